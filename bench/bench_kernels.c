@@ -0,0 +1,128 @@
+// throughput of lexer_next_token with each skip-kernel set
+//   cc -std=gnu2x -O2 -I.. bench_kernels.c -o bench_kernels && ./bench_kernels [MiB]
+//
+// the input looks like a real header: long `//` comment blocks, deep
+// indentation, long identifiers and numeric tables.
+
+#define IMPEL_C_LEXER
+#include "../c_lexer.h"
+#include <time.h>
+
+#define ROUNDS 5
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dull;
+static uint32_t rng(void){
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(rng_state >> 33);
+}
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static const char* idents[] = {
+    "lexer_next_token", "KeywordsTable", "src_len", "result", "LEXER_BUFFER_CAPACITY",
+    "create_token_with_location", "index", "uint32_t", "struct", "static", "const",
+    "return", "x", "CFile", "token_buf_noalloc", "__attribute__", "size_t",
+};
+
+static size_t emit(char* dst, const char* s){
+    size_t n = strlen(s);
+    memcpy(dst, s, n);
+    return n;
+}
+
+static char* generate(size_t target, size_t* out_len){
+    char* src = malloc(target + 4096);
+    size_t len = 0;
+    uint32_t nidents = sizeof(idents) / sizeof(idents[0]);
+    while(len < target){
+        switch(rng() % 4){
+            case 0: // comment block
+                for(uint32_t l = 0, n = 4 + rng() % 12; l < n; l++){
+                    len += emit(&src[len], "// Permission is hereby granted, free of charge, to any person obtaining a copy of this software\n");
+                }
+                break;
+            case 1: // indented declarations
+                for(uint32_t l = 0, n = 4 + rng() % 8; l < n; l++){
+                    uint32_t indent = 4 * (1 + rng() % 4);
+                    memset(&src[len], ' ', indent);
+                    len += indent;
+                    len += emit(&src[len], idents[rng() % nidents]);
+                    src[len++] = ' ';
+                    len += emit(&src[len], idents[rng() % nidents]);
+                    len += emit(&src[len], " = ");
+                    len += emit(&src[len], idents[rng() % nidents]);
+                    len += emit(&src[len], "(a, b);  // trailing note about this call\n");
+                }
+                break;
+            case 2: // numeric table
+                for(uint32_t l = 0, n = 2 + rng() % 6; l < n; l++){
+                    len += emit(&src[len], "\t");
+                    for(int k = 0; k < 8; k++){
+                        len += (size_t)sprintf(&src[len], "%u, ", rng());
+                    }
+                    src[len++] = '\n';
+                }
+                break;
+            default: // blank lines and alignment
+                len += emit(&src[len], "\n#define ALIGNED_NAME                                  1234567\n\n");
+                break;
+        }
+    }
+    src[len] = '\0';
+    *out_len = len;
+    return src;
+}
+
+static uint64_t run(const char* src, uint32_t len, const LexerKernels* k, uint64_t* tokens){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    uint64_t hash = 1469598103934665603ull;
+    *tokens = 0;
+    for(Token t = lexer_next_token(&lex); t.kind != Tok_eof; t = lexer_next_token(&lex)){
+        hash = (hash ^ ((uint64_t)t.kind << 32 | t.loc.offset)) * 1099511628211ull;
+        hash = (hash ^ ((uint64_t)t.loc.line << 32 | t.loc.len)) * 1099511628211ull;
+        *tokens += 1;
+    }
+    lexer_deinit(&lex);
+    return hash;
+}
+
+int main(int argc, char** argv){
+    size_t mib = argc > 1 ? (size_t)atoi(argv[1]) : 64;
+    size_t len = 0;
+    char* src = generate(mib << 20, &len);
+    const char* names[] = {"scalar", "sse2", "avx2"};
+    uint64_t reference = 0;
+    double scalar_time = 0;
+
+    printf("input: %.1f MiB, best of %d rounds\n", (double)len / (1 << 20), ROUNDS);
+    for(int i = 0; i < 3; i++){
+        const LexerKernels* k = lexer_kernels_by_name(names[i]);
+        if(!k){
+            printf("%-7s unsupported on this cpu\n", names[i]);
+            continue;
+        }
+        uint64_t tokens = 0, hash = 0;
+        double best = 1e30;
+        for(int r = 0; r < ROUNDS; r++){
+            double t0 = now_sec();
+            hash = run(src, (uint32_t)len, k, &tokens);
+            double t = now_sec() - t0;
+            if(t < best) best = t;
+        }
+        if(i == 0){
+            reference = hash;
+            scalar_time = best;
+        }
+        printf("%-7s %8.1f MB/s  %6.1f Mtok/s  %.2fx%s\n", k->name, (double)len / best / 1e6,
+               (double)tokens / best / 1e6, scalar_time / best, hash == reference ? "" : "  TOKEN STREAM MISMATCH");
+        if(hash != reference) return 1;
+    }
+    printf("default kernels: %s\n", lexer_kernels_detect()->name);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// micro-benchmark: keyword classification of identifiers
+//   cc -std=gnu2x -O2 -I.. bench_keywords.c -o bench_keywords && ./bench_keywords
+//
+// compares the old linear memcmp scan over every keyword with the perfect
+// hash used by lexer_next_token, on identifier-heavy synthetic input.
+
+#define IMPEL_C_LEXER
+#include "../c_lexer.h"
+#include <time.h>
+
+#define IDENT_COUNT (1u << 20)
+#define ROUNDS 20
+
+static const char* words[] = {
+    "return", "const", "static", "if", "else", "for", "while", "struct", "int", "char",
+    "unsigned", "sizeof", "void", "extern", "_Bool", "nullptr", "u8", "u32", "i64", "f32",
+    "i", "j", "n", "in", "len", "index", "buffer", "result", "lexer", "token_kind",
+    "source", "offset", "state", "count", "size_t", "uint32_t", "ptr", "next", "data",
+    "KeywordsTable", "create_token", "src_len", "is_valid", "iterator", "default_value",
+};
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+static uint32_t rng(void){
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(rng_state >> 33);
+}
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#define LINEAR_ENTRY(word, first, last) {#word, sizeof(#word) - 1, Tok_keyword_##word},
+static const KeywordEntry LinearKeywords[] = { C_LEXER_KEYWORDS(LINEAR_ENTRY) };
+
+// the lookup lexer_next_token used before the perfect hash, with the
+// prefix-matching bug fixed so both sides return the same kinds
+static TokenKind keyword_lookup_linear(const char* ident, uint32_t len){
+    TokenKind kind = Tok_identifier;
+    for(size_t i = 0; i < sizeof(LinearKeywords) / sizeof(LinearKeywords[0]) ; i++ ){
+        const KeywordEntry* e = &LinearKeywords[i];
+        if(e->len == len && !memcmp(ident, e->name, len)){
+            kind = e->kind;
+        }
+    }
+    return kind;
+}
+
+int main(void){
+    uint32_t word_count = sizeof(words) / sizeof(words[0]);
+    size_t cap = (size_t)IDENT_COUNT * 16;
+    char* source = calloc(cap + 1, 1);
+    size_t len = 0;
+    for(uint32_t i = 0; i < IDENT_COUNT; i++){
+        const char* w = words[rng() % word_count];
+        size_t n = strlen(w);
+        memcpy(&source[len], w, n);
+        len += n;
+        source[len++] = (i % 12 == 11) ? '\n' : ' ';
+    }
+    source[len] = '\0';
+
+    uint32_t* offsets = malloc(IDENT_COUNT * sizeof(uint32_t));
+    uint32_t* lens = malloc(IDENT_COUNT * sizeof(uint32_t));
+    uint32_t idents = 0;
+    Lexer lex = lexer_init_s(source, (uint32_t)len);
+    for(Token t = lexer_next_token(&lex); t.kind != Tok_eof; t = lexer_next_token(&lex)){
+        offsets[idents] = t.loc.offset;
+        lens[idents] = t.loc.len;
+        idents++;
+    }
+
+    uint64_t sink = 0;
+    double t0 = now_sec();
+    for(int r = 0; r < ROUNDS; r++)
+        for(uint32_t i = 0; i < idents; i++)
+            sink += keyword_lookup_linear(&source[offsets[i]], lens[i]);
+    double linear = now_sec() - t0;
+
+    uint64_t check = 0;
+    t0 = now_sec();
+    for(int r = 0; r < ROUNDS; r++)
+        for(uint32_t i = 0; i < idents; i++)
+            check += keyword_lookup(&source[offsets[i]], lens[i]);
+    double hashed = now_sec() - t0;
+
+    t0 = now_sec();
+    uint64_t tokens = 0;
+    for(int r = 0; r < ROUNDS; r++){
+        lex = lexer_init_s(source, (uint32_t)len);
+        while(lexer_next_token(&lex).kind != Tok_eof) tokens++;
+    }
+    double full = now_sec() - t0;
+
+    double n = (double)idents * ROUNDS;
+    printf("identifiers        : %u x %d rounds\n", idents, ROUNDS);
+    printf("linear memcmp scan : %7.2f ns/ident\n", linear * 1e9 / n);
+    printf("perfect hash       : %7.2f ns/ident (%.1fx)\n", hashed * 1e9 / n, linear / hashed);
+    printf("lexer_next_token   : %7.2f ns/token, %.1f MB/s\n", full * 1e9 / (double)tokens, (double)len * ROUNDS / full / 1e6);
+    if(sink != check){
+        fprintf(stderr, "mismatch between linear and hashed lookup\n");
+        return 1;
+    }
+    free(offsets);
+    free(lens);
+    free(source);
+    return 0;
+}
@@ -0,0 +1,682 @@
+// lexer benchmark suite: every lexing path over a set of synthetic corpora
+//   make bench_lexer && ./build/bench_lexer [-m MiB] [-r rounds] [-o results] [-c baseline] [-g dir] [corpus...]
+//
+// The corpora come from a fixed seed, so two runs lex the same bytes:
+//   identifiers  declarations and calls with long names and keywords
+//   comments     long `//` and `/* */` prose comments around short code lines
+//   strings      tables of string and char literals with escapes
+//   operators    deep operator soup on one letter operands
+//   numbers      data tables of decimal, hex and floating literals
+//   unicode      UTF-8 identifiers, comments and strings around ASCII code
+//   long_line    everything on a handful of huge lines
+//   mixed        blocks of all of the above
+// For every corpus each path reports the best of `rounds` runs as MB/s,
+// tokens/s and cycles/byte (TSC cycles, 0 off x86), plus the peak RSS while
+// it ran. Every path must produce the token stream of the first one.
+// `-o` writes one JSON object per measurement, `-c` reads such a file and
+// prints the MB/s ratio of this run against it, `-g` writes the corpora out
+// as .c files so other tools (clex) can be run on them.
+// tokenize_all/utf8 validates the source as UTF-8 first.
+// The backtrack paths look past every `(` and rewind, once by restoring the
+// lexer and lexing again and once through a LexerLookahead.
+// A new fast path goes into `paths` below.
+
+#define IMPEL_C_LEXER
+#define IMPEL_C_LEXER_PARALLEL
+#include "../c_lexer_parallel.h"
+#include <time.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#define MAX_RESULTS 256
+
+static uint64_t rng_state = 0x6a09e667f3bcc909ull;
+static uint32_t rng(void){
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(rng_state >> 33);
+}
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint64_t cycles(void){
+#ifdef C_LEXER_X86
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// VmHWM after clearing it through clear_refs, so each path gets its own peak.
+// glibc keeps freed heap pages, they are handed back first so that the peak
+// of the previous path doesn't carry over.
+static void peak_rss_reset(void){
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if(!f) return;
+    fputs("5", f);
+    fclose(f);
+}
+
+static uint64_t peak_rss_kb(void){
+    FILE* f = fopen("/proc/self/status", "r");
+    if(!f) return 0;
+    char line[256];
+    uint64_t kb = 0;
+    while(fgets(line, sizeof(line), f)){
+        if(!strncmp(line, "VmHWM:", 6)){
+            kb = strtoull(line + 6, NULL, 10);
+            break;
+        }
+    }
+    fclose(f);
+    return kb;
+}
+
+// corpus generators
+
+typedef struct Corpus {
+    char* src;
+    size_t len;
+    size_t cap;
+} Corpus;
+
+static void put(Corpus* c, const char* s){
+    size_t n = strlen(s);
+    memcpy(&c->src[c->len], s, n);
+    c->len += n;
+}
+
+static void put_char(Corpus* c, char ch){
+    c->src[c->len++] = ch;
+}
+
+static const char* idents[] = {
+    "lexer_next_token", "token_buffer_reserve", "src_len", "result", "LEXER_STREAM_WINDOW",
+    "create_token_with_location", "index", "uint32_t", "size_t", "CFile", "interner_intern",
+    "x", "i", "node", "parse_declaration_specifiers", "__attribute__", "TokenBuffer", "kinds",
+};
+static const char* keywords[] = {
+    "static", "const", "return", "struct", "unsigned", "while", "if", "else", "for", "switch",
+    "case", "break", "typedef", "enum", "void", "int", "char", "sizeof",
+};
+static const char* operators[] = {
+    "+", "-", "*", "/", "%", "<<", ">>", "<", ">", "<=", ">=", "==", "!=", "&", "|", "^",
+    "&&", "||", "->", ".", "<<=", ">>=", "+=", "-=", "*=", "/=", "&=", "|=", "^=", "?", ":",
+};
+
+#define PICK(table) table[rng() % (sizeof(table) / sizeof(table[0]))]
+
+static void gen_identifiers(Corpus* c){
+    uint32_t indent = 4 * (rng() % 4);
+    for(uint32_t i = 0; i < indent; i++) put_char(c, ' ');
+    switch(rng() % 3){
+        case 0:
+            put(c, PICK(keywords));
+            put_char(c, ' ');
+            put(c, PICK(idents));
+            put(c, " = ");
+            put(c, PICK(idents));
+            put(c, "(");
+            put(c, PICK(idents));
+            put(c, ", ");
+            put(c, PICK(idents));
+            put(c, ");\n");
+            break;
+        case 1:
+            put(c, PICK(keywords));
+            put_char(c, ' ');
+            put(c, PICK(keywords));
+            put_char(c, ' ');
+            put(c, PICK(idents));
+            put(c, "* ");
+            put(c, PICK(idents));
+            put(c, ";\n");
+            break;
+        default:
+            put(c, PICK(idents));
+            put(c, "->");
+            put(c, PICK(idents));
+            put(c, "[");
+            put(c, PICK(idents));
+            put(c, "] = ");
+            put(c, PICK(idents));
+            put(c, ".");
+            put(c, PICK(idents));
+            put(c, ";\n");
+            break;
+    }
+}
+
+static void gen_comments(Corpus* c){
+    bool block = rng() % 2;
+    if(block) put(c, "/*\n");
+    for(uint32_t l = 0, n = 3 + rng() % 10; l < n; l++){
+        put(c, block ? " * " : "// ");
+        put(c, "Permission is hereby granted, free of charge, to any person obtaining a copy of this ");
+        put(c, "software and associated documentation files, to deal in the Software without restriction\n");
+    }
+    if(block) put(c, " */\n");
+    put(c, "int ");
+    put(c, PICK(idents));
+    put(c, ";  // and a trailing note\n");
+}
+
+static const char* string_bodies[] = {
+    "hello, world", "line one\\nline two\\n", "tab\\tseparated\\tvalues", "quote \\\" inside",
+    "back\\\\slash", "%s: expected %u bytes but got %u", "", "0123456789abcdef0123456789abcdef",
+    "usage: tool [-v] [-o output] [-j jobs] input... reads every input and writes the merged result",
+};
+static const char* char_bodies[] = {"a", "\\n", "\\'", "\"", "\\\\", "\\0", "z"};
+
+static void gen_strings(Corpus* c){
+    put(c, "    { ");
+    for(uint32_t k = 0, n = 2 + rng() % 4; k < n; k++){
+        put_char(c, '"');
+        put(c, PICK(string_bodies));
+        put(c, "\", ");
+    }
+    put_char(c, '\'');
+    put(c, PICK(char_bodies));
+    put(c, "' },\n");
+}
+
+static void gen_operators(Corpus* c){
+    uint32_t depth = 0;
+    put(c, "    r = ");
+    for(uint32_t k = 0, n = 8 + rng() % 24; k < n; k++){
+        if(rng() % 4 == 0){
+            put_char(c, '(');
+            depth += 1;
+        }
+        put_char(c, (char)('a' + rng() % 26));
+        if(depth && rng() % 4 == 0){
+            put_char(c, ')');
+            depth -= 1;
+        }
+        put(c, PICK(operators));
+    }
+    put_char(c, 'z');
+    while(depth--) put_char(c, ')');
+    put(c, ";\n");
+}
+
+static const char* number_suffixes[] = {"", "", "", "u", "U", "ul", "LL", "ull"};
+static const char* float_suffixes[] = {"", "", "f", "F", "L"};
+
+static void gen_numbers(Corpus* c){
+    char buf[64];
+    put(c, "   ");
+    for(uint32_t k = 0, n = 4 + rng() % 8; k < n; k++){
+        uint64_t v = (uint64_t)rng() << 32 | rng();
+        v >>= rng() % 64;
+        switch(rng() % 4){
+            case 0: snprintf(buf, sizeof buf, " %llu%s,", (unsigned long long)v, PICK(number_suffixes)); break;
+            case 1: snprintf(buf, sizeof buf, " 0x%llx%s,", (unsigned long long)v, PICK(number_suffixes)); break;
+            case 2: snprintf(buf, sizeof buf, " %.*f%s,", (int)(rng() % 10), (double)v / 1e9, PICK(float_suffixes)); break;
+            default: snprintf(buf, sizeof buf, " %.*e%s,", (int)(rng() % 17), (double)v * 1e-12, PICK(float_suffixes)); break;
+        }
+        put(c, buf);
+    }
+    put_char(c, '\n');
+}
+
+static const char* unicode_idents[] = {
+    "größe", "Δx", "naïve_count", "距离", "вектор", "π", "résumé_len", "東京", "αβγ", "x_ß",
+};
+static const char* unicode_texts[] = {
+    "Größe in Bytes, ohne die Null am Ende", "длина строки без завершающего нуля", "文字列の長さ、終端を除く",
+    "naïve résumé: €5 → ±0.5°", "emoji 🙂 and math ∑ ∞ ≤ ≥",
+};
+
+static void gen_unicode(Corpus* c){
+    switch(rng() % 3){
+        case 0:
+            put(c, "    ");
+            put(c, PICK(keywords));
+            put_char(c, ' ');
+            put(c, PICK(unicode_idents));
+            put(c, " = ");
+            put(c, PICK(unicode_idents));
+            put(c, " * ");
+            put(c, PICK(idents));
+            put(c, ";\n");
+            break;
+        case 1:
+            put(c, "    // ");
+            put(c, PICK(unicode_texts));
+            put_char(c, '\n');
+            break;
+        default:
+            put(c, "    puts(\"");
+            put(c, PICK(unicode_texts));
+            put(c, "\");\n");
+            break;
+    }
+}
+
+// a line of a few MiB, the generators' pieces joined by spaces
+static void gen_long_line(Corpus* c){
+    size_t end = c->len + (4u << 20);
+    if(end > c->cap - 4096) end = c->cap - 4096;
+    while(c->len < end){
+        size_t start = c->len;
+        switch(rng() % 4){
+            case 0: gen_identifiers(c); break;
+            case 1: gen_strings(c); break;
+            case 2: gen_operators(c); break;
+            default: put(c, "0x1f2e3d4c 1234567 42 "); break;
+        }
+        for(size_t i = start; i < c->len; i++){
+            if(c->src[i] == '\n') c->src[i] = ' ';
+        }
+    }
+    put_char(c, '\n');
+}
+
+static void gen_mixed(Corpus* c){
+    switch(rng() % 5){
+        case 0: for(int i = 0; i < 8; i++) gen_identifiers(c); break;
+        case 1: gen_comments(c); break;
+        case 2: for(int i = 0; i < 4; i++) gen_strings(c); break;
+        case 3: for(int i = 0; i < 4; i++) gen_operators(c); break;
+        default: put(c, "\n#define TABLE_SIZE 1021\n#include \"generated.h\"\n\n"); break;
+    }
+}
+
+typedef struct CorpusKind {
+    const char* name;
+    void (*gen)(Corpus* c);
+} CorpusKind;
+
+static const CorpusKind corpora[] = {
+    {"identifiers", gen_identifiers},
+    {"comments", gen_comments},
+    {"strings", gen_strings},
+    {"operators", gen_operators},
+    {"numbers", gen_numbers},
+    {"unicode", gen_unicode},
+    {"long_line", gen_long_line},
+    {"mixed", gen_mixed},
+};
+#define CORPUS_COUNT (sizeof(corpora) / sizeof(corpora[0]))
+
+static Corpus corpus_generate(const CorpusKind* kind, size_t target){
+    Corpus c = { .cap = target + (4u << 20) + 8192 };
+    c.src = malloc(c.cap + CFILE_PADDING);
+    if(!c.src){
+        fprintf(stderr, "bench_lexer: failed to allocate %zu bytes\n", c.cap);
+        exit(1);
+    }
+    rng_state = 0x6a09e667f3bcc909ull;
+    while(c.len < target) kind->gen(&c);
+    memset(&c.src[c.len], 0, CFILE_PADDING);
+    return c;
+}
+
+// lexing paths
+
+typedef struct PathResult {
+    uint64_t tokens;
+    uint64_t hash;
+} PathResult;
+
+typedef struct Path {
+    const char* name;
+    const char* kernels; // kernel set to force, NULL for the detected one
+    PathResult (*run)(const char* src, uint32_t len, const LexerKernels* k);
+} Path;
+
+static uint64_t hash_token(uint64_t hash, TokenKind kind, uint32_t offset){
+    return (hash ^ ((uint64_t)kind << 32 | offset)) * 1099511628211ull;
+}
+
+static PathResult run_next_token(const char* src, uint32_t len, const LexerKernels* k){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    PathResult r = { .hash = 1469598103934665603ull };
+    for(Token t = lexer_next_token(&lex); t.kind != Tok_eof; t = lexer_next_token(&lex)){
+        r.hash = hash_token(r.hash, t.kind, t.loc.offset);
+        r.tokens += 1;
+    }
+    lexer_deinit(&lex);
+    return r;
+}
+
+static PathResult run_next_token_dfa(const char* src, uint32_t len, const LexerKernels* k){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    PathResult r = { .hash = 1469598103934665603ull };
+    for(Token t = lexer_next_token_dfa(&lex); t.kind != Tok_eof; t = lexer_next_token_dfa(&lex)){
+        r.hash = hash_token(r.hash, t.kind, t.loc.offset);
+        r.tokens += 1;
+    }
+    lexer_deinit(&lex);
+    return r;
+}
+
+// A parser that looks past every `(` for up to 32 tokens to its `)` and
+// then backtracks, the way a cast is told from a parenthesized expression.
+// The first one saves and restores the lexer state and lexes again.
+#define BACKTRACK_SPAN 32
+
+static PathResult run_backtrack_relex(const char* src, uint32_t len, const LexerKernels* k){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    PathResult r = { .hash = 1469598103934665603ull };
+    for(Token t = lexer_next_token(&lex); t.kind != Tok_eof; t = lexer_next_token(&lex)){
+        r.hash = hash_token(r.hash, t.kind, t.loc.offset);
+        r.tokens += 1;
+        if(t.kind != Tok_l_paren) continue;
+        uint32_t index = lex.index, line = lex.line, diag_len = lex.diag_len;
+        for(uint32_t n = 0, depth = 1; depth && n < BACKTRACK_SPAN; n++){
+            Token u = lexer_next_token(&lex);
+            if(u.kind == Tok_eof) break;
+            depth += (u.kind == Tok_l_paren) - (u.kind == Tok_r_paren);
+        }
+        lex.index = index;
+        lex.line = line;
+        lex.diag_len = diag_len;
+    }
+    lexer_deinit(&lex);
+    return r;
+}
+
+static PathResult run_backtrack_ring(const char* src, uint32_t len, const LexerKernels* k){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    LexerLookahead la;
+    lexer_lookahead_init(&la, &lex);
+    PathResult r = { .hash = 1469598103934665603ull };
+    for(Token t = lexer_lookahead_next(&la); t.kind != Tok_eof; t = lexer_lookahead_next(&la)){
+        r.hash = hash_token(r.hash, t.kind, t.loc.offset);
+        r.tokens += 1;
+        if(t.kind != Tok_l_paren) continue;
+        LexerCheckpoint cp = lexer_checkpoint(&la);
+        for(uint32_t n = 0, depth = 1; depth && n < BACKTRACK_SPAN; n++){
+            Token u = lexer_lookahead_next(&la);
+            if(u.kind == Tok_eof) break;
+            depth += (u.kind == Tok_l_paren) - (u.kind == Tok_r_paren);
+        }
+        lexer_rewind(&la, cp);
+    }
+    lexer_deinit(&lex);
+    return r;
+}
+
+static PathResult hash_buffer(const TokenBuffer* buf){
+    PathResult r = { .hash = 1469598103934665603ull };
+    for(uint32_t i = 0; i < buf->len; i++){
+        if(buf->kinds[i] == Tok_eof) break;
+        r.hash = hash_token(r.hash, (TokenKind)buf->kinds[i], buf->offsets[i]);
+        r.tokens += 1;
+    }
+    return r;
+}
+
+static PathResult run_tokenize_all(const char* src, uint32_t len, const LexerKernels* k){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    TokenBuffer buf;
+    token_buffer_init(&buf, 0, len);
+    lexer_tokenize_all(&lex, &buf);
+    PathResult r = hash_buffer(&buf);
+    token_buffer_deinit(&buf);
+    lexer_deinit(&lex);
+    return r;
+}
+
+// tokenize_all with the number literals decoded into a NumberTable
+static PathResult run_tokenize_numbers(const char* src, uint32_t len, const LexerKernels* k){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    NumberTable numbers = {0};
+    lex.numbers = &numbers;
+    TokenBuffer buf;
+    token_buffer_init(&buf, 0, len);
+    lexer_tokenize_all(&lex, &buf);
+    PathResult r = hash_buffer(&buf);
+    token_buffer_deinit(&buf);
+    number_table_deinit(&numbers);
+    lexer_deinit(&lex);
+    return r;
+}
+
+// tokenize_all after lexer_validate_utf8, which lets identifiers skip the checks
+static PathResult run_tokenize_utf8(const char* src, uint32_t len, const LexerKernels* k){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    lexer_validate_utf8(&lex);
+    TokenBuffer buf;
+    token_buffer_init(&buf, 0, len);
+    lexer_tokenize_all(&lex, &buf);
+    PathResult r = hash_buffer(&buf);
+    token_buffer_deinit(&buf);
+    lexer_deinit(&lex);
+    return r;
+}
+
+static uint32_t parallel_threads;
+
+static PathResult run_parallel(const char* src, uint32_t len, const LexerKernels* k){
+    Lexer lex = lexer_init_s(src, len);
+    lex.kernels = k;
+    TokenBuffer buf;
+    token_buffer_init(&buf, 0, len);
+    lexer_tokenize_parallel(&lex, &buf, parallel_threads);
+    PathResult r = hash_buffer(&buf);
+    token_buffer_deinit(&buf);
+    lexer_deinit(&lex);
+    return r;
+}
+
+static const Path paths[] = {
+    {"next_token/scalar", "scalar", run_next_token},
+    {"next_token/sse2", "sse2", run_next_token},
+    {"next_token/avx2", "avx2", run_next_token},
+    {"next_token_dfa", NULL, run_next_token_dfa},
+    {"backtrack/relex", NULL, run_backtrack_relex},
+    {"backtrack/ring", NULL, run_backtrack_ring},
+    {"tokenize_all", NULL, run_tokenize_all},
+    {"tokenize_all/numbers", NULL, run_tokenize_numbers},
+    {"tokenize_all/utf8", NULL, run_tokenize_utf8},
+    {"tokenize_parallel", NULL, run_parallel},
+};
+#define PATH_COUNT (sizeof(paths) / sizeof(paths[0]))
+
+// results
+
+typedef struct Result {
+    char corpus[32];
+    char path[32];
+    uint64_t bytes;
+    uint64_t tokens;
+    double seconds;
+    double cycles_per_byte;
+    uint64_t peak_rss_kb;
+} Result;
+
+static double mb_per_s(const Result* r){ return (double)r->bytes / r->seconds / 1e6; }
+static double tokens_per_s(const Result* r){ return (double)r->tokens / r->seconds; }
+
+static void result_write(FILE* out, const Result* r){
+    fprintf(out, "{\"corpus\":\"%s\",\"path\":\"%s\",\"bytes\":%llu,\"tokens\":%llu,\"seconds\":%.6f,"
+                 "\"mb_per_s\":%.1f,\"tokens_per_s\":%.0f,\"cycles_per_byte\":%.3f,\"peak_rss_kb\":%llu}\n",
+            r->corpus, r->path, (unsigned long long)r->bytes, (unsigned long long)r->tokens, r->seconds,
+            mb_per_s(r), tokens_per_s(r), r->cycles_per_byte, (unsigned long long)r->peak_rss_kb);
+}
+
+// reads the files result_write produces, one object per line in that order
+static uint32_t results_read(const char* name, Result* out, uint32_t cap){
+    FILE* f = fopen(name, "r");
+    if(!f) return 0;
+    char line[512];
+    uint32_t n = 0;
+    while(n < cap && fgets(line, sizeof(line), f)){
+        Result r = {0};
+        unsigned long long bytes, tokens, rss;
+        if(sscanf(line, "{\"corpus\":\"%31[^\"]\",\"path\":\"%31[^\"]\",\"bytes\":%llu,\"tokens\":%llu,\"seconds\":%lf,"
+                        "\"mb_per_s\":%*f,\"tokens_per_s\":%*f,\"cycles_per_byte\":%lf,\"peak_rss_kb\":%llu}",
+                  r.corpus, r.path, &bytes, &tokens, &r.seconds, &r.cycles_per_byte, &rss) != 7) continue;
+        r.bytes = bytes;
+        r.tokens = tokens;
+        r.peak_rss_kb = rss;
+        out[n++] = r;
+    }
+    fclose(f);
+    return n;
+}
+
+static const Result* results_find(const Result* results, uint32_t len, const Result* key){
+    for(uint32_t i = 0; i < len; i++){
+        if(!strcmp(results[i].corpus, key->corpus) && !strcmp(results[i].path, key->path)) return &results[i];
+    }
+    return NULL;
+}
+
+static void usage(FILE* out){
+    fprintf(out,
+        "usage: bench_lexer [-m MiB] [-r rounds] [-o results] [-c baseline] [-g dir] [corpus...]\n"
+        "  -m MiB       size of every corpus, default 32\n"
+        "  -r rounds    runs per measurement, the best one counts, default 5\n"
+        "  -o FILE      write the results as JSON lines\n"
+        "  -c FILE      compare against the results of an earlier run\n"
+        "  -g DIR       write the corpora to DIR/<corpus>.c and exit\n"
+        "  corpus       any of identifiers comments strings operators numbers unicode\n"
+        "               long_line mixed\n");
+}
+
+int main(int argc, char** argv){
+    size_t mib = 32;
+    int rounds = 5;
+    const char* out_name = NULL;
+    const char* baseline_name = NULL;
+    const char* gen_dir = NULL;
+    bool selected[CORPUS_COUNT] = {0};
+    bool any_selected = false;
+
+    for(int i = 1; i < argc; i++){
+        const char* arg = argv[i];
+        if(!strcmp(arg, "-m") && i + 1 < argc){
+            mib = (size_t)atoi(argv[++i]);
+        }else if(!strcmp(arg, "-r") && i + 1 < argc){
+            rounds = atoi(argv[++i]);
+        }else if(!strcmp(arg, "-o") && i + 1 < argc){
+            out_name = argv[++i];
+        }else if(!strcmp(arg, "-c") && i + 1 < argc){
+            baseline_name = argv[++i];
+        }else if(!strcmp(arg, "-g") && i + 1 < argc){
+            gen_dir = argv[++i];
+        }else if(!strcmp(arg, "-h") || !strcmp(arg, "--help")){
+            usage(stdout);
+            return 0;
+        }else{
+            size_t k = 0;
+            while(k < CORPUS_COUNT && strcmp(corpora[k].name, arg)) k++;
+            if(k == CORPUS_COUNT){
+                usage(stderr);
+                return 1;
+            }
+            selected[k] = true;
+            any_selected = true;
+        }
+    }
+    if(mib == 0 || mib >= 4000 || rounds < 1){
+        usage(stderr);
+        return 1;
+    }
+
+    static Result baseline[MAX_RESULTS];
+    uint32_t baseline_len = 0;
+    if(baseline_name){
+        baseline_len = results_read(baseline_name, baseline, MAX_RESULTS);
+        if(!baseline_len){
+            fprintf(stderr, "bench_lexer: no results in `%s`\n", baseline_name);
+            return 1;
+        }
+    }
+    FILE* out = NULL;
+    if(out_name && !(out = fopen(out_name, "w"))){
+        fprintf(stderr, "bench_lexer: cannot write `%s`\n", out_name);
+        return 1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    parallel_threads = cpus > 0 ? (uint32_t)cpus : 1;
+
+    int status = 0;
+    if(!gen_dir){
+        printf("%zu MiB per corpus, best of %d rounds, default kernels %s, %u threads\n", mib, rounds,
+               lexer_kernels_detect()->name, parallel_threads);
+        printf("%-12s %-20s %9s %9s %8s %9s%s\n", "corpus", "path", "MB/s", "Mtok/s", "cyc/B", "rss MiB",
+               baseline_len ? "  vs baseline" : "");
+    }
+    for(size_t c = 0; c < CORPUS_COUNT; c++){
+        if(any_selected && !selected[c]) continue;
+        Corpus corpus = corpus_generate(&corpora[c], mib << 20);
+
+        if(gen_dir){
+            char name[4096];
+            snprintf(name, sizeof(name), "%s/%s.c", gen_dir, corpora[c].name);
+            FILE* f = fopen(name, "w");
+            if(!f || fwrite(corpus.src, 1, corpus.len, f) != corpus.len){
+                fprintf(stderr, "bench_lexer: cannot write `%s`\n", name);
+                status = 1;
+            }
+            if(f) fclose(f);
+            free(corpus.src);
+            continue;
+        }
+
+        uint64_t reference = 0;
+        bool have_reference = false;
+        for(size_t p = 0; p < PATH_COUNT; p++){
+            const LexerKernels* k = paths[p].kernels ? lexer_kernels_by_name(paths[p].kernels) : lexer_kernels_detect();
+            if(!k) continue;
+
+            Result r = { .bytes = corpus.len };
+            snprintf(r.corpus, sizeof(r.corpus), "%s", corpora[c].name);
+            snprintf(r.path, sizeof(r.path), "%s", paths[p].name);
+            r.seconds = 1e30;
+            PathResult pr = {0};
+            peak_rss_reset();
+            for(int round = 0; round < rounds; round++){
+                uint64_t c0 = cycles();
+                double t0 = now_sec();
+                pr = paths[p].run(corpus.src, (uint32_t)corpus.len, k);
+                double t = now_sec() - t0;
+                uint64_t c1 = cycles();
+                if(t < r.seconds){
+                    r.seconds = t;
+                    r.cycles_per_byte = (double)(c1 - c0) / (double)corpus.len;
+                }
+            }
+            r.tokens = pr.tokens;
+            r.peak_rss_kb = peak_rss_kb();
+
+            printf("%-12s %-20s %9.1f %9.1f %8.2f %9.1f", r.corpus, r.path, mb_per_s(&r), tokens_per_s(&r) / 1e6,
+                   r.cycles_per_byte, (double)r.peak_rss_kb / 1024);
+            const Result* old = baseline_len ? results_find(baseline, baseline_len, &r) : NULL;
+            if(old) printf("  %.2fx", mb_per_s(&r) / mb_per_s(old));
+            if(have_reference && pr.hash != reference){
+                printf("  TOKEN STREAM MISMATCH");
+                status = 1;
+            }
+            printf("\n");
+            if(!have_reference){
+                reference = pr.hash;
+                have_reference = true;
+            }
+            if(out) result_write(out, &r);
+        }
+        free(corpus.src);
+    }
+    if(out) fclose(out);
+    return status;
+}
@@ -0,0 +1,99 @@
+// scaling of lexer_tokenize_parallel against a serial lexer_tokenize_all
+//   cc -std=gnu2x -O2 -pthread -I.. bench_parallel.c -o bench_parallel && ./bench_parallel [MiB]
+//
+// the input is an amalgamation-like mix with multi-line string literals, so
+// some chunk cuts land inside a literal and have to be re-synchronized.
+// every run is checked token for token against the serial output.
+
+#define IMPEL_C_LEXER
+#define IMPEL_C_LEXER_PARALLEL
+#include "../c_lexer_parallel.h"
+#include <time.h>
+
+#define ROUNDS 3
+
+static uint64_t rng_state = 0x853c49e6748fea9bull;
+static uint32_t rng(void){
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(rng_state >> 33);
+}
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static const char* pieces[] = {
+    "static uint32_t table_lookup(const char* key, uint32_t len) {\n",
+    "    for (uint32_t i = 0; i < len; i++) { hash = (hash ^ key[i]) * 16777619; }\n",
+    "    return hash % 1021;\n}\n",
+    "// generated by the table compiler, do not edit\n",
+    "    { 12, 34, 56, 78, 90, 12, 34, 56 },\n",
+    "const char* banner = \"line one\nline two\nline three with // no comment\n\";\n",
+    "    if (a->next != b && c <= d) { x <<= 2; y >>= 1; z += w; }\n",
+    "#include \"generated_header.h\"\n",
+    "    'a', '\\n', '\\'', '\"',\n",
+};
+
+static int same(const TokenBuffer* a, const TokenBuffer* b){
+    if(a->len != b->len) return 0;
+    return !memcmp(a->kinds, b->kinds, a->len)
+        && !memcmp(a->offsets, b->offsets, a->len * sizeof(uint32_t))
+        && !memcmp(a->lengths, b->lengths, a->len * sizeof(uint32_t))
+        && !memcmp(a->lines, b->lines, a->len * sizeof(uint32_t));
+}
+
+int main(int argc, char** argv){
+    size_t target = (argc > 1 ? (size_t)atoi(argv[1]) : 256) << 20;
+    char* src = malloc(target + 4096);
+    size_t len = 0;
+    uint32_t npieces = sizeof(pieces) / sizeof(pieces[0]);
+    while(len < target){
+        const char* p = pieces[rng() % npieces];
+        size_t n = strlen(p);
+        memcpy(&src[len], p, n);
+        len += n;
+    }
+    src[len] = '\0';
+
+    uint32_t flags = TokenBuffer_lengths | TokenBuffer_lines;
+    TokenBuffer serial, parallel;
+    token_buffer_init(&serial, flags, len);
+    token_buffer_init(&parallel, flags, len);
+
+    double serial_best = 1e30;
+    for(int r = 0; r < ROUNDS; r++){
+        token_buffer_reset(&serial);
+        Lexer lex = lexer_init_s(src, (uint32_t)len);
+        double t0 = now_sec();
+        lexer_tokenize_all(&lex, &serial);
+        double t = now_sec() - t0;
+        lexer_deinit(&lex);
+        if(t < serial_best) serial_best = t;
+    }
+    printf("input %.1f MiB, %u tokens, %ld cpus\n", (double)len / (1 << 20), serial.len, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("serial     %8.1f MB/s\n", (double)len / serial_best / 1e6);
+
+    for(uint32_t threads = 1; threads <= 32; threads *= 2){
+        double best = 1e30;
+        for(int r = 0; r < ROUNDS; r++){
+            token_buffer_reset(&parallel);
+            Lexer lex = lexer_init_s(src, (uint32_t)len);
+            double t0 = now_sec();
+            lexer_tokenize_parallel(&lex, &parallel, threads);
+            double t = now_sec() - t0;
+            lexer_deinit(&lex);
+            if(t < best) best = t;
+        }
+        int ok = same(&serial, &parallel);
+        printf("threads %2u %8.1f MB/s  %5.2fx%s\n", threads, (double)len / best / 1e6, serial_best / best,
+               ok ? "" : "  TOKEN STREAM MISMATCH");
+        if(!ok) return 1;
+    }
+
+    token_buffer_deinit(&serial);
+    token_buffer_deinit(&parallel);
+    free(src);
+    return 0;
+}
@@ -0,0 +1,110 @@
+// cost of one keystroke: token_buffer_relex against a full lexer_tokenize_all
+//   cc -std=gnu2x -O2 -I.. bench_relex.c -o bench_relex && ./bench_relex [lines]
+//
+// a source of `lines` lines gets single byte inserts and deletes at random
+// places, like typing in an editor. After every edit the buffer is compared
+// token for token with a full re-lex of the edited text.
+
+#define IMPEL_C_LEXER
+#include "../c_lexer.h"
+#include <time.h>
+
+#define EDITS 2000
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15ull;
+static uint32_t rng(void){
+    rng_state = rng_state * 6364136223846793005ull + 1442695040888963407ull;
+    return (uint32_t)(rng_state >> 33);
+}
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static const char* lines[] = {
+    "static uint32_t table_lookup(const char* key, uint32_t len) {\n",
+    "    for (uint32_t i = 0; i < len; i++) { hash = (hash ^ key[i]) * 16777619; }\n",
+    "    return hash % 1021;\n}\n",
+    "// keep the table in sync with the generator\n",
+    "    if (a->next != b && c <= d) { x <<= 2; y += w; }\n",
+    "#define TABLE_SIZE 1021\n",
+    "    puts(\"lookup failed\");\n",
+};
+
+// typing stays away from quotes so a literal never swallows the rest of the file
+static const char typed[] = "abcxyz_019 ;(){}+-*<=\n";
+
+static int same(const TokenBuffer* a, const TokenBuffer* b){
+    return a->len == b->len
+        && !memcmp(a->kinds, b->kinds, a->len)
+        && !memcmp(a->offsets, b->offsets, a->len * sizeof(uint32_t))
+        && !memcmp(a->lengths, b->lengths, a->len * sizeof(uint32_t))
+        && !memcmp(a->lines, b->lines, a->len * sizeof(uint32_t));
+}
+
+int main(int argc, char** argv){
+    uint32_t nlines = argc > 1 ? (uint32_t)atoi(argv[1]) : 100000;
+    size_t cap = (size_t)nlines * 96 + EDITS + CFILE_PADDING;
+    char* src = calloc(cap, 1);
+    uint32_t len = 0;
+    for(uint32_t l = 0; l < nlines; l++){
+        const char* p = lines[rng() % (sizeof(lines) / sizeof(lines[0]))];
+        size_t n = strlen(p);
+        memcpy(&src[len], p, n);
+        len += (uint32_t)n;
+    }
+
+    uint32_t flags = TokenBuffer_lengths | TokenBuffer_lines;
+    TokenBuffer tokens, full;
+    token_buffer_init(&tokens, flags, len);
+    token_buffer_init(&full, flags, len);
+    Lexer lex = lexer_init_s(src, len);
+    lexer_tokenize_all(&lex, &tokens);
+    lexer_deinit(&lex);
+
+    double relex_time = 0, full_time = 0;
+    uint64_t relexed = 0;
+    for(uint32_t e = 0; e < EDITS; e++){
+        TokenEdit edit = { .offset = rng() % len };
+        if(rng() % 2){
+            memmove(&src[edit.offset + 1], &src[edit.offset], len - edit.offset);
+            src[edit.offset] = typed[rng() % (sizeof(typed) - 1)];
+            edit.inserted = 1;
+            len += 1;
+        }else{
+            while(src[edit.offset] == '"') edit.offset += 1;
+            memmove(&src[edit.offset], &src[edit.offset + 1], len - edit.offset);
+            edit.deleted = 1;
+            len -= 1;
+        }
+
+        double t0 = now_sec();
+        TokenSplice splice = token_buffer_relex(&tokens, src, len, edit, NULL);
+        double t1 = now_sec();
+        token_buffer_reset(&full);
+        lex = lexer_init_s(src, len);
+        lexer_tokenize_all(&lex, &full);
+        lexer_deinit(&lex);
+        double t2 = now_sec();
+
+        relex_time += t1 - t0;
+        full_time += t2 - t1;
+        relexed += splice.added;
+        if(!same(&tokens, &full)){
+            printf("edit %u at %u: TOKEN STREAM MISMATCH\n", e, edit.offset);
+            return 1;
+        }
+    }
+
+    printf("%u lines, %.1f MiB, %u tokens, %d edits\n", nlines, (double)len / (1 << 20), tokens.len, EDITS);
+    printf("full   %9.1f us/edit\n", full_time / EDITS * 1e6);
+    printf("relex  %9.1f us/edit  %.1f tokens re-lexed/edit  %.0fx\n", relex_time / EDITS * 1e6,
+           (double)relexed / EDITS, full_time / relex_time);
+
+    token_buffer_deinit(&tokens);
+    token_buffer_deinit(&full);
+    free(src);
+    return 0;
+}
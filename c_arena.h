@@ -0,0 +1,267 @@
+// you need to define IMPEL_C_ARENA before including this header
+//
+// Bump allocator: memory comes from big blocks and is only given back all at
+// once, with arena_reset to a mark or arena_deinit, so a whole file or batch
+// costs one free. Blocks are chained and never move, pointers stay valid
+// until the reset that drops them. An Arena is not thread safe, every thread
+// uses its own, e.g. the one arena_thread returns.
+// With Arena_hugepages, blocks of ARENA_HUGEPAGE_BYTES and more are mapped
+// 2 MiB aligned and advised MADV_HUGEPAGE, which saves TLB misses when
+// streaming over large token columns.
+
+#ifndef C_ARENA_H
+#define C_ARENA_H
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// default size of a block, a bigger allocation gets a block of its own
+#ifndef ARENA_BLOCK_BYTES
+#define ARENA_BLOCK_BYTES (1u << 20)
+#endif
+
+#define ARENA_HUGEPAGE_BYTES (2u << 20)
+
+// alignment of arena_alloc, enough for any scalar type and for SSE loads
+#define ARENA_ALIGN 16
+
+typedef enum ArenaFlags {
+    Arena_hugepages = 1 << 0,
+} ArenaFlags;
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* prev;
+    size_t size;      // usable bytes in `data`
+    size_t used;
+    size_t map_size;  // non zero when the block is a mapping
+    char* map_base;
+    _Alignas(64) char data[];
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock* block; // current block, the older ones hang off `prev`
+    size_t block_size;
+    uint32_t flags;
+} Arena;
+
+// a position to go back to with arena_reset
+typedef struct ArenaMark {
+    ArenaBlock* block;
+    size_t used;
+} ArenaMark;
+
+void arena_init(Arena* arena, size_t block_size, uint32_t flags);
+void arena_deinit(Arena* arena);
+void* arena_alloc(Arena* arena, size_t size);
+void* arena_alloc_aligned(Arena* arena, size_t size, size_t align);
+void* arena_calloc(Arena* arena, size_t count, size_t size);
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size);
+void* arena_realloc_aligned(Arena* arena, void* ptr, size_t old_size, size_t new_size, size_t align);
+char* arena_strndup(Arena* arena, const char* str, size_t len);
+ArenaMark arena_mark(const Arena* arena);
+void arena_reset(Arena* arena, ArenaMark mark);
+void arena_clear(Arena* arena);
+size_t arena_used(const Arena* arena);
+Arena* arena_thread(void);
+void arena_thread_deinit(void);
+
+#ifdef IMPEL_C_ARENA
+
+void arena_init(Arena* arena, size_t block_size, uint32_t flags){
+    *arena = (Arena){
+        .block_size = block_size ? block_size : ARENA_BLOCK_BYTES,
+        .flags = flags,
+    };
+}
+
+static void arena_block_free(ArenaBlock* b){
+    if(b->map_size){
+        munmap(b->map_base, b->map_size);
+    }else{
+        free(b);
+    }
+}
+
+void arena_deinit(Arena* arena){
+    for(ArenaBlock* b = arena->block; b;){
+        ArenaBlock* prev = b->prev;
+        arena_block_free(b);
+        b = prev;
+    }
+    arena->block = NULL;
+}
+
+// Over-maps by one huge page and trims both ends, so the kernel can back the
+// block with huge pages from its first byte.
+static ArenaBlock* arena_block_map(size_t total){
+    size_t huge = ARENA_HUGEPAGE_BYTES;
+    size_t size = (total + huge - 1) & ~(huge - 1);
+    char* base = mmap(NULL, size + huge, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED) return NULL;
+    char* aligned = (char*)(((uintptr_t)base + huge - 1) & ~(uintptr_t)(huge - 1));
+    if(aligned > base) munmap(base, (size_t)(aligned - base));
+    size_t tail = (size_t)(base + size + huge - (aligned + size));
+    if(tail) munmap(aligned + size, tail);
+#ifdef MADV_HUGEPAGE
+    madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+    ArenaBlock* b = (ArenaBlock*)aligned;
+    b->map_size = size;
+    b->map_base = aligned;
+    b->size = size - offsetof(ArenaBlock, data);
+    return b;
+}
+
+// Chains a block with room for `size` bytes at alignment `align`.
+static void arena_grow(Arena* arena, size_t size, size_t align){
+    size_t need = size + align;
+    size_t data = need > arena->block_size ? need : arena->block_size;
+    size_t total = offsetof(ArenaBlock, data) + data;
+    ArenaBlock* b = NULL;
+    if((arena->flags & Arena_hugepages) && total >= ARENA_HUGEPAGE_BYTES) b = arena_block_map(total);
+    if(!b){
+        b = (ArenaBlock*)aligned_alloc(64, (total + 63) & ~(size_t)63);
+        if(!b){
+            fprintf(stderr, "[Arena Error]: failed to allocate a block of %zu bytes\n", total);
+            exit(1);
+        }
+        b->map_size = 0;
+        b->map_base = NULL;
+        b->size = data;
+    }
+    b->used = 0;
+    b->prev = arena->block;
+    arena->block = b;
+}
+
+// Offset in `b` of the first byte at or after `used` whose address is a
+// multiple of `align`. The data is only 64 byte aligned, so rounding `used`
+// alone would not do for bigger alignments.
+static size_t arena_block_align(const ArenaBlock* b, size_t align){
+    uintptr_t at = (uintptr_t)(b->data + b->used);
+    return b->used + (size_t)(((at + align - 1) & ~(uintptr_t)(align - 1)) - at);
+}
+
+// `align` must be a power of two
+void* arena_alloc_aligned(Arena* arena, size_t size, size_t align){
+    ArenaBlock* b = arena->block;
+    if(b){
+        size_t start = arena_block_align(b, align);
+        if(start + size <= b->size){
+            b->used = start + size;
+            return b->data + start;
+        }
+    }
+    // the new block has room for the worst case padding, align - 1 bytes
+    arena_grow(arena, size, align);
+    b = arena->block;
+    size_t start = arena_block_align(b, align);
+    b->used = start + size;
+    return b->data + start;
+}
+
+void* arena_alloc(Arena* arena, size_t size){
+    return arena_alloc_aligned(arena, size, ARENA_ALIGN);
+}
+
+void* arena_calloc(Arena* arena, size_t count, size_t size){
+    if(size && count > SIZE_MAX / size){
+        fprintf(stderr, "[Arena Error]: %zu elements of %zu bytes overflow a size\n", count, size);
+        exit(1);
+    }
+    void* p = arena_alloc(arena, count * size);
+    memset(p, 0, count * size);
+    return p;
+}
+
+// Grows the newest allocation in place when its block has room, otherwise
+// copies it to a new one aligned to `align`, which has to be the alignment
+// it was allocated with; the old bytes are only reclaimed by the next reset.
+void* arena_realloc_aligned(Arena* arena, void* ptr, size_t old_size, size_t new_size, size_t align){
+    ArenaBlock* b = arena->block;
+    if(ptr && b && (char*)ptr + old_size == b->data + b->used){
+        size_t start = (size_t)((char*)ptr - b->data);
+        if(start + new_size <= b->size){
+            b->used = start + new_size;
+            return ptr;
+        }
+    }
+    void* p = arena_alloc_aligned(arena, new_size, align);
+    if(ptr) memcpy(p, ptr, old_size < new_size ? old_size : new_size);
+    return p;
+}
+
+// arena_realloc_aligned for memory from arena_alloc
+void* arena_realloc(Arena* arena, void* ptr, size_t old_size, size_t new_size){
+    return arena_realloc_aligned(arena, ptr, old_size, new_size, ARENA_ALIGN);
+}
+
+char* arena_strndup(Arena* arena, const char* str, size_t len){
+    char* dst = (char*)arena_alloc_aligned(arena, len + 1, 1);
+    memcpy(dst, str, len);
+    dst[len] = '\0';
+    return dst;
+}
+
+ArenaMark arena_mark(const Arena* arena){
+    return (ArenaMark){ .block = arena->block, .used = arena->block ? arena->block->used : 0 };
+}
+
+// Frees every block chained after the mark and rewinds the marked one.
+void arena_reset(Arena* arena, ArenaMark mark){
+    while(arena->block != mark.block){
+        ArenaBlock* prev = arena->block->prev;
+        arena_block_free(arena->block);
+        arena->block = prev;
+    }
+    if(arena->block) arena->block->used = mark.used;
+}
+
+// Empties the arena but keeps its newest block for the next batch.
+void arena_clear(Arena* arena){
+    ArenaBlock* keep = arena->block;
+    if(!keep) return;
+    for(ArenaBlock* b = keep->prev; b;){
+        ArenaBlock* prev = b->prev;
+        arena_block_free(b);
+        b = prev;
+    }
+    keep->prev = NULL;
+    keep->used = 0;
+}
+
+size_t arena_used(const Arena* arena){
+    size_t used = 0;
+    for(const ArenaBlock* b = arena->block; b; b = b->prev) used += b->used;
+    return used;
+}
+
+static _Thread_local Arena arena_thread_instance;
+
+// The calling thread's arena, created on first use with the default sizes.
+Arena* arena_thread(void){
+    Arena* a = &arena_thread_instance;
+    if(a->block_size == 0) arena_init(a, 0, 0);
+    return a;
+}
+
+// Frees the calling thread's arena, call it before the thread exits.
+void arena_thread_deinit(void){
+    arena_deinit(&arena_thread_instance);
+    arena_thread_instance = (Arena){0};
+}
+
+#endif // IMPEL_C_ARENA
+
+#ifdef __cplusplus
+}
+#endif
+#endif // C_ARENA_H
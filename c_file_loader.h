@@ -0,0 +1,542 @@
+// you need to define IMPEL_C_FILE_LOADER before including this header
+// (c_lexer.h still needs IMPEL_C_LEXER in one translation unit), link with -pthread
+//
+// Loads a batch of files into memory with their I/O overlapped, and hands
+// every file over as soon as its read completes, in completion order, while
+// the later ones are still in flight. On a cold page cache a tree of many
+// small files is bound by the latency of each open and read, not by
+// bandwidth, so keeping many of them in flight at once hides most of it.
+// On Linux one loader thread drives an io_uring (raw syscalls, no liburing):
+// for every file an openat and a statx are queued together, a read for the
+// whole file once both complete, then a close, with up to `depth` files in
+// flight. Where io_uring is missing, refused (seccomp) or lacks those
+// opcodes (kernels before 5.6, found with IORING_REGISTER_PROBE) a pool
+// of `depth` threads does open/fstat/pread instead, to the same effect.
+// Buffers are malloc'd with CFILE_PADDING zero bytes after the content, and
+// at most `max_bytes` of them are held at once: a read waits for consumers
+// to release files first, so a slow consumer can't make the loader read the
+// whole tree into memory.
+
+#ifndef C_FILE_LOADER_H
+#define C_FILE_LOADER_H
+#include "c_lexer.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define C_FILE_LOADER_URING 1
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+#include <sys/syscall.h>
+#endif
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// files in flight at once, the io_uring depth or the pread pool size
+#ifndef FILE_LOADER_DEPTH
+#define FILE_LOADER_DEPTH 64
+#endif
+
+// bytes of loaded files held at once, a bigger file still gets loaded alone
+#ifndef FILE_LOADER_MAX_BYTES
+#define FILE_LOADER_MAX_BYTES (64u * 1024u * 1024u)
+#endif
+
+typedef enum FileLoaderBackend {
+    FileLoader_uring,
+    FileLoader_pread,
+} FileLoaderBackend;
+
+// A loaded file: `file.buffer` holds `file.size` bytes and the padding, or
+// `error` is the LexerError that stopped it and the file has no buffer.
+typedef struct LoadedFile {
+    CFile file;
+    uint32_t task;
+    int error;
+} LoadedFile;
+
+typedef struct FileLoaderSlot FileLoaderSlot;
+
+typedef struct FileLoader {
+    char* const* paths;     // indexed by task
+    const uint32_t* tasks;  // what to load, in submission order
+    uint32_t count;
+    uint32_t depth;
+    uint64_t max_bytes;
+    FileLoaderBackend backend;
+
+    pthread_mutex_t lock;
+    pthread_cond_t ready_cond; // a file was loaded
+    pthread_cond_t space_cond; // a file was released
+    LoadedFile* ready;         // `count` entries, each file goes through once
+    uint32_t ready_head;
+    uint32_t ready_tail;
+    uint64_t held_bytes;       // buffers loaded and not released yet
+    _Atomic uint32_t next;     // next task to start, for the pread pool
+    pthread_t* threads;
+    uint32_t thread_len;
+
+    // io_uring state, owned by the loader thread
+    int ring_fd;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void* sq_map;
+    size_t sq_map_size;
+    void* cq_map;
+    size_t cq_map_size;
+    size_t sqe_map_size;
+    uint32_t to_submit;
+    FileLoaderSlot* slots;
+} FileLoader;
+
+bool file_loader_start(FileLoader* loader, char* const* paths, const uint32_t* tasks, uint32_t count, uint32_t depth, bool uring);
+bool file_loader_next(FileLoader* loader, LoadedFile* out);
+void file_loader_release(FileLoader* loader, LoadedFile* file);
+void file_loader_stop(FileLoader* loader);
+const char* file_loader_backend_name(FileLoaderBackend backend);
+
+#ifdef IMPEL_C_FILE_LOADER
+
+const char* file_loader_backend_name(FileLoaderBackend backend){
+    switch(backend){
+        case FileLoader_uring: return "io_uring";
+        case FileLoader_pread: return "pread";
+    }
+    return "unknown";
+}
+
+// Takes room for a buffer of `size` bytes and the padding under the
+// budget; `wait` false returns false instead of waiting for it.
+static bool file_loader_reserve(FileLoader* l, uint64_t size, bool wait){
+    uint64_t need = size + CFILE_PADDING;
+    pthread_mutex_lock(&l->lock);
+    while(wait && l->held_bytes && l->held_bytes + need > l->max_bytes) pthread_cond_wait(&l->space_cond, &l->lock);
+    bool room = !l->held_bytes || l->held_bytes + need <= l->max_bytes;
+    if(room) l->held_bytes += need;
+    pthread_mutex_unlock(&l->lock);
+    return room;
+}
+
+static char* file_loader_alloc(uint64_t size){
+    char* buffer = (char*)malloc((size_t)size + CFILE_PADDING);
+    if(!buffer){
+        fprintf(stderr, "[Lexing Error]: failed to allocate %llu bytes for a loaded file\n", (unsigned long long)size + CFILE_PADDING);
+        exit(1);
+    }
+    return buffer;
+}
+
+// Hands a file over once its read ended: `reserved` is what its buffer was
+// sized for, the file keeps the `got` bytes read (a file that shrank since
+// its stat keeps what was there), a failed read frees the buffer.
+static void file_loader_push(FileLoader* l, LoadedFile file, uint64_t reserved, uint64_t got){
+    pthread_mutex_lock(&l->lock);
+    if(file.file.buffer){
+        if(file.error){
+            free(file.file.buffer);
+            file.file.buffer = NULL;
+            l->held_bytes -= reserved + CFILE_PADDING;
+            pthread_cond_broadcast(&l->space_cond);
+        }else{
+            file.file.size = (size_t)got;
+            memset(file.file.buffer + got, 0, CFILE_PADDING);
+            l->held_bytes -= reserved - got;
+        }
+    }
+    l->ready[l->ready_tail++] = file;
+    pthread_cond_signal(&l->ready_cond);
+    pthread_mutex_unlock(&l->lock);
+}
+
+// the pread pool: every thread loads the next task until none is left
+static void* file_loader_pread_worker(void* arg){
+    FileLoader* l = (FileLoader*)arg;
+    for(;;){
+        uint32_t i = atomic_fetch_add(&l->next, 1);
+        if(i >= l->count) return NULL;
+        LoadedFile out = { .task = l->tasks[i] };
+        out.file.name = l->paths[out.task];
+        uint64_t size = 0, got = 0;
+        int fd = open(out.file.name, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if(fd < 0){
+            out.error = Error_file_open;
+        }else if(fstat(fd, &st) < 0){
+            out.error = Error_file_stat;
+        }else{
+            size = (uint64_t)st.st_size;
+            file_loader_reserve(l, size, true);
+            out.file.buffer = file_loader_alloc(size);
+            while(got < size){
+                ssize_t n = pread(fd, out.file.buffer + got, (size_t)(size - got), (off_t)got);
+                if(n < 0 && errno == EINTR) continue;
+                if(n < 0) out.error = Error_file_read;
+                if(n <= 0) break;
+                got += (uint64_t)n;
+            }
+        }
+        if(fd >= 0) close(fd);
+        file_loader_push(l, out, size, got);
+    }
+}
+
+#ifdef C_FILE_LOADER_URING
+
+// what a completion was for, in the low bits of its user_data
+enum { FileLoaderOp_open, FileLoaderOp_statx, FileLoaderOp_read, FileLoaderOp_close, FileLoaderOp_bits = 2 };
+
+typedef enum FileLoaderState {
+    FileLoaderSlot_free,
+    FileLoaderSlot_opening, // openat and statx in flight
+    FileLoaderSlot_waiting, // opened and sized, waits for room to read
+    FileLoaderSlot_reading,
+    FileLoaderSlot_closing, // handed over, close in flight
+} FileLoaderState;
+
+struct FileLoaderSlot {
+    LoadedFile file;
+    struct statx stx;
+    FileLoaderState state;
+    int fd;
+    uint32_t pending;  // openat and statx completions still to come
+    uint64_t size;
+    uint64_t got;
+};
+
+// Do the ring's opcodes include openat, statx, read and close? They came
+// with Linux 5.6, as did the probe, so a kernel that fails it lacks them.
+static bool file_loader_probe(int fd){
+    enum { ops = 256 };
+    union {
+        struct io_uring_probe probe;
+        char bytes[sizeof(struct io_uring_probe) + ops * sizeof(struct io_uring_probe_op)];
+    } u;
+    memset(&u, 0, sizeof(u));
+    if(syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, &u.probe, ops) < 0) return false;
+    static const uint8_t needed[] = { IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE };
+    for(uint32_t i = 0; i < sizeof(needed); i++){
+        uint8_t op = needed[i];
+        if(op >= u.probe.ops_len || !(u.probe.ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+}
+
+static int file_loader_setup(FileLoader* l){
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, l->depth * 2, &p);
+    if(fd < 0) return -1;
+    if(!file_loader_probe(fd)){
+        close(fd);
+        return -1;
+    }
+    l->ring_fd = fd;
+    l->sq_map_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    l->cq_map_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        if(l->cq_map_size > l->sq_map_size) l->sq_map_size = l->cq_map_size;
+        l->cq_map_size = l->sq_map_size;
+    }
+    l->sq_map = mmap(NULL, l->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if(l->sq_map == MAP_FAILED) goto fail;
+    l->cq_map = l->sq_map;
+    if(!(p.features & IORING_FEAT_SINGLE_MMAP)){
+        l->cq_map = mmap(NULL, l->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if(l->cq_map == MAP_FAILED) goto fail_sq;
+    }
+    l->sqe_map_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    l->sqes = (struct io_uring_sqe*)mmap(NULL, l->sqe_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(l->sqes == MAP_FAILED) goto fail_cq;
+
+    char* sq = (char*)l->sq_map;
+    char* cq = (char*)l->cq_map;
+    l->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+    l->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+    l->sq_array = (unsigned*)(sq + p.sq_off.array);
+    l->cq_head = (unsigned*)(cq + p.cq_off.head);
+    l->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+    l->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+    l->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+    return 0;
+
+fail_cq:
+    if(l->cq_map != l->sq_map) munmap(l->cq_map, l->cq_map_size);
+fail_sq:
+    munmap(l->sq_map, l->sq_map_size);
+fail:
+    close(fd);
+    return -1;
+}
+
+static void file_loader_teardown(FileLoader* l){
+    munmap(l->sqes, l->sqe_map_size);
+    if(l->cq_map != l->sq_map) munmap(l->cq_map, l->cq_map_size);
+    munmap(l->sq_map, l->sq_map_size);
+    close(l->ring_fd);
+}
+
+// The next free submission entry, zeroed. The ring has two entries per
+// slot and a slot never has more than two operations in flight, so it
+// can't run full.
+static struct io_uring_sqe* file_loader_sqe(FileLoader* l, uint32_t slot, uint32_t op){
+    unsigned tail = *l->sq_tail;
+    unsigned index = tail & *l->sq_mask;
+    struct io_uring_sqe* sqe = &l->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = (uint64_t)slot << FileLoaderOp_bits | op;
+    l->sq_array[index] = index;
+    __atomic_store_n(l->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    l->to_submit += 1;
+    return sqe;
+}
+
+static void file_loader_open(FileLoader* l, uint32_t slot, uint32_t task){
+    FileLoaderSlot* s = &l->slots[slot];
+    *s = (FileLoaderSlot){ .file = { .task = task, .file = { .name = l->paths[task] } }, .state = FileLoaderSlot_opening, .fd = -1, .pending = 2 };
+    struct io_uring_sqe* sqe = file_loader_sqe(l, slot, FileLoaderOp_open);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)s->file.file.name;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe = file_loader_sqe(l, slot, FileLoaderOp_statx);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (uint64_t)(uintptr_t)s->file.file.name;
+    sqe->len = STATX_SIZE;
+    sqe->off = (uint64_t)(uintptr_t)&s->stx;
+}
+
+static void file_loader_read(FileLoader* l, uint32_t slot){
+    FileLoaderSlot* s = &l->slots[slot];
+    uint64_t left = s->size - s->got;
+    struct io_uring_sqe* sqe = file_loader_sqe(l, slot, FileLoaderOp_read);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = s->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(s->file.file.buffer + s->got);
+    sqe->len = (uint32_t)(left < (1u << 30) ? left : (1u << 30));
+    sqe->off = s->got;
+}
+
+// hands the slot's file over and closes its descriptor
+static void file_loader_finish(FileLoader* l, uint32_t slot){
+    FileLoaderSlot* s = &l->slots[slot];
+    file_loader_push(l, s->file, s->size, s->got);
+    s->state = FileLoaderSlot_free;
+    if(s->fd >= 0){
+        struct io_uring_sqe* sqe = file_loader_sqe(l, slot, FileLoaderOp_close);
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->fd = s->fd;
+        s->state = FileLoaderSlot_closing;
+    }
+}
+
+// Starts the read of a waiting slot if the budget has room for it; never
+// waits, the loader thread has to keep reaping completions meanwhile.
+static bool file_loader_try_read(FileLoader* l, uint32_t slot){
+    FileLoaderSlot* s = &l->slots[slot];
+    if(!file_loader_reserve(l, s->size, false)) return false;
+    s->file.file.buffer = file_loader_alloc(s->size);
+    s->state = FileLoaderSlot_reading;
+    if(s->size == 0){
+        file_loader_finish(l, slot);
+    }else{
+        file_loader_read(l, slot);
+    }
+    return true;
+}
+
+static void file_loader_complete(FileLoader* l, uint64_t user_data, int res){
+    uint32_t slot = (uint32_t)(user_data >> FileLoaderOp_bits);
+    FileLoaderSlot* s = &l->slots[slot];
+    switch(user_data & ((1u << FileLoaderOp_bits) - 1)){
+        case FileLoaderOp_open:
+            if(res >= 0) s->fd = res;
+            else if(!s->file.error) s->file.error = Error_file_open;
+            break;
+        case FileLoaderOp_statx:
+            if(res < 0 && !s->file.error) s->file.error = Error_file_stat;
+            break;
+        case FileLoaderOp_read:
+            if(res == -EINTR || res == -EAGAIN){
+                file_loader_read(l, slot);
+                return;
+            }
+            if(res < 0) s->file.error = Error_file_read;
+            if(res > 0) s->got += (uint64_t)res;
+            if(res > 0 && s->got < s->size){
+                file_loader_read(l, slot);
+                return;
+            }
+            file_loader_finish(l, slot);
+            return;
+        default: // FileLoaderOp_close
+            s->state = FileLoaderSlot_free;
+            return;
+    }
+    if(--s->pending) return;
+    if(s->file.error){
+        file_loader_finish(l, slot);
+        return;
+    }
+    s->size = s->stx.stx_size;
+    s->state = FileLoaderSlot_waiting;
+    file_loader_try_read(l, slot);
+}
+
+static void* file_loader_uring_worker(void* arg){
+    FileLoader* l = (FileLoader*)arg;
+    uint32_t next = 0, busy = 0;
+
+    for(;;){
+        // refill the free slots, and retry the ones waiting for room
+        uint32_t waiting = 0;
+        uint64_t smallest = UINT64_MAX;
+        for(uint32_t i = 0; i < l->depth; i++){
+            FileLoaderSlot* s = &l->slots[i];
+            if(s->state == FileLoaderSlot_free && next < l->count){
+                file_loader_open(l, i, l->tasks[next++]);
+                busy += 1;
+            }else if(s->state == FileLoaderSlot_waiting && !file_loader_try_read(l, i)){
+                waiting += 1;
+                if(s->size < smallest) smallest = s->size;
+            }
+        }
+        if(busy == 0) break;
+
+        // only files waiting for room left: sleep until one of them fits, the
+        // test file_loader_reserve makes, under the lock so no release is missed
+        if(waiting == busy){
+            uint64_t need = smallest + CFILE_PADDING;
+            pthread_mutex_lock(&l->lock);
+            while(l->held_bytes && l->held_bytes + need > l->max_bytes) pthread_cond_wait(&l->space_cond, &l->lock);
+            pthread_mutex_unlock(&l->lock);
+            continue;
+        }
+        int n = (int)syscall(__NR_io_uring_enter, l->ring_fd, l->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if(n < 0 && errno != EINTR && errno != EBUSY){
+            fprintf(stderr, "[Lexing Error]: io_uring_enter failed: %s\n", strerror(errno));
+            exit(1);
+        }
+        if(n > 0) l->to_submit -= (uint32_t)n;
+
+        unsigned head = *l->cq_head;
+        unsigned tail = __atomic_load_n(l->cq_tail, __ATOMIC_ACQUIRE);
+        for(; head != tail; head++){
+            struct io_uring_cqe* cqe = &l->cqes[head & *l->cq_mask];
+            uint32_t slot = (uint32_t)(cqe->user_data >> FileLoaderOp_bits);
+            file_loader_complete(l, cqe->user_data, cqe->res);
+            if(l->slots[slot].state == FileLoaderSlot_free) busy -= 1;
+        }
+        __atomic_store_n(l->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+#endif // C_FILE_LOADER_URING
+
+// Starts loading the files `paths[tasks[i]]` and returns at once; take
+// them with file_loader_next. `depth` 0 means FILE_LOADER_DEPTH. With
+// `uring` false, or when io_uring can't be set up, the pread pool is used.
+// Returns false if no loader thread could be started.
+bool file_loader_start(FileLoader* l, char* const* paths, const uint32_t* tasks, uint32_t count, uint32_t depth, bool uring){
+    *l = (FileLoader){
+        .paths = paths,
+        .tasks = tasks,
+        .count = count,
+        .depth = depth ? depth : FILE_LOADER_DEPTH,
+        .max_bytes = FILE_LOADER_MAX_BYTES,
+        .backend = FileLoader_pread,
+        .ring_fd = -1,
+    };
+    if(l->depth > count) l->depth = count ? count : 1;
+    pthread_mutex_init(&l->lock, NULL);
+    pthread_cond_init(&l->ready_cond, NULL);
+    pthread_cond_init(&l->space_cond, NULL);
+    atomic_init(&l->next, 0);
+    l->ready = (LoadedFile*)malloc((count ? count : 1) * sizeof(LoadedFile));
+    l->threads = (pthread_t*)malloc(l->depth * sizeof(pthread_t));
+    if(!l->ready || !l->threads){
+        fprintf(stderr, "[Lexing Error]: failed to allocate a loader for %u files\n", count);
+        exit(1);
+    }
+
+#ifdef C_FILE_LOADER_URING
+    if(uring && file_loader_setup(l) == 0){
+        l->slots = (FileLoaderSlot*)calloc(l->depth, sizeof(FileLoaderSlot));
+        if(!l->slots){
+            fprintf(stderr, "[Lexing Error]: failed to allocate %u loader slots\n", l->depth);
+            exit(1);
+        }
+        if(pthread_create(&l->threads[0], NULL, file_loader_uring_worker, l) == 0){
+            l->backend = FileLoader_uring;
+            l->thread_len = 1;
+            return true;
+        }
+        free(l->slots);
+        l->slots = NULL;
+        file_loader_teardown(l);
+        l->ring_fd = -1;
+    }
+#else
+    (void)uring;
+#endif
+    for(uint32_t i = 0; i < l->depth; i++){
+        if(pthread_create(&l->threads[l->thread_len], NULL, file_loader_pread_worker, l) == 0) l->thread_len += 1;
+    }
+    return l->thread_len > 0;
+}
+
+// Waits for the next loaded file, in completion order. False once every
+// file was handed out. Any thread may call it.
+bool file_loader_next(FileLoader* l, LoadedFile* out){
+    pthread_mutex_lock(&l->lock);
+    while(l->ready_head == l->ready_tail && l->ready_tail < l->count) pthread_cond_wait(&l->ready_cond, &l->lock);
+    bool got = l->ready_head < l->ready_tail;
+    if(got) *out = l->ready[l->ready_head++];
+    // the last file: wake every other waiter so they see there is none left
+    if(l->ready_head == l->count) pthread_cond_broadcast(&l->ready_cond);
+    pthread_mutex_unlock(&l->lock);
+    return got;
+}
+
+// Frees the buffer of a file from file_loader_next and makes room for the
+// next reads.
+void file_loader_release(FileLoader* l, LoadedFile* file){
+    if(!file->file.buffer) return;
+    free(file->file.buffer);
+    file->file.buffer = NULL;
+    pthread_mutex_lock(&l->lock);
+    l->held_bytes -= file->file.size + CFILE_PADDING;
+    pthread_cond_broadcast(&l->space_cond);
+    pthread_mutex_unlock(&l->lock);
+}
+
+// Waits for the loader threads and frees the loader; release the files
+// taken from it first, and take all of them or the loader may never end.
+void file_loader_stop(FileLoader* l){
+    for(uint32_t i = 0; i < l->thread_len; i++) pthread_join(l->threads[i], NULL);
+#ifdef C_FILE_LOADER_URING
+    if(l->ring_fd >= 0) file_loader_teardown(l);
+    free(l->slots);
+#endif
+    for(uint32_t i = l->ready_head; i < l->ready_tail; i++) file_loader_release(l, &l->ready[i]);
+    pthread_mutex_destroy(&l->lock);
+    pthread_cond_destroy(&l->ready_cond);
+    pthread_cond_destroy(&l->space_cond);
+    free(l->ready);
+    free(l->threads);
+    *l = (FileLoader){ .ring_fd = -1 };
+}
+
+#endif // IMPEL_C_FILE_LOADER
+
+#ifdef __cplusplus
+}
+#endif
+#endif // C_FILE_LOADER_H
@@ -0,0 +1,671 @@
+// you need to define IMPEL_C_INCLUDE_GRAPH before including this header
+// (c_lexer.h still needs IMPEL_C_LEXER in one translation unit)
+//
+// Follows the `#include` directives of translation units through a list of
+// search paths and records which files every unit depends on. Like a
+// preprocessor it walks a unit depth first, in directive order, but it
+// evaluates no conditions: every branch is followed, and the only macro
+// state kept is which names were #defined and not #undef'd since.
+// A file is opened and scanned once per graph, the first time it is reached:
+// only its directive lines are lexed (lexer_next_directive), what the walk
+// needs, its include/define/undef directives, is kept, so including it again
+// anywhere costs no I/O and no lexing. Names are resolved once per
+// (directory, name) as well.
+// While a file is summarized its include guard is detected: the whole file,
+// comments aside, is one `#ifndef X` (or `#if !defined X`) ... `#endif`.
+// Reaching a guarded file whose macro is currently defined skips it without
+// walking it again, as does reaching a `#pragma once` file already entered by
+// the unit. Real units include the same headers hundreds of times, and
+// that is where most of the time of following them goes.
+// An IncludeGraph is not thread safe.
+
+#ifndef C_INCLUDE_GRAPH_H
+#define C_INCLUDE_GRAPH_H
+#include "c_lexer.h"
+#include <limits.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the limit of gcc and clang, past it an include cycle is assumed
+#ifndef INCLUDE_GRAPH_MAX_DEPTH
+#define INCLUDE_GRAPH_MAX_DEPTH 200
+#endif
+
+typedef enum IncludeDirectiveKind {
+    IncludeDirective_include, // #include, #include_next and #import
+    IncludeDirective_embed,   // a dependency that is not walked
+    IncludeDirective_define,
+    IncludeDirective_undef,
+} IncludeDirectiveKind;
+
+// `target` caches the resolution: 0 until resolved, the file index + 1, or
+// INCLUDE_MISSING when no search path has the name.
+#define INCLUDE_MISSING UINT32_MAX
+
+typedef struct IncludeDirective {
+    uint8_t kind;
+    bool angled;    // <name> rather than "name"
+    uint32_t name;  // header or macro name symbol, 0 for a computed include
+    uint32_t line;  // 1-based, 0 under C_LEXER_NO_LINES
+    uint32_t target;
+} IncludeDirective;
+
+typedef struct IncludeFile {
+    const char* path;   // as found through the search paths
+    uint32_t dir;       // symbol of the directory part, 0 for the current one
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    IncludeDirective* directives;
+    uint32_t directive_len;
+    uint32_t guard;     // include guard macro symbol, 0 when not guarded
+    bool pragma_once;
+    bool loaded;
+    bool failed;        // could not be read
+    bool active;        // on the include stack of the walk
+    uint32_t entered_unit; // last unit that walked the file
+    uint32_t dep_unit;     // last unit that depends on it
+} IncludeFile;
+
+typedef struct IncludeUnit {
+    uint32_t file;
+    uint32_t first_dep; // into IncludeGraph.deps, the unit's file excluded
+    uint32_t dep_count;
+} IncludeUnit;
+
+// a name no search path has, once per directive
+typedef struct IncludeMissing {
+    uint32_t file;
+    uint32_t line;
+    uint32_t name; // 0 for a computed include
+    bool angled;
+} IncludeMissing;
+
+typedef struct IncludeGraphStats {
+    uint64_t units;
+    uint64_t includes;      // #include directives reached by the walk
+    uint64_t entered;       // files walked, units included
+    uint64_t skipped_guard; // guarded files skipped, their macro being defined
+    uint64_t skipped_once;  // #pragma once files skipped
+    uint64_t unresolved;    // includes no search path has
+    uint64_t cycles;        // includes of a file the walk is inside of
+    uint64_t too_deep;      // includes past INCLUDE_GRAPH_MAX_DEPTH
+    uint64_t files;         // distinct files loaded and lexed
+    uint64_t failed;        // files that could not be read
+    uint64_t guarded;       // loaded files with an include guard or #pragma once
+    uint64_t bytes;         // lexed
+} IncludeGraphStats;
+
+typedef struct IncludeGraph {
+    const char** quote_paths;  // searched for "name" after the includer's directory
+    uint32_t quote_len;
+    uint32_t quote_cap;
+    const char** angled_paths; // searched for <name>, and for "name" last
+    uint32_t angled_len;
+    uint32_t angled_cap;
+    IncludeFile* files;
+    uint32_t file_len;
+    uint32_t file_cap;
+    uint32_t* file_slots;      // file index + 1 by device and inode
+    uint32_t file_mask;
+    uint64_t* resolve_keys;    // dir << 32 | name << 1 | angled
+    uint32_t* resolve_values;  // IncludeDirective.target
+    uint32_t resolve_len;
+    uint32_t resolve_mask;
+    Interner names;            // directories, header and macro names
+    uint8_t* defined;          // by macro symbol, for the current unit
+    uint32_t defined_cap;
+    IncludeUnit* units;
+    uint32_t unit_len;
+    uint32_t unit_cap;
+    uint32_t* deps;
+    uint32_t dep_len;
+    uint32_t dep_cap;
+    uint64_t* edges;           // from << 32 | to, every pair once
+    uint32_t edge_len;
+    uint32_t edge_cap;
+    uint64_t* edge_slots;
+    uint32_t edge_mask;
+    IncludeMissing* missing;
+    uint32_t missing_len;
+    uint32_t missing_cap;
+    IncludeGraphStats stats;
+    bool reenter_guarded;      // walk guarded files again instead of skipping them
+    Arena arena;               // paths and directive lists
+    Lexer lexer;
+} IncludeGraph;
+
+void include_graph_init(IncludeGraph* graph);
+void include_graph_deinit(IncludeGraph* graph);
+void include_graph_add_path(IncludeGraph* graph, const char* dir, bool quote_only);
+int include_graph_add_unit(IncludeGraph* graph, const char* path);
+const char* include_graph_name(const IncludeGraph* graph, uint32_t symbol);
+void include_graph_stats_print(const IncludeGraphStats* stats, FILE* out);
+
+#ifdef IMPEL_C_INCLUDE_GRAPH
+
+void include_graph_init(IncludeGraph* g){
+    *g = (IncludeGraph){0};
+    interner_init(&g->names, 0);
+    arena_init(&g->arena, 0, 0);
+    g->lexer = lexer_init_s("", 0);
+}
+
+void include_graph_deinit(IncludeGraph* g){
+    free(g->quote_paths);
+    free(g->angled_paths);
+    free(g->files);
+    free(g->file_slots);
+    free(g->resolve_keys);
+    free(g->resolve_values);
+    free(g->defined);
+    free(g->units);
+    free(g->deps);
+    free(g->edges);
+    free(g->edge_slots);
+    free(g->missing);
+    interner_deinit(&g->names);
+    arena_deinit(&g->arena);
+    lexer_deinit(&g->lexer);
+    *g = (IncludeGraph){0};
+}
+
+// Grows `*items` to hold `len + 1` entries of `size` bytes.
+static void include_graph_grow(void** items, uint32_t* cap, uint32_t len, size_t size, const char* what){
+    if(len < *cap) return;
+    *cap = *cap ? *cap * 2 : 64;
+    *items = realloc(*items, (size_t)*cap * size);
+    if(!*items){
+        fprintf(stderr, "[Lexing Error]: failed to grow the include graph %s to %u entries\n", what, *cap);
+        exit(1);
+    }
+}
+
+// Search paths are tried in the order they are added, `dir` must outlive
+// the graph. A quote_only path is like -iquote, the others like -I.
+void include_graph_add_path(IncludeGraph* g, const char* dir, bool quote_only){
+    if(quote_only){
+        include_graph_grow((void**)&g->quote_paths, &g->quote_cap, g->quote_len, sizeof(char*), "search paths");
+        g->quote_paths[g->quote_len++] = dir;
+    }else{
+        include_graph_grow((void**)&g->angled_paths, &g->angled_cap, g->angled_len, sizeof(char*), "search paths");
+        g->angled_paths[g->angled_len++] = dir;
+    }
+}
+
+const char* include_graph_name(const IncludeGraph* g, uint32_t symbol){
+    return interner_get(&g->names, symbol).ptr;
+}
+
+static uint32_t include_graph_mix(uint64_t key){
+    key *= 0x9e3779b97f4a7c15ull;
+    return (uint32_t)(key >> 32);
+}
+
+// An empty table of at least `count` zeroed slots, `count` a power of two.
+static void* include_graph_slots(uint32_t count, size_t size){
+    void* slots = calloc(count, size);
+    if(!slots){
+        fprintf(stderr, "[Lexing Error]: failed to allocate %u include graph slots\n", count);
+        exit(1);
+    }
+    return slots;
+}
+
+static uint32_t include_graph_file_hash(uint64_t dev, uint64_t ino){
+    return include_graph_mix(ino ^ (dev << 40) ^ (dev >> 24));
+}
+
+static uint32_t* include_graph_file_slot(IncludeGraph* g, uint64_t dev, uint64_t ino){
+    for(uint32_t i = include_graph_file_hash(dev, ino) & g->file_mask;; i = (i + 1) & g->file_mask){
+        uint32_t s = g->file_slots[i];
+        if(!s || (g->files[s - 1].dev == dev && g->files[s - 1].ino == ino)) return &g->file_slots[i];
+    }
+}
+
+// The file of `path` by its identity, so two spellings of one file are one
+// node; a new one is registered but not loaded. Returns the index + 1, or 0
+// when `path` is not a regular file.
+static uint32_t include_graph_file(IncludeGraph* g, const char* path){
+    struct stat st;
+    if(stat(path, &st) < 0 || !S_ISREG(st.st_mode)) return 0;
+    if(g->file_len * 2 >= g->file_mask){
+        uint32_t count = g->file_mask ? (g->file_mask + 1) * 2 : 1024;
+        free(g->file_slots);
+        g->file_slots = (uint32_t*)include_graph_slots(count, sizeof(uint32_t));
+        g->file_mask = count - 1;
+        for(uint32_t f = 0; f < g->file_len; f++){
+            *include_graph_file_slot(g, g->files[f].dev, g->files[f].ino) = f + 1;
+        }
+    }
+    uint32_t* slot = include_graph_file_slot(g, (uint64_t)st.st_dev, (uint64_t)st.st_ino);
+    if(*slot) return *slot;
+
+    include_graph_grow((void**)&g->files, &g->file_cap, g->file_len, sizeof(IncludeFile), "files");
+    size_t len = strlen(path);
+    const char* slash = strrchr(path, '/');
+    g->files[g->file_len] = (IncludeFile){
+        .path = arena_strndup(&g->arena, path, len),
+        .dir = slash ? interner_intern(&g->names, path, slash == path ? 1 : (uint32_t)(slash - path)) : 0,
+        .dev = (uint64_t)st.st_dev,
+        .ino = (uint64_t)st.st_ino,
+        .size = (uint64_t)st.st_size,
+    };
+    *slot = ++g->file_len;
+    return *slot;
+}
+
+// Tries `dir/name`, or `name` alone for the current directory.
+static uint32_t include_graph_try(IncludeGraph* g, const char* dir, size_t dir_len, const char* name, size_t name_len){
+    char path[PATH_MAX];
+    if(dir_len + 1 + name_len + 1 > sizeof(path)) return 0;
+    size_t n = 0;
+    if(dir_len){
+        memcpy(path, dir, dir_len);
+        n = dir_len;
+        if(path[n - 1] != '/') path[n++] = '/';
+    }
+    memcpy(path + n, name, name_len + 1);
+    return include_graph_file(g, path);
+}
+
+static uint64_t* include_graph_resolve_slot(IncludeGraph* g, uint64_t key){
+    for(uint32_t i = include_graph_mix(key) & g->resolve_mask;; i = (i + 1) & g->resolve_mask){
+        if(!g->resolve_keys[i] || g->resolve_keys[i] == key) return &g->resolve_keys[i];
+    }
+}
+
+// The file `name` stands for when `from` includes it. "name" is looked up
+// next to the includer, then in the quote paths, then in the angled ones;
+// <name> only in the angled ones. The answer is cached per directory and name.
+static uint32_t include_graph_resolve(IncludeGraph* g, uint32_t from, const IncludeDirective* d){
+    if(!d->name) return INCLUDE_MISSING;
+    uint32_t dir = d->angled ? 0 : g->files[from].dir;
+    uint64_t key = (uint64_t)dir << 32 | (uint64_t)d->name << 1 | d->angled;
+    if(g->resolve_len * 2 >= g->resolve_mask){
+        uint32_t count = g->resolve_mask ? (g->resolve_mask + 1) * 2 : 1024;
+        uint64_t* keys = g->resolve_keys;
+        uint32_t* values = g->resolve_values;
+        g->resolve_keys = (uint64_t*)include_graph_slots(count, sizeof(uint64_t));
+        g->resolve_values = (uint32_t*)include_graph_slots(count, sizeof(uint32_t));
+        uint32_t old = g->resolve_mask ? g->resolve_mask + 1 : 0;
+        g->resolve_mask = count - 1;
+        for(uint32_t i = 0; i < old; i++){
+            if(!keys[i]) continue;
+            uint64_t* slot = include_graph_resolve_slot(g, keys[i]);
+            *slot = keys[i];
+            g->resolve_values[slot - g->resolve_keys] = values[i];
+        }
+        free(keys);
+        free(values);
+    }
+    uint64_t* slot = include_graph_resolve_slot(g, key);
+    if(*slot) return g->resolve_values[slot - g->resolve_keys];
+
+    StrView name = interner_get(&g->names, d->name);
+    uint32_t found = 0;
+    if(name.ptr[0] == '/'){
+        found = include_graph_file(g, name.ptr);
+    }else{
+        if(!d->angled){
+            StrView base = interner_get(&g->names, dir);
+            found = include_graph_try(g, base.ptr, base.len, name.ptr, name.len);
+            for(uint32_t i = 0; i < g->quote_len && !found; i++){
+                found = include_graph_try(g, g->quote_paths[i], strlen(g->quote_paths[i]), name.ptr, name.len);
+            }
+        }
+        for(uint32_t i = 0; i < g->angled_len && !found; i++){
+            found = include_graph_try(g, g->angled_paths[i], strlen(g->angled_paths[i]), name.ptr, name.len);
+        }
+    }
+    uint32_t target = found ? found : INCLUDE_MISSING;
+    *slot = key;
+    g->resolve_values[slot - g->resolve_keys] = target;
+    g->resolve_len += 1;
+    return target;
+}
+
+static const char* include_graph_blanks(const char* p){
+    while(*p == ' ' || *p == '\t') p++;
+    return p;
+}
+
+static bool include_graph_ident_char(char c){
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '$';
+}
+
+// Reads the identifier at `*p`, after blanks. Returns its length, 0 if none.
+static uint32_t include_graph_ident(const char** p){
+    const char* s = include_graph_blanks(*p);
+    const char* e = s;
+    while(include_graph_ident_char(*e)) e++;
+    *p = s;
+    return (uint32_t)(e - s);
+}
+
+static bool include_graph_word(const char* s, uint32_t len, const char* word){
+    return strlen(word) == len && !memcmp(s, word, len);
+}
+
+// `#if !defined X` or `#if !defined(X)` with nothing after it: the guard
+// form clang and gcc also accept. Returns the length of X, 0 otherwise.
+static uint32_t include_graph_if_not_defined(const char** p){
+    const char* s = include_graph_blanks(*p);
+    if(*s++ != '!') return 0;
+    uint32_t len = include_graph_ident(&s);
+    if(!include_graph_word(s, len, "defined")) return 0;
+    s = include_graph_blanks(s + len);
+    bool paren = *s == '(';
+    if(paren) s++;
+    const char* name = s;
+    len = include_graph_ident(&name);
+    if(!len) return 0;
+    s = include_graph_blanks(name + len);
+    if(paren && *s++ != ')') return 0;
+    s = include_graph_blanks(s);
+    if(*s != '\n' && *s != '\0' && !(s[0] == '/' && (s[1] == '/' || s[1] == '*'))) return 0;
+    *p = name;
+    return len;
+}
+
+typedef enum IncludeGuardState {
+    IncludeGuard_start,  // nothing but blanks and comments yet
+    IncludeGuard_open,   // inside the #ifndef that opened the file
+    IncludeGuard_closed, // after its #endif
+    IncludeGuard_none,
+} IncludeGuardState;
+
+typedef struct IncludeScan {
+    IncludeDirective* directives;
+    uint32_t len;
+    uint32_t cap;
+    IncludeGuardState guard_state;
+    uint32_t guard;
+    uint32_t depth; // of #if nesting
+    bool pragma_once;
+} IncludeScan;
+
+static void include_scan_push(IncludeGraph* g, IncludeScan* s, IncludeDirective d){
+    if(s->len == s->cap){
+        uint32_t cap = s->cap ? s->cap * 2 : 16;
+        s->directives = (IncludeDirective*)arena_realloc(&g->arena, s->directives, s->cap * sizeof(IncludeDirective), cap * sizeof(IncludeDirective));
+        s->cap = cap;
+    }
+    s->directives[s->len++] = d;
+}
+
+// One directive, `p` pointing at its name (after the `#` and any blanks).
+static void include_scan_directive(IncludeGraph* g, IncludeScan* s, const char* p, uint32_t line){
+    uint32_t len = include_graph_ident(&p);
+    const char* name = p;
+    p += len;
+    bool opens = include_graph_word(name, len, "if") || include_graph_word(name, len, "ifdef") || include_graph_word(name, len, "ifndef");
+    if(opens){
+        uint32_t guard_len = 0;
+        const char* guard = p;
+        if(include_graph_word(name, len, "ifndef")) guard_len = include_graph_ident(&guard);
+        else if(include_graph_word(name, len, "if")) guard_len = include_graph_if_not_defined(&guard);
+        if(s->depth == 0){
+            if(s->guard_state == IncludeGuard_start && guard_len){
+                s->guard_state = IncludeGuard_open;
+                s->guard = interner_intern(&g->names, guard, guard_len);
+            }else{
+                s->guard_state = IncludeGuard_none;
+            }
+        }
+        s->depth += 1;
+        return;
+    }
+    if(include_graph_word(name, len, "endif")){
+        if(s->depth > 0) s->depth -= 1;
+        if(s->depth == 0 && s->guard_state == IncludeGuard_open) s->guard_state = IncludeGuard_closed;
+        return;
+    }
+    if(len == 0) return; // the null directive
+    if(s->depth == 0) s->guard_state = IncludeGuard_none;
+    if(s->depth == 1 && s->guard_state == IncludeGuard_open && len >= 4 && !memcmp(name, "el", 2)){
+        s->guard_state = IncludeGuard_none; // #else, #elif, #elifdef, #elifndef
+        return;
+    }
+
+    if(include_graph_word(name, len, "include") || include_graph_word(name, len, "include_next")
+       || include_graph_word(name, len, "import") || include_graph_word(name, len, "embed")){
+        IncludeDirective d = {
+            .kind = name[1] == 'm' && name[2] == 'b' ? IncludeDirective_embed : IncludeDirective_include,
+            .line = line,
+        };
+        p = include_graph_blanks(p);
+        char close = *p == '<' ? '>' : *p == '"' ? '"' : 0;
+        if(close){
+            d.angled = close == '>';
+            const char* begin = ++p;
+            while(*p && *p != close && *p != '\n') p++;
+            if(*p == close && p > begin) d.name = interner_intern(&g->names, begin, (uint32_t)(p - begin));
+        }
+        include_scan_push(g, s, d);
+    }else if(include_graph_word(name, len, "define") || include_graph_word(name, len, "undef")){
+        uint32_t n = include_graph_ident(&p);
+        if(n){
+            include_scan_push(g, s, (IncludeDirective){
+                .kind = name[0] == 'd' ? IncludeDirective_define : IncludeDirective_undef,
+                .name = interner_intern(&g->names, p, n),
+                .line = line,
+            });
+        }
+    }else if(include_graph_word(name, len, "pragma")){
+        uint32_t n = include_graph_ident(&p);
+        if(include_graph_word(p, n, "once")) s->pragma_once = true;
+    }
+}
+
+// Whether [p, end) holds nothing but blanks, newlines and comments. With
+// `directive_tail`, p is on a directive line whose remaining tokens are
+// ignored, as a preprocessor does with the name after an #endif.
+static bool include_graph_no_code(const char* p, const char* end, bool directive_tail){
+    while(p < end){
+        if(*p == ' ' || *p == '\t' || *p == '\r' || *p == '\f' || *p == '\v'){
+            p++;
+        }else if(*p == '\n'){
+            directive_tail = false;
+            p++;
+        }else if(p[0] == '/' && p[1] == '/'){
+            while(p < end && *p != '\n') p++;
+        }else if(p[0] == '/' && p[1] == '*'){
+            p += 2;
+            while(p < end && (p = (const char*)memchr(p, '*', (size_t)(end - p))) && p[1] != '/') p++;
+            if(!p || p >= end) return true;
+            p += 2;
+        }else if(directive_tail){
+            p++;
+        }else{
+            return false;
+        }
+    }
+    return true;
+}
+
+// Summarizes a file from its directives alone (lexer_next_directive): any
+// code before the first one or after the #endif that closes the guard
+// means the file is not guarded, and any directive outside it as well.
+static void include_graph_scan(IncludeGraph* g, IncludeScan* s, const char* source, uint32_t size){
+    Lexer* lex = &g->lexer;
+    lexer_reset(lex, source, size);
+    for(;;){
+        Token tok = lexer_next_directive(lex);
+        if(tok.kind == Tok_eof) break;
+        if(s->guard_state == IncludeGuard_start && !include_graph_no_code(source, source + tok.loc.offset - 1, false)){
+            s->guard_state = IncludeGuard_none;
+        }
+        include_scan_directive(g, s, source + tok.loc.offset, tok.loc.line);
+        if(s->guard_state == IncludeGuard_closed && !include_graph_no_code(source + lex->index, source + size, true)){
+            s->guard_state = IncludeGuard_none;
+        }
+    }
+}
+
+// Opens and scans a file the first time the walk reaches it, and keeps
+// only its directives and guard.
+static void include_graph_load(IncludeGraph* g, uint32_t index){
+    IncludeFile* f = &g->files[index];
+    f->loaded = true;
+    CFile file;
+    if(cfile_init_mmap(&file, f->path) != 0 || file.size > UINT32_MAX - CFILE_PADDING){
+        if(file.map_size) cfile_deinit(&file);
+        f->failed = true;
+        g->stats.failed += 1;
+        return;
+    }
+    IncludeScan s = { .guard_state = IncludeGuard_start };
+    include_graph_scan(g, &s, file.buffer, (uint32_t)file.size);
+    f = &g->files[index];
+    f->directives = s.directives;
+    f->directive_len = s.len;
+    f->guard = s.guard_state == IncludeGuard_closed ? s.guard : 0;
+    f->pragma_once = s.pragma_once;
+    g->stats.files += 1;
+    g->stats.bytes += file.size;
+    g->stats.guarded += f->guard || f->pragma_once;
+    cfile_deinit(&file);
+}
+
+static bool include_graph_defined(const IncludeGraph* g, uint32_t symbol){
+    return symbol < g->defined_cap && g->defined[symbol];
+}
+
+static void include_graph_define(IncludeGraph* g, uint32_t symbol, bool defined){
+    if(symbol >= g->defined_cap){
+        uint32_t cap = g->defined_cap ? g->defined_cap : 1024;
+        while(cap <= symbol) cap *= 2;
+        g->defined = (uint8_t*)realloc(g->defined, cap);
+        if(!g->defined){
+            fprintf(stderr, "[Lexing Error]: failed to grow the include graph macros to %u entries\n", cap);
+            exit(1);
+        }
+        memset(g->defined + g->defined_cap, 0, cap - g->defined_cap);
+        g->defined_cap = cap;
+    }
+    g->defined[symbol] = defined;
+}
+
+static void include_graph_edge(IncludeGraph* g, uint32_t from, uint32_t to){
+    uint64_t key = (uint64_t)from << 32 | to;
+    if(g->edge_len * 2 >= g->edge_mask){
+        uint32_t count = g->edge_mask ? (g->edge_mask + 1) * 2 : 1024;
+        free(g->edge_slots);
+        g->edge_slots = (uint64_t*)include_graph_slots(count, sizeof(uint64_t));
+        g->edge_mask = count - 1;
+        for(uint32_t e = 0; e < g->edge_len; e++){
+            uint32_t i = include_graph_mix(g->edges[e]) & g->edge_mask;
+            while(g->edge_slots[i]) i = (i + 1) & g->edge_mask;
+            g->edge_slots[i] = g->edges[e] + 1;
+        }
+    }
+    uint32_t i = include_graph_mix(key) & g->edge_mask;
+    for(; g->edge_slots[i]; i = (i + 1) & g->edge_mask){
+        if(g->edge_slots[i] == key + 1) return;
+    }
+    g->edge_slots[i] = key + 1;
+    include_graph_grow((void**)&g->edges, &g->edge_cap, g->edge_len, sizeof(uint64_t), "edges");
+    g->edges[g->edge_len++] = key;
+}
+
+// Records that the current unit depends on `file`.
+static void include_graph_dep(IncludeGraph* g, uint32_t file){
+    IncludeFile* f = &g->files[file];
+    if(f->dep_unit == g->unit_len) return;
+    f->dep_unit = g->unit_len;
+    include_graph_grow((void**)&g->deps, &g->dep_cap, g->dep_len, sizeof(uint32_t), "dependencies");
+    g->deps[g->dep_len++] = file;
+    g->units[g->unit_len - 1].dep_count += 1;
+}
+
+static void include_graph_enter(IncludeGraph* g, uint32_t index, uint32_t depth){
+    if(!g->files[index].loaded) include_graph_load(g, index);
+    IncludeFile* f = &g->files[index];
+    f->entered_unit = g->unit_len;
+    f->active = true;
+    g->stats.entered += 1;
+    // the directives live in the arena, `f` moves when files are added
+    IncludeDirective* directives = f->directives;
+    uint32_t len = f->directive_len;
+    for(uint32_t i = 0; i < len; i++){
+        IncludeDirective* d = &directives[i];
+        if(d->kind == IncludeDirective_define || d->kind == IncludeDirective_undef){
+            include_graph_define(g, d->name, d->kind == IncludeDirective_define);
+            continue;
+        }
+        if(d->kind == IncludeDirective_include) g->stats.includes += 1;
+        if(!d->target){
+            d->target = include_graph_resolve(g, index, d);
+            if(d->target == INCLUDE_MISSING){
+                include_graph_grow((void**)&g->missing, &g->missing_cap, g->missing_len, sizeof(IncludeMissing), "missing names");
+                g->missing[g->missing_len++] = (IncludeMissing){ .file = index, .line = d->line, .name = d->name, .angled = d->angled };
+            }
+        }
+        if(d->target == INCLUDE_MISSING){
+            g->stats.unresolved += 1;
+            continue;
+        }
+        uint32_t to = d->target - 1;
+        include_graph_edge(g, index, to);
+        include_graph_dep(g, to);
+        if(d->kind == IncludeDirective_embed) continue;
+
+        const IncludeFile* t = &g->files[to];
+        if(t->pragma_once && t->entered_unit == g->unit_len){
+            g->stats.skipped_once += 1;
+        }else if(t->guard && !g->reenter_guarded && include_graph_defined(g, t->guard)){
+            g->stats.skipped_guard += 1;
+        }else if(t->active){
+            g->stats.cycles += 1;
+        }else if(depth + 1 >= INCLUDE_GRAPH_MAX_DEPTH){
+            g->stats.too_deep += 1;
+        }else{
+            include_graph_enter(g, to, depth + 1);
+        }
+    }
+    g->files[index].active = false;
+}
+
+// Walks one translation unit from a fresh macro state. Returns its index
+// in `units`, or -1 when `path` is not a readable file.
+int include_graph_add_unit(IncludeGraph* g, const char* path){
+    uint32_t file = include_graph_file(g, path);
+    if(!file) return -1;
+    include_graph_grow((void**)&g->units, &g->unit_cap, g->unit_len, sizeof(IncludeUnit), "units");
+    g->units[g->unit_len++] = (IncludeUnit){ .file = file - 1, .first_dep = g->dep_len };
+    if(g->defined) memset(g->defined, 0, g->defined_cap);
+    g->files[file - 1].dep_unit = g->unit_len; // not a dependency of itself
+    g->stats.units += 1;
+    include_graph_enter(g, file - 1, 0);
+    if(g->files[file - 1].failed){
+        g->unit_len -= 1;
+        g->stats.units -= 1;
+        g->stats.entered -= 1;
+        return -1;
+    }
+    return (int)g->unit_len - 1;
+}
+
+void include_graph_stats_print(const IncludeGraphStats* s, FILE* out){
+    fprintf(out, "units          %llu\n", (unsigned long long)s->units);
+    fprintf(out, "includes       %llu\n", (unsigned long long)s->includes);
+    fprintf(out, "entered        %llu\n", (unsigned long long)s->entered);
+    fprintf(out, "skipped        %llu by include guard, %llu by #pragma once\n",
+            (unsigned long long)s->skipped_guard, (unsigned long long)s->skipped_once);
+    fprintf(out, "unresolved     %llu\n", (unsigned long long)s->unresolved);
+    if(s->cycles) fprintf(out, "cycles         %llu\n", (unsigned long long)s->cycles);
+    if(s->too_deep) fprintf(out, "too deep       %llu\n", (unsigned long long)s->too_deep);
+    fprintf(out, "files lexed    %llu (%llu guarded), %llu bytes\n",
+            (unsigned long long)s->files, (unsigned long long)s->guarded, (unsigned long long)s->bytes);
+    if(s->failed) fprintf(out, "unreadable     %llu\n", (unsigned long long)s->failed);
+}
+
+#endif // IMPEL_C_INCLUDE_GRAPH
+
+#ifdef __cplusplus
+}
+#endif
+#endif // C_INCLUDE_GRAPH_H
@@ -1,4 +1,5 @@
 // you need to define IMPEL_C_LEXER before including this header
+// (it also pulls in the c_arena.h implementation, don't define IMPEL_C_ARENA elsewhere)
 
 
 #ifndef C_LEXER_H
@@ -10,185 +11,196 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <errno.h>
+#include <time.h>
 #include <unistd.h>
-#include <setjmp.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(IMPEL_C_LEXER) && !defined(IMPEL_C_ARENA)
+#define IMPEL_C_ARENA
+#endif
+#include "c_arena.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define C_LEXER_X86 1
+#include <immintrin.h>
+#endif
 
 #ifdef  __cplusplus
 extern "C" {
 #endif
 
-jmp_buf lex_err; 
-
 typedef enum LexerError {
     Error_unhandled_char = 19,
     Error_string_literal_no_end_quote = 20,
+    Error_file_open = 21,
+    Error_file_stat = 22,
+    Error_file_map = 23,
+    Error_char_literal_no_end_quote = 24,
+    Error_stream_read = 25,
+    Error_number_literal_invalid = 26,
+    Error_comment_no_end = 27,
+    Error_file_read = 28,
 }LexerError ;
 
-typedef enum TokenKind : uint32_t {
-    Tok_eof,
-    Tok_identifier,
-    Tok_number_literal,
-    Tok_string_literal,
-    Tok_char_literal,
-
-    Tok_l_paren,
-    Tok_r_paren,
-    Tok_l_brace,
-    Tok_r_brace,
-    Tok_l_bracket,
-    Tok_r_bracket,
-    Tok_period,
-    Tok_ellipsis2,
-    Tok_ellipsis3,
-    Tok_colon,
-    Tok_colon_equal,
-    Tok_colon_colon,
-    Tok_equal,
-    Tok_equal_equal,
-    Tok_semicolon,
-    Tok_comma,
-    Tok_bang,
-    Tok_bang_equal,
-    Tok_questionmark,
-    Tok_dollar_sign,
-    Tok_at_sign,
-    Tok_hash,
-    Tok_plus,
-    Tok_plus_plus,
-    Tok_plus_equal,
-    Tok_minus,
-    Tok_minus_minus,
-    Tok_minus_equal,
-    Tok_arrow,
-    Tok_asterisk,
-    Tok_asterisk_equal,
-    Tok_slash,
-    Tok_slash_equal,
-    Tok_percent,
-    Tok_percent_equal,
-    Tok_pipe,
-    Tok_pipe_equal,
-    Tok_pipe_pipe,
-    Tok_ampersand,
-    Tok_ampersand_equal,
-    Tok_ampersand_ampersand,
-    Tok_caret,
-    Tok_caret_equal,
-    Tok_tilde,
-    Tok_tilde_equal,
-    Tok_angle_bracket_left,
-    Tok_angle_bracket_left_left,
-    Tok_angle_bracket_left_left_equal,
-    Tok_angle_bracket_left_equal,
-    Tok_angle_bracket_right,
-    Tok_angle_bracket_right_right,
-    Tok_angle_bracket_right_right_equal,
-    Tok_angle_bracket_right_equal,
-
-    Tok_keyword_return,
-    Tok_keyword_const,
-    Tok_keyword_let,
-    Tok_keyword_static,
-    Tok_keyword_if,
-    Tok_keyword_else,
-    Tok_keyword_for,
-    Tok_keyword_while,
-    Tok_keyword_do,
-    Tok_keyword_goto,
-    Tok_keyword_switch,
-    Tok_keyword_case,
-    Tok_keyword_break,
-    Tok_keyword_default,
-    Tok_keyword_struct,
-    Tok_keyword_enum,
-    Tok_keyword_union,
-    Tok_keyword_typedef,
-    Tok_keyword_sizeof,
-    Tok_Keyword_signed,
-    Tok_keyword_unsigned,
-    Tok_keyword_int,
-    Tok_keyword_bool,
-    Tok_keyword_char,
-    Tok_keyword_short,
-    Tok_keyword_long,
-    Tok_keyword_float,
-    Tok_keyword_double,
-    Tok_keyword_true,
-    Tok_keyword_false,
-    Tok_keyword_u8,
-    Tok_keyword_i8,
-    Tok_keyword_u16,
-    Tok_keyword_i16,
-    Tok_keyword_u32,
-    Tok_keyword_i32,
-    Tok_keyword_u64,
-    Tok_keyword_i64,
-    Tok_keyword_f32,
-    Tok_keyword_f64,
-
-    Tok_builtin_include,
-    Tok_builtin_embed,
-    Tok_builtin_define,
-    Tok_builtin_ifdef,
-    Tok_builtin_ifndef,
-    Tok_builtin_endif,
+// C23 fixed underlying type of an enum, dropped for compilers that can't
+// parse it yet (gcc before 13); TokenKind is 32 bit either way.
+#if defined(__clang__) || (defined(__GNUC__) && __GNUC__ >= 13) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 202311L)
+#define C_LEXER_ENUM_TYPE(type) : type
+#else
+#define C_LEXER_ENUM_TYPE(type)
+#endif
+
+// Token kinds are generated from the lists below, so the enum, the name
+// table of token_enum_to_str and the keyword recognizer can't drift apart.
+// Literals and punctuators: X(name)
+#define C_LEXER_TOKENS(X) \
+    X(eof) X(error) X(identifier) X(number_literal) X(float_literal) X(string_literal) X(char_literal) \
+    X(l_paren) X(r_paren) X(l_brace) X(r_brace) X(l_bracket) X(r_bracket) \
+    X(period) X(ellipsis2) X(ellipsis3) \
+    X(colon) X(colon_equal) X(colon_colon) \
+    X(equal) X(equal_equal) X(semicolon) X(comma) \
+    X(bang) X(bang_equal) X(questionmark) X(dollar_sign) X(at_sign) X(hash) \
+    X(plus) X(plus_plus) X(plus_equal) \
+    X(minus) X(minus_minus) X(minus_equal) X(arrow) \
+    X(asterisk) X(asterisk_equal) X(slash) X(slash_equal) X(percent) X(percent_equal) \
+    X(pipe) X(pipe_equal) X(pipe_pipe) \
+    X(ampersand) X(ampersand_equal) X(ampersand_ampersand) \
+    X(caret) X(caret_equal) X(tilde) X(tilde_equal) \
+    X(angle_bracket_left) X(angle_bracket_left_left) X(angle_bracket_left_left_equal) X(angle_bracket_left_equal) \
+    X(angle_bracket_right) X(angle_bracket_right_right) X(angle_bracket_right_right_equal) X(angle_bracket_right_equal)
+
+// Keywords by the dialect that introduced them: X(word, first byte, last byte)
+// gives Tok_keyword_<word>. `word` only ever meets # and ##, so the bool,
+// true and false macros of <stdbool.h> never expand inside these lists.
+#define C_LEXER_KEYWORDS_C11(X) \
+    X(auto, 'a', 'o') X(break, 'b', 'k') X(case, 'c', 'e') X(char, 'c', 'r') \
+    X(const, 'c', 't') X(continue, 'c', 'e') X(default, 'd', 't') X(do, 'd', 'o') \
+    X(double, 'd', 'e') X(else, 'e', 'e') X(enum, 'e', 'm') X(extern, 'e', 'n') \
+    X(float, 'f', 't') X(for, 'f', 'r') X(goto, 'g', 'o') X(if, 'i', 'f') \
+    X(inline, 'i', 'e') X(int, 'i', 't') X(long, 'l', 'g') X(register, 'r', 'r') \
+    X(restrict, 'r', 't') X(return, 'r', 'n') X(short, 's', 't') X(signed, 's', 'd') \
+    X(sizeof, 's', 'f') X(static, 's', 'c') X(struct, 's', 't') X(switch, 's', 'h') \
+    X(typedef, 't', 'f') X(union, 'u', 'n') X(unsigned, 'u', 'd') X(void, 'v', 'd') \
+    X(volatile, 'v', 'e') X(while, 'w', 'e') \
+    X(_Alignas, '_', 's') X(_Alignof, '_', 'f') X(_Atomic, '_', 'c') X(_Bool, '_', 'l') \
+    X(_Complex, '_', 'x') X(_Generic, '_', 'c') X(_Imaginary, '_', 'y') X(_Noreturn, '_', 'n') \
+    X(_Static_assert, '_', 't') X(_Thread_local, '_', 'l')
+
+#define C_LEXER_KEYWORDS_SINCE_C23(X) \
+    X(alignas, 'a', 's') X(alignof, 'a', 'f') X(bool, 'b', 'l') X(constexpr, 'c', 'r') \
+    X(false, 'f', 'e') X(nullptr, 'n', 'r') X(static_assert, 's', 't') X(thread_local, 't', 'l') \
+    X(true, 't', 'e') X(typeof, 't', 'f') X(typeof_unqual, 't', 'l') \
+    X(_BitInt, '_', 't') X(_Decimal32, '_', '2') X(_Decimal64, '_', '4') X(_Decimal128, '_', '8')
+
+// the extended language: C23 plus `let` and fixed width type names
+#define C_LEXER_KEYWORDS_EXTENDED(X) \
+    X(let, 'l', 't') \
+    X(u8, 'u', '8') X(i8, 'i', '8') X(u16, 'u', '6') X(i16, 'i', '6') \
+    X(u32, 'u', '2') X(i32, 'i', '2') X(u64, 'u', '4') X(i64, 'i', '4') \
+    X(f32, 'f', '2') X(f64, 'f', '4')
+
+// `#` directives: X(word, first byte, last byte) gives Tok_builtin_<word>
+#define C_LEXER_BUILTINS(X) \
+    X(include, 'i', 'e') X(embed, 'e', 'd') X(define, 'd', 'e') \
+    X(ifdef, 'i', 'f') X(ifndef, 'i', 'f') X(endif, 'e', 'f')
+
+#define TOKEN_KIND_ENUM(name) Tok_##name,
+#define KEYWORD_KIND_ENUM(word, first, last) Tok_keyword_##word,
+#define BUILTIN_KIND_ENUM(word, first, last) Tok_builtin_##word,
+
+// Every dialect shares one TokenKind, so code naming e.g. Tok_keyword_let
+// builds in all of them; keywords outside the selected dialect just never
+// come out of the lexer.
+typedef enum TokenKind C_LEXER_ENUM_TYPE(uint32_t) {
+    C_LEXER_TOKENS(TOKEN_KIND_ENUM)
+    C_LEXER_KEYWORDS_C11(KEYWORD_KIND_ENUM)
+    C_LEXER_KEYWORDS_SINCE_C23(KEYWORD_KIND_ENUM)
+    C_LEXER_KEYWORDS_EXTENDED(KEYWORD_KIND_ENUM)
+    C_LEXER_BUILTINS(BUILTIN_KIND_ENUM)
 }TokenKind;
 
+#define TOKEN_KIND_COUNT (Tok_builtin_endif + 1)
 
-#define BUILTINS_TABLE_LEN 6 
-static  struct {const char* name; TokenKind kind;} BuiltinsTable[BUILTINS_TABLE_LEN] = {
+// the old misspelled name
+#define Tok_Keyword_signed Tok_keyword_signed
 
-    {"include" ,Tok_builtin_include},
-    {"embed"  , Tok_builtin_embed},
-    {"define" , Tok_builtin_define},
-    {"ifdef"  , Tok_builtin_ifdef},
-    {"ifndef" , Tok_builtin_ifndef},
-    {"endif"  , Tok_builtin_endif},
-};
+// The keyword set is picked at compile time, define C_LEXER_DIALECT to one
+// of these before including the header (the same in every translation unit).
+#define C_LEXER_DIALECT_C11 1
+#define C_LEXER_DIALECT_C23 2
+#define C_LEXER_DIALECT_EXTENDED 3
 
-#define KEYWORDS_TABLE_LEN 40
-static  struct {const char* name; TokenKind kind;} KeywordsTable[KEYWORDS_TABLE_LEN] = {
-    { "return"    , Tok_keyword_return },
-    { "const"     , Tok_keyword_const },
-    { "let"       , Tok_keyword_let },
-    { "static"    , Tok_keyword_static },
-    { "if"        , Tok_keyword_if },
-    { "else"      , Tok_keyword_else },
-    { "for"       , Tok_keyword_for },
-    { "while"     , Tok_keyword_while },
-    { "do"        , Tok_keyword_do },
-    { "goto"      , Tok_keyword_goto },
-    { "switch"    , Tok_keyword_switch },
-    { "case"      , Tok_keyword_case },
-    { "break"     , Tok_keyword_break },
-    { "default"   , Tok_keyword_default },
-    { "struct"    , Tok_keyword_struct },
-    { "enum"      , Tok_keyword_enum },
-    { "union"     , Tok_keyword_union },
-    { "typedef"   , Tok_keyword_typedef },
-    { "sizeof"    , Tok_keyword_sizeof },
-    { "signed"    , Tok_Keyword_signed },
-    { "unsigned"  , Tok_keyword_unsigned },
-    { "int"       , Tok_keyword_int },
-    { "bool"       , Tok_keyword_bool },
-    { "char"      , Tok_keyword_char },
-    { "short"     , Tok_keyword_short },
-    { "long"      , Tok_keyword_long },
-    { "float"     , Tok_keyword_float },
-    { "double"    , Tok_keyword_double },
-    { "true"      , Tok_keyword_true },
-    { "false"     , Tok_keyword_false },
-    { "u8"        , Tok_keyword_u8 },
-    { "i8"        , Tok_keyword_i8 },
-    { "u16"       , Tok_keyword_u16 },
-    { "i16"       , Tok_keyword_i16 },
-    { "u32"       , Tok_keyword_u32 },
-    { "i32"       , Tok_keyword_i32 },
-    { "u64"       , Tok_keyword_u64 },
-    { "i64"       , Tok_keyword_i64 },
-    { "f32"       , Tok_keyword_f32 },
-    { "f64"       , Tok_keyword_f64 },
-};
+#ifndef C_LEXER_DIALECT
+#define C_LEXER_DIALECT C_LEXER_DIALECT_EXTENDED
+#endif
+
+// Keywords and `#` directives are classified with a perfect hash over
+// (length, first byte, last byte): one table probe and one exact compare per
+// identifier. The three are packed in a word and multiplied, the top `bits`
+// of the product are the slot. Each dialect has its own multiplier and the
+// smallest table it fits in, so C11 doesn't pay for the extended keywords.
+// The tables are built by the compiler from the lists and
+// `keywords_hash_check`/`builtins_hash_check` turn any slot collision into a
+// duplicate `case` compile error; a keyword that collides needs a new
+// multiplier, any odd constant that gets through that check will do.
+#define KEYWORD_SLOT(len, first, last, mul, bits) \
+    ((((uint32_t)(len) << 16 | (uint32_t)(uint8_t)(first) << 8 | (uint32_t)(uint8_t)(last)) * (uint32_t)(mul)) >> (32 - (bits)))
+
+#if C_LEXER_DIALECT == C_LEXER_DIALECT_C11
+#define C_LEXER_KEYWORDS(X) C_LEXER_KEYWORDS_C11(X)
+#define KEYWORDS_HASH_MUL 0xf151865bu
+#define KEYWORDS_HASH_BITS 7
+#elif C_LEXER_DIALECT == C_LEXER_DIALECT_C23
+#define C_LEXER_KEYWORDS(X) C_LEXER_KEYWORDS_C11(X) C_LEXER_KEYWORDS_SINCE_C23(X)
+#define KEYWORDS_HASH_MUL 0x0e6006bbu
+#define KEYWORDS_HASH_BITS 8
+#elif C_LEXER_DIALECT == C_LEXER_DIALECT_EXTENDED
+#define C_LEXER_KEYWORDS(X) C_LEXER_KEYWORDS_C11(X) C_LEXER_KEYWORDS_SINCE_C23(X) C_LEXER_KEYWORDS_EXTENDED(X)
+#define KEYWORDS_HASH_MUL 0x48a9ca93u
+#define KEYWORDS_HASH_BITS 8
+#else
+#error "C_LEXER_DIALECT must be C_LEXER_DIALECT_C11, C_LEXER_DIALECT_C23 or C_LEXER_DIALECT_EXTENDED"
+#endif
+
+#define KEYWORDS_HASH_SIZE (1u << KEYWORDS_HASH_BITS)
+#define KEYWORD_MIN_LEN 2
+#define KEYWORD_MAX_LEN 14
+
+#define BUILTINS_HASH_MUL 0x2265b1f5u
+#define BUILTINS_HASH_BITS 4
+#define BUILTINS_HASH_SIZE (1u << BUILTINS_HASH_BITS)
+#define BUILTIN_MIN_LEN 5
+#define BUILTIN_MAX_LEN 7
+
+typedef struct KeywordEntry {
+    const char* name;
+    uint32_t len;
+    TokenKind kind;
+} KeywordEntry;
+
+#define BUILTIN_TABLE_ENTRY(word, first, last) \
+    [KEYWORD_SLOT(sizeof(#word) - 1, first, last, BUILTINS_HASH_MUL, BUILTINS_HASH_BITS)] = {#word, sizeof(#word) - 1, Tok_builtin_##word},
+#define KEYWORD_TABLE_ENTRY(word, first, last) \
+    [KEYWORD_SLOT(sizeof(#word) - 1, first, last, KEYWORDS_HASH_MUL, KEYWORDS_HASH_BITS)] = {#word, sizeof(#word) - 1, Tok_keyword_##word},
+#define BUILTIN_HASH_CASE(word, first, last) \
+    case KEYWORD_SLOT(sizeof(#word) - 1, first, last, BUILTINS_HASH_MUL, BUILTINS_HASH_BITS): break;
+#define KEYWORD_HASH_CASE(word, first, last) \
+    case KEYWORD_SLOT(sizeof(#word) - 1, first, last, KEYWORDS_HASH_MUL, KEYWORDS_HASH_BITS): break;
+#define BUILTIN_LEN_CHECK(word, first, last) \
+    _Static_assert(sizeof(#word) - 1 >= BUILTIN_MIN_LEN && sizeof(#word) - 1 <= BUILTIN_MAX_LEN, "`" #word "` is outside BUILTIN_MIN_LEN..BUILTIN_MAX_LEN");
+#define KEYWORD_LEN_CHECK(word, first, last) \
+    _Static_assert(sizeof(#word) - 1 >= KEYWORD_MIN_LEN && sizeof(#word) - 1 <= KEYWORD_MAX_LEN, "`" #word "` is outside KEYWORD_MIN_LEN..KEYWORD_MAX_LEN");
+
+static const KeywordEntry BuiltinsTable[BUILTINS_HASH_SIZE] = { C_LEXER_BUILTINS(BUILTIN_TABLE_ENTRY) };
+static const KeywordEntry KeywordsTable[KEYWORDS_HASH_SIZE] = { C_LEXER_KEYWORDS(KEYWORD_TABLE_ENTRY) };
+
+static inline void builtins_hash_check(uint32_t slot){ switch(slot){ C_LEXER_BUILTINS(BUILTIN_HASH_CASE) default: break; } }
+static inline void keywords_hash_check(uint32_t slot){ switch(slot){ C_LEXER_KEYWORDS(KEYWORD_HASH_CASE) default: break; } }
+C_LEXER_BUILTINS(BUILTIN_LEN_CHECK)
+C_LEXER_KEYWORDS(KEYWORD_LEN_CHECK)
 
 typedef enum LexingState{
     Lexing_start,
@@ -212,14 +224,23 @@ typedef enum LexingState{
     Lexing_bang,
     Lexing_period,
     Lexing_single_line_comment,
+    Lexing_multi_line_comment,
     Lexing_builtin,
 }LexingState;
 
+#define LEXING_STATE_COUNT (Lexing_builtin + 1)
+
+// Readable zero bytes guaranteed after the end of every CFile buffer: the
+// NUL terminator plus room for vector loads that run past it.
+#define CFILE_PADDING 64
+
 typedef struct CFile {
     const char* name;
     size_t size;
     FILE* fp;
     char* buffer; // buffer containing file content;
+    size_t map_size; // non zero when `buffer` is a read-only mapping
+    Arena* arena;    // owns `buffer` when set, cfile_deinit leaves it alone
 } CFile;
 
 typedef struct Location {
@@ -231,35 +252,813 @@ typedef struct Location {
 typedef struct Token {
     TokenKind kind;
     Location loc;
-    char* buf;
+    // interned identifier, index into Lexer.numbers for a number literal,
+    // 0 for other tokens or without an Interner or NumberTable
+    uint32_t symbol;
 } Token; 
 
+// Kernels that skip a whole run of one character class starting at `index`
+// and return the index of the first byte outside it. Every class excludes
+// '\0', so the NUL terminator always stops a run. The vector versions only
+// issue aligned loads, which never cross a page boundary, so they may read
+// past the terminator but never fault on it.
+typedef struct LexerKernels {
+    const char* name;
+    uint32_t (*skip_blanks)(const char* src, uint32_t index);     // ' ' '\t'
+    uint32_t (*skip_identifier)(const char* src, uint32_t index); // [a-zA-Z0-9_]
+    uint32_t (*skip_digits)(const char* src, uint32_t index);     // [0-9]
+    uint32_t (*skip_line)(const char* src, uint32_t index);       // up to '\n'
+    uint32_t (*skip_text)(const char* src, uint32_t index);       // up to '"' '\'' '/' '#'
+    uint32_t (*skip_comment)(const char* src, uint32_t index);    // up to the '*' of "*/"
+    uint32_t (*skip_string)(const char* src, uint32_t index);     // up to '"' '\\' '\n'
+    uint32_t (*skip_char)(const char* src, uint32_t index);       // up to '\'' '\\' '\n'
+    // stores the offset of every '\n' in [begin, end) and returns how many
+    uint32_t (*find_newlines)(const char* src, uint32_t begin, uint32_t end, uint32_t* out);
+    uint32_t (*count_newlines)(const char* src, uint32_t begin, uint32_t end);
+    // offset of the first invalid UTF-8 sequence in [0, len), or len; this
+    // one reads nothing past `len`
+    uint32_t (*validate_utf8)(const char* src, uint32_t len);
+} LexerKernels;
+
+typedef struct LexerDiagnostic {
+    LexerError code;
+    Location loc;
+} LexerDiagnostic;
+
+// `read()`-style input callback: fills at most `cap` bytes of `buf` and
+// returns how many it wrote, 0 at the end of the input or -1 on an error.
+typedef ssize_t (*LexerReadFn)(void* ctx, char* buf, size_t cap);
+
+// window bytes pulled per refill when lexer_stream_init gets 0
+#ifndef LEXER_STREAM_WINDOW
+#define LEXER_STREAM_WINDOW (64u * 1024u)
+#endif
+
+// Input of a streaming Lexer. The lexer sees one window at a time: when a
+// state reaches the NUL at the end of the window, the bytes of the token in
+// progress are moved to the front, the rest is refilled from `read` and the
+// state carries on where it stopped. A token is therefore never cut, and the
+// window only grows (doubling) when a single token fills half of it.
+// Token and diagnostic offsets are relative to `window` and `base` is the
+// stream offset of window[0]; both move on the next lexer_next_token call.
+typedef struct LexerStream {
+    LexerReadFn read;
+    void* ctx;
+    char* window;  // cap + CFILE_PADDING bytes
+    uint32_t cap;
+    uint64_t base;
+    bool eof;
+} LexerStream;
+
+// Identifiers interned to dense ids, so that comparing two names is comparing
+// two integers. An open addressing table holds the hash and id of each name
+// in one 64 bit slot, the names themselves are copied NUL terminated into
+// the interner's own arena, so the views stay valid until interner_deinit.
+// Id 0 is the empty name and stands for "no symbol". An Interner is not
+// thread safe: give every thread its own and interner_merge them afterwards.
+typedef struct StrView {
+    const char* ptr;
+    uint32_t len;
+} StrView;
+
+typedef struct Interner {
+    uint64_t* slots; // hash << 32 | id, 0 when empty
+    uint32_t slot_mask;
+    StrView* names;  // by id
+    uint32_t len;
+    uint32_t cap;
+    Arena strings;
+} Interner;
+
+#define INTERNER_CHUNK (64u * 1024u)
+
+// What a number literal is, besides its value. The suffixes are recorded as
+// written, picking the type they give is left to the parser.
+typedef enum NumberFlags {
+    Number_float       = 1 << 0,  // a Tok_float_literal, the value is a double
+    Number_based       = 1 << 1,  // hex, octal or binary: may be unsigned without u
+    Number_unsigned    = 1 << 2,  // u
+    Number_long        = 1 << 3,  // l
+    Number_long_long   = 1 << 4,  // ll
+    Number_bit_precise = 1 << 5,  // wb
+    Number_single      = 1 << 6,  // f
+    Number_interchange = 1 << 7,  // f16 f32 f64 f128 f32x f64x
+    Number_decimal     = 1 << 8,  // df dd dl, the value is the nearest double
+    Number_imaginary   = 1 << 9,  // i or j, a GNU extension
+    Number_overflow    = 1 << 10, // above UINT64_MAX (saturated) or out of double range
+} NumberFlags;
+
+typedef union NumberValue {
+    uint64_t u;
+    double f;
+} NumberValue;
+
+// Side array of decoded number literals. A Lexer with `numbers` set
+// appends one entry per Tok_number_literal or Tok_float_literal and gives
+// the token its index in `symbol`, so TokenBuffer_symbols keeps them too.
+typedef struct NumberTable {
+    NumberValue* values;
+    uint16_t* flags; // NumberFlags
+    uint32_t len;
+    uint32_t cap;
+} NumberTable;
+
+// Offsets of every '\n' of `source`, built in one vector pass. Maps offsets
+// to lines and columns with a binary search, so line numbers can be left out
+// of the lexing loop and only be paid for when one is actually printed.
+typedef struct LineIndex {
+    const char* source; // NULL until built
+    uint32_t src_len;
+    uint32_t* newlines;
+    uint32_t len;
+    uint32_t cap;
+} LineIndex;
+
+// both 1-based, the column counts bytes
+typedef struct LineColumn {
+    uint32_t line;
+    uint32_t column;
+} LineColumn;
+
+// Define C_LEXER_NO_LINES to drop line counting from lexer_next_token: tokens
+// and diagnostics then report line 0 and lines come from a LineIndex.
+#ifdef C_LEXER_NO_LINES
+#define LEXER_FIRST_LINE 0
+#define LEXER_NEWLINE(lex) ((void)0)
+#else
+#define LEXER_FIRST_LINE 1
+#define LEXER_NEWLINE(lex) ((lex)->line += 1)
+#endif
+
+// Define C_LEXER_PROFILE to instrument lexer_next_token; without it the hooks
+// compile to nothing. A Lexer with `profile` set then records how often the
+// state machine entered each LexingState, the bytes and cycles spent in it,
+// the kinds of the tokens returned, and the cycles of every call (rdtsc,
+// nanoseconds off x86). One profile per thread, lexer_profile_add sums them.
+typedef struct LexerProfile {
+    uint64_t transitions[LEXING_STATE_COUNT];
+    uint64_t bytes[LEXING_STATE_COUNT];
+    uint64_t state_cycles[LEXING_STATE_COUNT];
+    uint64_t kinds[TOKEN_KIND_COUNT];
+    uint64_t calls;
+    uint64_t cycles;
+} LexerProfile;
+
+// All error state lives in the Lexer: a bad byte or an unterminated literal
+// comes out as a Tok_error token and a diagnostic with the same location, and
+// lexing carries on after it. Call lexer_deinit to release the diagnostics,
+// or set `arena` to take them from it.
 typedef struct Lexer {
     const char* source;
     uint32_t src_len;
     uint32_t index;
     uint32_t line;
+    const LexerKernels* kernels;
+    LexerStream* stream; // NULL when `source` holds the whole input
+    LineIndex line_index; // built by the first lexer_get_line or lexer_line_column
+    Interner* interner;   // when set, Tok_identifier tokens get their symbol
+    NumberTable* numbers; // when set, number literals are decoded into it
+    uint32_t utf8_end;    // source[0, utf8_end) is valid UTF-8, see lexer_validate_utf8
+    Arena* arena;         // when set, diagnostics are allocated from it
+    LexerProfile* profile; // counters, only updated under C_LEXER_PROFILE
+    LexerDiagnostic* diags;
+    uint32_t diag_len;
+    uint32_t diag_cap;
 } Lexer;
 
+// roughly one token per 5 bytes of C source, used to size buffers from file sizes
+#define TOKEN_BUFFER_BYTES_PER_TOKEN 5
+
+// Tokens stored column-wise for whole-file lexing: a kind byte and an offset
+// per token (5 bytes instead of the 20 of a Token), plus the optional lengths,
+// lines and symbols columns. A length can always be recomputed from the offset with
+// token_len_at, so dropping that column only costs a re-lex on access.
+// A buffer made by token_buffer_init_arena grows inside its arena and
+// token_buffer_deinit only forgets it; the arena frees the columns.
+typedef enum TokenBufferFlags {
+    TokenBuffer_lengths = 1 << 0,
+    TokenBuffer_lines   = 1 << 1,
+    TokenBuffer_symbols = 1 << 2,
+} TokenBufferFlags;
+
+typedef struct TokenBuffer {
+    uint8_t* kinds;
+    uint32_t* offsets;
+    uint32_t* lengths; // NULL without TokenBuffer_lengths
+    uint32_t* lines;   // NULL without TokenBuffer_lines
+    uint32_t* symbols; // NULL without TokenBuffer_symbols
+    uint32_t len;
+    uint32_t cap;
+    uint32_t flags;
+    Arena* arena;
+} TokenBuffer;
+
+// An edit already applied to the source: `deleted` bytes at `offset` were
+// replaced by `inserted` bytes.
+typedef struct TokenEdit {
+    uint32_t offset;
+    uint32_t deleted;
+    uint32_t inserted;
+} TokenEdit;
+
+// Where token_buffer_relex changed the buffer: `removed` old tokens starting
+// at index `first` were replaced by `added` new ones, everything after them
+// was only shifted.
+typedef struct TokenSplice {
+    uint32_t first;
+    uint32_t removed;
+    uint32_t added;
+} TokenSplice;
+
+// tokens a LexerLookahead holds, a power of two
+#ifndef LEXER_LOOKAHEAD
+#define LEXER_LOOKAHEAD 64
+#endif
+
+// A position in the token sequence of a LexerLookahead, with the lexer
+// state to lex its token again once the ring has dropped it.
+typedef struct LexerCheckpoint {
+    uint32_t pos;        // tokens handed out before it
+    uint32_t index;
+    uint32_t line;
+    uint32_t diag_len;
+    uint32_t number_len;
+} LexerCheckpoint;
+
+// Lookahead for parsers on top of lexer_next_token: a ring of the last
+// LEXER_LOOKAHEAD tokens lexed, so peeking ahead and rewinding to a
+// checkpoint hand out buffered tokens instead of lexing the bytes again.
+// Positions count tokens from the first one, `head` is the next to hand
+// out and `tail` the next to lex; the ring holds the last LEXER_LOOKAHEAD
+// of [first, tail). A rewind to a token the ring no longer holds resets the
+// lexer to the checkpoint, empties the ring and lexes again, dropping the
+// diagnostics and number values reported since. Not for streaming lexers.
+typedef struct LexerLookahead {
+    Lexer* lexer;
+    uint32_t first;
+    uint32_t head;
+    uint32_t tail;
+    Token tokens[LEXER_LOOKAHEAD];
+    LexerCheckpoint marks[LEXER_LOOKAHEAD]; // the lexer state before each token
+} LexerLookahead;
+
 CFile cfile_init_alloc(const char* file_name);
+int cfile_init_mmap(CFile* file, const char* file_name);
+int cfile_init_arena(CFile* file, const char* file_name, Arena* arena);
 void cfile_deinit(CFile* file);
 Token create_token(Lexer* lexer,TokenKind kind,uint32_t start,uint32_t end);
 Lexer lexer_init(const char* source);
 Lexer lexer_init_s(const char* source,uint32_t src_len);
+void lexer_reset(Lexer* lexer, const char* source, uint32_t src_len);
+uint32_t lexer_validate_utf8(Lexer* lexer);
+void lexer_stream_init(LexerStream* stream, LexerReadFn read, void* ctx, uint32_t window);
+void lexer_stream_deinit(LexerStream* stream);
+Lexer lexer_init_stream(LexerStream* stream);
+uint64_t lexer_stream_offset(const Lexer* lexer, Location loc);
+ssize_t lexer_read_fd(void* fd, char* buf, size_t cap);
+void lexer_deinit(Lexer* lexer);
+void lexer_report(Lexer* lexer, LexerError code, Location loc);
+const char* lexer_error_to_str(LexerError code);
+void lexer_print_diagnostics(const Lexer* lexer, FILE* out, const char* file_name);
 Token lexer_next_token(Lexer* lexer);
+Token lexer_next_token_dfa(Lexer* lexer);
+TokenKind keyword_lookup(const char* ident, uint32_t len);
+const LexerKernels* lexer_kernels_detect(void);
+const LexerKernels* lexer_kernels_by_name(const char* name);
+TokenKind builtin_lookup(const char* name, uint32_t len);
+void interner_init(Interner* interner, uint32_t size_hint);
+void interner_deinit(Interner* interner);
+uint32_t interner_intern(Interner* interner, const char* name, uint32_t len);
+uint32_t interner_find(const Interner* interner, const char* name, uint32_t len);
+StrView interner_get(const Interner* interner, uint32_t symbol);
+void interner_merge(Interner* into, const Interner* from, uint32_t* remap);
+bool number_literal_decode(const char* text, uint32_t len, NumberValue* value, uint16_t* flags);
+uint32_t number_table_push(NumberTable* table, NumberValue value, uint16_t flags);
+void number_table_deinit(NumberTable* table);
 const char* token_buf_noalloc(const char* source,Token* tok);
-const char* lexer_get_line(Lexer* lexer, Token* token);
-const char* token_get_line(const char* source, Token* token);
+const char* token_enum_to_str(TokenKind kind);
+const char* lexing_state_to_str(LexingState state);
+void lexer_profile_add(LexerProfile* into, const LexerProfile* from);
+void lexer_profile_print(const LexerProfile* profile, FILE* out);
+void token_buffer_init(TokenBuffer* buf, uint32_t flags, size_t size_hint);
+void token_buffer_init_arena(TokenBuffer* buf, uint32_t flags, size_t size_hint, Arena* arena);
+void token_buffer_reserve(TokenBuffer* buf, uint32_t cap);
+void token_buffer_push(TokenBuffer* buf, Token tok);
+void token_buffer_reset(TokenBuffer* buf);
+void token_buffer_deinit(TokenBuffer* buf);
+Token token_buffer_get(const TokenBuffer* buf, const char* source, uint32_t i);
+uint32_t token_len_at(const char* source, TokenKind kind, uint32_t offset);
+uint32_t lexer_tokenize_all(Lexer* lexer, TokenBuffer* out);
+Token lexer_next_directive(Lexer* lexer);
+uint32_t lexer_scan_directives(Lexer* lexer, TokenBuffer* out);
+void lexer_lookahead_init(LexerLookahead* lookahead, Lexer* lexer);
+Token lexer_peek(LexerLookahead* lookahead, uint32_t n);
+Token lexer_lookahead_next(LexerLookahead* lookahead);
+LexerCheckpoint lexer_checkpoint(const LexerLookahead* lookahead);
+void lexer_rewind(LexerLookahead* lookahead, LexerCheckpoint checkpoint);
+void token_buffer_remap_symbols(TokenBuffer* buf, uint32_t first, const uint32_t* remap);
+TokenSplice token_buffer_relex(TokenBuffer* buf, const char* source, uint32_t src_len, TokenEdit edit, Interner* interner);
+void line_index_build(LineIndex* index, const char* source, uint32_t src_len);
+void line_index_deinit(LineIndex* index);
+LineColumn line_index_lookup(const LineIndex* index, uint32_t offset);
+const char* line_index_line(const LineIndex* index, uint32_t line, uint32_t* len);
+LineColumn lexer_line_column(Lexer* lexer, uint32_t offset);
+const char* lexer_get_line(Lexer* lexer, const Token* token, uint32_t* len);
+const char* token_get_line(const char* source, const Token* token, uint32_t* len);
 
 
 #ifdef IMPEL_C_LEXER
 
+static uint32_t skip_blanks_scalar(const char* src, uint32_t index){
+    while(src[index] == ' ' || src[index] == '\t') index += 1;
+    return index;
+}
+
+static uint32_t skip_identifier_scalar(const char* src, uint32_t index){
+    for(;;){
+        switch(src[index]){
+            case 'a' ... 'z':
+            case 'A' ... 'Z':
+            case '0' ... '9':
+            case '_':
+                index += 1;
+                continue;
+            default:
+                return index;
+        }
+    }
+}
+
+static uint32_t skip_digits_scalar(const char* src, uint32_t index){
+    while(src[index] >= '0' && src[index] <= '9') index += 1;
+    return index;
+}
+
+static uint32_t skip_line_scalar(const char* src, uint32_t index){
+    while(src[index] != '\n' && src[index] != '\0') index += 1;
+    return index;
+}
+
+static uint32_t skip_text_scalar(const char* src, uint32_t index){
+    for(;;){
+        switch(src[index]){
+            case '"':
+            case '\'':
+            case '/':
+            case '#':
+            case '\0':
+                return index;
+            default:
+                index += 1;
+        }
+    }
+}
+
+static uint32_t skip_comment_scalar(const char* src, uint32_t index){
+    while(src[index] != '\0' && !(src[index] == '*' && src[index + 1] == '/')) index += 1;
+    return index;
+}
+
+static uint32_t skip_string_scalar(const char* src, uint32_t index){
+    for(;;){
+        switch(src[index]){
+            case '"':
+            case '\\':
+            case '\n':
+            case '\0':
+                return index;
+            default:
+                index += 1;
+        }
+    }
+}
+
+static uint32_t skip_char_scalar(const char* src, uint32_t index){
+    for(;;){
+        switch(src[index]){
+            case '\'':
+            case '\\':
+            case '\n':
+            case '\0':
+                return index;
+            default:
+                index += 1;
+        }
+    }
+}
+
+static uint32_t find_newlines_scalar(const char* src, uint32_t begin, uint32_t end, uint32_t* out){
+    uint32_t n = 0;
+    for(uint32_t i = begin; i < end; i++){
+        if(src[i] == '\n') out[n++] = i;
+    }
+    return n;
+}
+
+static uint32_t count_newlines_scalar(const char* src, uint32_t begin, uint32_t end){
+    uint32_t n = 0;
+    for(uint32_t i = begin; i < end; i++) n += src[i] == '\n';
+    return n;
+}
+
+// Length of the UTF-8 sequence at `src` with its code point in `*cp`, or 0
+// when it isn't a valid one (overlong, surrogate, above U+10FFFF or cut
+// short). Reading stops at the first byte that isn't a continuation, so the
+// NUL after the source ends a cut sequence.
+static uint32_t utf8_decode(const char* src, uint32_t* cp){
+    const uint8_t* s = (const uint8_t*)src;
+    uint32_t c = s[0], n, min;
+    if(c < 0x80){
+        *cp = c;
+        return 1;
+    }
+    if(c >= 0xC2 && c <= 0xDF){
+        n = 2, c &= 0x1F, min = 0x80;
+    }else if(c >= 0xE0 && c <= 0xEF){
+        n = 3, c &= 0x0F, min = 0x800;
+    }else if(c >= 0xF0 && c <= 0xF4){
+        n = 4, c &= 0x07, min = 0x10000;
+    }else{
+        return 0;
+    }
+    for(uint32_t i = 1; i < n; i++){
+        if((s[i] & 0xC0) != 0x80) return 0;
+        c = c << 6 | (s[i] & 0x3F);
+    }
+    if(c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF)) return 0;
+    *cp = c;
+    return n;
+}
+
+// utf8_decode for bytes already validated: the lead byte gives the length
+static inline uint32_t utf8_decode_valid(const char* src, uint32_t* cp){
+    const uint8_t* s = (const uint8_t*)src;
+    if(s[0] < 0xE0){
+        *cp = (uint32_t)(s[0] & 0x1F) << 6 | (s[1] & 0x3F);
+        return 2;
+    }
+    if(s[0] < 0xF0){
+        *cp = (uint32_t)(s[0] & 0x0F) << 12 | (uint32_t)(s[1] & 0x3F) << 6 | (s[2] & 0x3F);
+        return 3;
+    }
+    *cp = (uint32_t)(s[0] & 0x07) << 18 | (uint32_t)(s[1] & 0x3F) << 12 | (uint32_t)(s[2] & 0x3F) << 6 | (s[3] & 0x3F);
+    return 4;
+}
+
+// validates [index, len), `index` on the start of a sequence
+static uint32_t validate_utf8_from(const char* src, uint32_t index, uint32_t len){
+    while(index < len){
+        uint64_t word;
+        if(index + 8 <= len && (memcpy(&word, src + index, 8), !(word & 0x8080808080808080ull))){
+            index += 8;
+            continue;
+        }
+        // the last bytes are decoded from a copy, so a cut sequence ends in its zeros
+        char tail[4] = {0};
+        const char* at = src + index;
+        if(len - index < 4) at = (const char*)memcpy(tail, at, len - index);
+        uint32_t cp, n = utf8_decode(at, &cp);
+        if(n == 0) return index;
+        index += n;
+    }
+    return len;
+}
+
+static uint32_t validate_utf8_scalar(const char* src, uint32_t len){
+    return validate_utf8_from(src, 0, len);
+}
+
+static const LexerKernels LexerKernelsScalar = {
+    .name = "scalar",
+    .skip_blanks = skip_blanks_scalar,
+    .skip_identifier = skip_identifier_scalar,
+    .skip_digits = skip_digits_scalar,
+    .skip_line = skip_line_scalar,
+    .skip_text = skip_text_scalar,
+    .skip_comment = skip_comment_scalar,
+    .skip_string = skip_string_scalar,
+    .skip_char = skip_char_scalar,
+    .find_newlines = find_newlines_scalar,
+    .count_newlines = count_newlines_scalar,
+    .validate_utf8 = validate_utf8_scalar,
+};
+
+#ifdef C_LEXER_X86
+
+// Class masks: 0xFF in every lane whose byte belongs to the run. Unsigned
+// range checks are done as `min_epu8(c - lo, hi - lo) == c - lo`.
+#define LEXER_SIMD_CLASSES(isa, vec, W, bits) \
+    __attribute__((target(#isa))) static inline vec blank_mask_##isa(vec c){ \
+        return W##_or_si##bits(W##_cmpeq_epi8(c, W##_set1_epi8(' ')), W##_cmpeq_epi8(c, W##_set1_epi8('\t'))); \
+    } \
+    __attribute__((target(#isa))) static inline vec digit_mask_##isa(vec c){ \
+        vec d = W##_sub_epi8(c, W##_set1_epi8('0')); \
+        return W##_cmpeq_epi8(W##_min_epu8(d, W##_set1_epi8(9)), d); \
+    } \
+    __attribute__((target(#isa))) static inline vec identifier_mask_##isa(vec c){ \
+        vec a = W##_sub_epi8(W##_or_si##bits(c, W##_set1_epi8(0x20)), W##_set1_epi8('a')); \
+        vec alpha = W##_cmpeq_epi8(W##_min_epu8(a, W##_set1_epi8(25)), a); \
+        vec under = W##_cmpeq_epi8(c, W##_set1_epi8('_')); \
+        return W##_or_si##bits(W##_or_si##bits(alpha, under), digit_mask_##isa(c)); \
+    } \
+    __attribute__((target(#isa))) static inline vec line_mask_##isa(vec c){ \
+        vec stop = W##_or_si##bits(W##_cmpeq_epi8(c, W##_set1_epi8('\n')), W##_cmpeq_epi8(c, W##_setzero_si##bits())); \
+        return W##_xor_si##bits(stop, W##_set1_epi8(-1)); \
+    } \
+    __attribute__((target(#isa))) static inline vec text_mask_##isa(vec c){ \
+        vec quotes = W##_or_si##bits(W##_cmpeq_epi8(c, W##_set1_epi8('"')), W##_cmpeq_epi8(c, W##_set1_epi8('\''))); \
+        vec marks = W##_or_si##bits(W##_cmpeq_epi8(c, W##_set1_epi8('/')), W##_cmpeq_epi8(c, W##_set1_epi8('#'))); \
+        vec stop = W##_or_si##bits(W##_or_si##bits(quotes, marks), W##_cmpeq_epi8(c, W##_setzero_si##bits())); \
+        return W##_xor_si##bits(stop, W##_set1_epi8(-1)); \
+    } \
+    __attribute__((target(#isa))) static inline vec quoted_mask_##isa(vec c, char quote){ \
+        vec ends = W##_or_si##bits(W##_cmpeq_epi8(c, W##_set1_epi8(quote)), W##_cmpeq_epi8(c, W##_set1_epi8('\\'))); \
+        vec lines = W##_or_si##bits(W##_cmpeq_epi8(c, W##_set1_epi8('\n')), W##_cmpeq_epi8(c, W##_setzero_si##bits())); \
+        return W##_xor_si##bits(W##_or_si##bits(ends, lines), W##_set1_epi8(-1)); \
+    } \
+    __attribute__((target(#isa))) static inline vec string_mask_##isa(vec c){ return quoted_mask_##isa(c, '"'); } \
+    __attribute__((target(#isa))) static inline vec char_mask_##isa(vec c){ return quoted_mask_##isa(c, '\''); }
+
+// Starts at the aligned block containing `index`, drops the lanes before it,
+// then walks whole blocks until a lane leaves the class.
+#define LEXER_SIMD_SKIP(isa, vec, W, bits, full, class) \
+    __attribute__((target(#isa))) static uint32_t skip_##class##_##isa(const char* src, uint32_t index){ \
+        const char* p = src + index; \
+        const char* block = (const char*)((uintptr_t)p & ~(uintptr_t)(sizeof(vec) - 1)); \
+        uint32_t stop = ~(uint32_t)W##_movemask_epi8(class##_mask_##isa(W##_load_si##bits((const vec*)block))); \
+        stop &= (full << (p - block)) & full; \
+        while(!stop){ \
+            block += sizeof(vec); \
+            stop = ~(uint32_t)W##_movemask_epi8(class##_mask_##isa(W##_load_si##bits((const vec*)block))) & full; \
+        } \
+        return (uint32_t)(block - src) + (uint32_t)__builtin_ctz(stop); \
+    }
+
+// A '*' ends a comment when the next lane holds '/'. The '/' mask is shifted
+// down one lane, the last lane looks at the first one of the next block.
+#define LEXER_SIMD_COMMENT(isa, vec, W, bits, full) \
+    __attribute__((target(#isa))) static uint32_t skip_comment_##isa(const char* src, uint32_t index){ \
+        const char* p = src + index; \
+        const char* block = (const char*)((uintptr_t)p & ~(uintptr_t)(sizeof(vec) - 1)); \
+        uint32_t keep = (full << (p - block)) & full, carry = 0; \
+        const vec star = W##_set1_epi8('*'), slash = W##_set1_epi8('/'), zero = W##_setzero_si##bits(); \
+        for(;; block += sizeof(vec), keep = full){ \
+            vec c = W##_load_si##bits((const vec*)block); \
+            uint32_t stars = (uint32_t)W##_movemask_epi8(W##_cmpeq_epi8(c, star)) & keep; \
+            uint32_t slashes = (uint32_t)W##_movemask_epi8(W##_cmpeq_epi8(c, slash)); \
+            if(carry && (slashes & 1)) return (uint32_t)(block - src) - 1; \
+            uint32_t stop = ((stars & (slashes >> 1)) | (uint32_t)W##_movemask_epi8(W##_cmpeq_epi8(c, zero))) & keep; \
+            if(stop) return (uint32_t)(block - src) + (uint32_t)__builtin_ctz(stop); \
+            carry = stars >> (sizeof(vec) - 1); \
+        } \
+    }
+
+// Lanes before `begin` and from `end` on are masked off, the set bits of the
+// '\n' mask are peeled one by one, or only counted.
+#define LEXER_SIMD_NEWLINES(isa, vec, W, bits, full) \
+    __attribute__((target(#isa))) static uint32_t find_newlines_##isa(const char* src, uint32_t begin, uint32_t end, uint32_t* out){ \
+        uint32_t n = 0; \
+        if(begin >= end) return 0; \
+        const char* block = (const char*)((uintptr_t)(src + begin) & ~(uintptr_t)(sizeof(vec) - 1)); \
+        uint32_t keep = (full << ((src + begin) - block)) & full; \
+        const vec nl = W##_set1_epi8('\n'); \
+        for(; block < src + end; block += sizeof(vec), keep = full){ \
+            uint32_t mask = (uint32_t)W##_movemask_epi8(W##_cmpeq_epi8(W##_load_si##bits((const vec*)block), nl)) & keep; \
+            uint32_t base = (uint32_t)(block - src), width = (uint32_t)sizeof(vec); \
+            /* wraps like `base` when the first block starts before `src` */ \
+            if(base + width > end) mask &= full >> (base + width - end); \
+            while(mask){ \
+                out[n++] = base + (uint32_t)__builtin_ctz(mask); \
+                mask &= mask - 1; \
+            } \
+        } \
+        return n; \
+    } \
+    __attribute__((target(#isa))) static uint32_t count_newlines_##isa(const char* src, uint32_t begin, uint32_t end){ \
+        uint32_t n = 0; \
+        if(begin >= end) return 0; \
+        const char* block = (const char*)((uintptr_t)(src + begin) & ~(uintptr_t)(sizeof(vec) - 1)); \
+        uint32_t keep = (full << ((src + begin) - block)) & full; \
+        const vec nl = W##_set1_epi8('\n'); \
+        for(; block < src + end; block += sizeof(vec), keep = full){ \
+            uint32_t mask = (uint32_t)W##_movemask_epi8(W##_cmpeq_epi8(W##_load_si##bits((const vec*)block), nl)) & keep; \
+            uint32_t base = (uint32_t)(block - src), width = (uint32_t)sizeof(vec); \
+            if(base + width > end) mask &= full >> (base + width - end); \
+            n += (uint32_t)__builtin_popcount(mask); \
+        } \
+        return n; \
+    }
+
+#define LEXER_SIMD_KERNELS(isa, vec, W, bits, full) \
+    LEXER_SIMD_CLASSES(isa, vec, W, bits) \
+    LEXER_SIMD_SKIP(isa, vec, W, bits, full, blank) \
+    LEXER_SIMD_SKIP(isa, vec, W, bits, full, identifier) \
+    LEXER_SIMD_SKIP(isa, vec, W, bits, full, digit) \
+    LEXER_SIMD_SKIP(isa, vec, W, bits, full, line) \
+    LEXER_SIMD_SKIP(isa, vec, W, bits, full, text) \
+    LEXER_SIMD_SKIP(isa, vec, W, bits, full, string) \
+    LEXER_SIMD_SKIP(isa, vec, W, bits, full, char) \
+    LEXER_SIMD_COMMENT(isa, vec, W, bits, full) \
+    LEXER_SIMD_NEWLINES(isa, vec, W, bits, full)
+
+LEXER_SIMD_KERNELS(sse2, __m128i, _mm, 128, 0xFFFFu)
+LEXER_SIMD_KERNELS(avx2, __m256i, _mm256, 256, 0xFFFFFFFFu)
+
+// SSE2 has no byte shuffle: blocks of ASCII are skipped 16 bytes at a time
+// and the others decoded one sequence at a time.
+__attribute__((target("sse2"))) static uint32_t validate_utf8_sse2(const char* src, uint32_t len){
+    uint32_t index = 0;
+    while(index + 16 <= len){
+        if(!_mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(src + index)))){
+            index += 16;
+            continue;
+        }
+        for(uint32_t stop = index + 16; index < stop;){
+            uint32_t cp, n = len - index >= 4 ? utf8_decode(src + index, &cp) : 0;
+            if(n == 0) return validate_utf8_from(src, index, len);
+            index += n;
+        }
+    }
+    return validate_utf8_from(src, index, len);
+}
+
+// Checks 32 bytes at a time with three nibble lookups per byte pair, after
+// Keiser and Lemire, "Validating UTF-8 in less than one instruction per
+// byte". Every error class is one bit, a pair of bytes is wrong when the
+// bit is set in the lookup of the first byte's high nibble, its low nibble
+// and the second byte's high nibble. The 3rd and 4th bytes of a sequence
+// are found from the bytes 2 and 3 back instead.
+enum {
+    Utf8_too_short = 1 << 0,  // lead byte not followed by a continuation
+    Utf8_too_long = 1 << 1,   // continuation after an ASCII byte
+    Utf8_overlong_3 = 1 << 2,
+    Utf8_too_large = 1 << 3,
+    Utf8_surrogate = 1 << 4,
+    Utf8_overlong_2 = 1 << 5,
+    Utf8_too_large_1000 = 1 << 6,
+    Utf8_overlong_4 = 1 << 6,
+    Utf8_two_conts = 1 << 7,  // continuation after a continuation
+    Utf8_carry = Utf8_too_short | Utf8_too_long | Utf8_two_conts,
+};
+
+#define UTF8_LOOKUP_AVX2(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+    _mm256_setr_epi8(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p, a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p)
+
+// the 32 bytes ending `n` bytes before the block `input`, `prev` being the block before it
+#define UTF8_PREV_AVX2(input, prev, n) _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev, input, 0x21), 16 - (n))
+
+__attribute__((target("avx2"))) static inline __m256i utf8_errors_avx2(__m256i input, __m256i prev){
+    const __m256i first_high = UTF8_LOOKUP_AVX2(
+        Utf8_too_long, Utf8_too_long, Utf8_too_long, Utf8_too_long,
+        Utf8_too_long, Utf8_too_long, Utf8_too_long, Utf8_too_long,
+        Utf8_two_conts, Utf8_two_conts, Utf8_two_conts, Utf8_two_conts,
+        Utf8_too_short | Utf8_overlong_2,
+        Utf8_too_short,
+        Utf8_too_short | Utf8_overlong_3 | Utf8_surrogate,
+        Utf8_too_short | Utf8_too_large | Utf8_too_large_1000 | Utf8_overlong_4);
+    const __m256i first_low = UTF8_LOOKUP_AVX2(
+        Utf8_carry | Utf8_overlong_3 | Utf8_overlong_2 | Utf8_overlong_4,
+        Utf8_carry | Utf8_overlong_2,
+        Utf8_carry,
+        Utf8_carry,
+        Utf8_carry | Utf8_too_large,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000 | Utf8_surrogate,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000,
+        Utf8_carry | Utf8_too_large | Utf8_too_large_1000);
+    const __m256i second_high = UTF8_LOOKUP_AVX2(
+        Utf8_too_short, Utf8_too_short, Utf8_too_short, Utf8_too_short,
+        Utf8_too_short, Utf8_too_short, Utf8_too_short, Utf8_too_short,
+        Utf8_too_long | Utf8_overlong_2 | Utf8_two_conts | Utf8_overlong_3 | Utf8_too_large_1000 | Utf8_overlong_4,
+        Utf8_too_long | Utf8_overlong_2 | Utf8_two_conts | Utf8_overlong_3 | Utf8_too_large,
+        Utf8_too_long | Utf8_overlong_2 | Utf8_two_conts | Utf8_surrogate | Utf8_too_large,
+        Utf8_too_long | Utf8_overlong_2 | Utf8_two_conts | Utf8_surrogate | Utf8_too_large,
+        Utf8_too_short, Utf8_too_short, Utf8_too_short, Utf8_too_short);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = UTF8_PREV_AVX2(input, prev, 1);
+    __m256i errors = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(first_high, _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble)),
+                         _mm256_shuffle_epi8(first_low, _mm256_and_si256(prev1, nibble))),
+        _mm256_shuffle_epi8(second_high, _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble)));
+    // bytes 2 and 3 back a 3 or 4 byte lead: the byte must be the continuation flagged as two_conts
+    __m256i third = _mm256_subs_epu8(UTF8_PREV_AVX2(input, prev, 2), _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(UTF8_PREV_AVX2(input, prev, 3), _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_continue, errors);
+}
+
+__attribute__((target("avx2"))) static uint32_t validate_utf8_avx2(const char* src, uint32_t len){
+    // non-zero in the last 3 bytes of a block when they start a sequence the next block has to finish
+    const __m256i incomplete_above = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    __m256i prev = _mm256_setzero_si256(), incomplete = _mm256_setzero_si256();
+    uint32_t index = 0;
+    for(;; index += 32){
+        __m256i input, errors;
+        bool last = index + 32 > len;
+        if(last){
+            // the tail is checked from a zeroed copy, which also ends a sequence cut by `len`
+            char tail[32] = {0};
+            memcpy(tail, src + index, len - index);
+            input = _mm256_loadu_si256((const __m256i*)tail);
+        }else{
+            input = _mm256_loadu_si256((const __m256i*)(src + index));
+        }
+        if(!last && !_mm256_movemask_epi8(input)){
+            errors = incomplete;
+        }else{
+            errors = utf8_errors_avx2(input, prev);
+            incomplete = _mm256_subs_epu8(input, incomplete_above);
+        }
+        if(!_mm256_testz_si256(errors, errors)){
+            // the sequence at fault starts in this block or is the one the
+            // previous block ends in, everything before that one is valid
+            uint32_t from = index;
+            if(from > 0){
+                from -= 1;
+                while(from > 0 && index - from < 4 && ((uint8_t)src[from] & 0xC0) == 0x80) from -= 1;
+            }
+            return validate_utf8_from(src, from, len);
+        }
+        if(last) return len;
+        prev = input;
+    }
+}
+
+static const LexerKernels LexerKernelsSse2 = {
+    .name = "sse2",
+    .skip_blanks = skip_blank_sse2,
+    .skip_identifier = skip_identifier_sse2,
+    .skip_digits = skip_digit_sse2,
+    .skip_line = skip_line_sse2,
+    .skip_text = skip_text_sse2,
+    .skip_comment = skip_comment_sse2,
+    .skip_string = skip_string_sse2,
+    .skip_char = skip_char_sse2,
+    .find_newlines = find_newlines_sse2,
+    .count_newlines = count_newlines_sse2,
+    .validate_utf8 = validate_utf8_sse2,
+};
+
+static const LexerKernels LexerKernelsAvx2 = {
+    .name = "avx2",
+    .skip_blanks = skip_blank_avx2,
+    .skip_identifier = skip_identifier_avx2,
+    .skip_digits = skip_digit_avx2,
+    .skip_line = skip_line_avx2,
+    .skip_text = skip_text_avx2,
+    .skip_comment = skip_comment_avx2,
+    .skip_string = skip_string_avx2,
+    .skip_char = skip_char_avx2,
+    .find_newlines = find_newlines_avx2,
+    .count_newlines = count_newlines_avx2,
+    .validate_utf8 = validate_utf8_avx2,
+};
+
+#endif // C_LEXER_X86
+
+// returns NULL when the named kernel set is not supported by this cpu
+const LexerKernels* lexer_kernels_by_name(const char* name){
+    if(!strcmp(name, "scalar")) return &LexerKernelsScalar;
+#ifdef C_LEXER_X86
+    __builtin_cpu_init();
+    if(!strcmp(name, "sse2") && __builtin_cpu_supports("sse2")) return &LexerKernelsSse2;
+    if(!strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) return &LexerKernelsAvx2;
+#endif
+    return NULL;
+}
+
+// Any thread may get here first, e.g. through token_len_at, so the cache is
+// read and written atomically. Relaxed is enough: it only ever points at a
+// static table, and threads racing on the first call store the same one.
+const LexerKernels* lexer_kernels_detect(void){
+    static const LexerKernels* detected = NULL;
+    const LexerKernels* k = __atomic_load_n(&detected, __ATOMIC_RELAXED);
+    if(k) return k;
+#ifdef C_LEXER_X86
+    k = lexer_kernels_by_name("avx2");
+    if(!k) k = lexer_kernels_by_name("sse2");
+#endif
+    if(!k) k = &LexerKernelsScalar;
+    __atomic_store_n(&detected, k, __ATOMIC_RELAXED);
+    return k;
+}
+
 Lexer lexer_init_s(const char* source, uint32_t src_len){
     return (Lexer){
         .source = source,
         .src_len = src_len,
         .index = 0,
-        .line = 1,
+        .line = LEXER_FIRST_LINE,
+        .kernels = lexer_kernels_detect(),
     };
 }
 
@@ -267,6 +1066,929 @@ Lexer lexer_init(const char* source){
     return lexer_init_s(source, strlen(source));
 }
 
+// points the lexer at a new source, keeping its kernels and diagnostics storage
+void lexer_reset(Lexer* lex, const char* source, uint32_t src_len){
+    lex->source = source;
+    lex->src_len = src_len;
+    lex->index = 0;
+    lex->line = LEXER_FIRST_LINE;
+    lex->stream = NULL;
+    lex->line_index.source = NULL;
+    lex->utf8_end = 0;
+    lex->diag_len = 0;
+}
+
+// Validates the whole source as UTF-8 with the vector kernel and returns
+// the offset of its first invalid sequence, src_len when there is none.
+// Identifiers are lexed the same either way, but the code points before
+// that offset are decoded without checks. Not for stream lexers.
+uint32_t lexer_validate_utf8(Lexer* lex){
+    assert(!lex->stream && "a stream lexer has no whole source to validate");
+    lex->utf8_end = lex->kernels->validate_utf8(lex->source, lex->src_len);
+    return lex->utf8_end;
+}
+
+void lexer_stream_init(LexerStream* stream, LexerReadFn read, void* ctx, uint32_t window){
+    if(window == 0) window = LEXER_STREAM_WINDOW;
+    *stream = (LexerStream){ .read = read, .ctx = ctx, .cap = window };
+    stream->window = calloc((size_t)window + CFILE_PADDING, sizeof(char));
+    if(!stream->window){
+        fprintf(stderr, "[Lexing Error]: failed to allocate a %u byte stream window\n", window);
+        exit(1);
+    }
+}
+
+void lexer_stream_deinit(LexerStream* stream){
+    free(stream->window);
+    *stream = (LexerStream){0};
+}
+
+// The window starts empty, the first lexer_next_token call fills it.
+Lexer lexer_init_stream(LexerStream* stream){
+    Lexer lex = lexer_init_s(stream->window, 0);
+    lex.stream = stream;
+    return lex;
+}
+
+// stream offset of `loc`, valid until the next lexer_next_token call
+uint64_t lexer_stream_offset(const Lexer* lex, Location loc){
+    return (lex->stream ? lex->stream->base : 0) + loc.offset;
+}
+
+// LexerReadFn over a file descriptor, `fd` points to an int
+ssize_t lexer_read_fd(void* fd, char* buf, size_t cap){
+    ssize_t n;
+    do n = read(*(int*)fd, buf, cap); while(n < 0 && errno == EINTR);
+    return n;
+}
+
+// Called at the NUL that ends the window. Keeps the bytes from the start of
+// `partial` on, rebasing its offset and lex->index, and appends one read.
+// Returns false at the end of the stream, the window then still ends in NUL.
+static bool lexer_stream_refill(Lexer* lex, Token* partial){
+    LexerStream* s = lex->stream;
+    if(s->eof) return false;
+    uint32_t from = partial->loc.offset;
+    uint32_t keep = lex->src_len - from;
+    memmove(s->window, s->window + from, keep);
+    s->base += from;
+    lex->index -= from;
+    partial->loc.offset = 0;
+
+    if(keep > s->cap / 2){
+        uint32_t cap = s->cap * 2;
+        char* window = realloc(s->window, (size_t)cap + CFILE_PADDING);
+        if(!window){
+            fprintf(stderr, "[Lexing Error]: failed to grow the stream window to %u bytes\n", cap);
+            exit(1);
+        }
+        s->window = window;
+        s->cap = cap;
+    }
+
+    ssize_t n = s->read(s->ctx, s->window + keep, s->cap - keep);
+    if(n < 0) lexer_report(lex, Error_stream_read, (Location){ .offset = keep, .line = lex->line });
+    if(n <= 0){
+        n = 0;
+        s->eof = true;
+    }
+    lex->source = s->window;
+    lex->src_len = keep + (uint32_t)n;
+    memset(s->window + lex->src_len, 0, CFILE_PADDING);
+    return n > 0;
+}
+
+// True when the NUL at `pos` is only the end of the current stream window and
+// more input was read; the state then simply re-reads the same position.
+#define LEXER_REFILL_AT(pos) (lex->stream && (pos) >= lex->src_len && lexer_stream_refill(lex, &result))
+
+static inline uint64_t lexer_profile_clock(void){
+#ifdef C_LEXER_X86
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Profiling hooks of lexer_next_token. A step closes the state being left,
+// charging it the bytes and cycles since it was entered. Positions are
+// stream offsets so a window refill in between doesn't skew them.
+#ifdef C_LEXER_PROFILE
+#define LEXER_PROFILE_POS(lex) (((lex)->stream ? (lex)->stream->base : 0) + (lex)->index)
+#define LEXER_PROFILE_BEGIN(lex)                                           \
+    LexerProfile* prof = (lex)->profile;                                    \
+    uint64_t prof_start = prof ? lexer_profile_clock() : 0;                 \
+    uint64_t prof_clock = prof_start;                                       \
+    uint64_t prof_pos = LEXER_PROFILE_POS(lex);                             \
+    LexingState prof_state = Lexing_start
+#define LEXER_PROFILE_STEP(lex, next) do{ if(prof){                        \
+        uint64_t now = lexer_profile_clock(), pos = LEXER_PROFILE_POS(lex); \
+        prof->bytes[prof_state] += pos - prof_pos;                          \
+        prof->state_cycles[prof_state] += now - prof_clock;                 \
+        prof->transitions[next] += 1;                                       \
+        prof_state = (next);                                                \
+        prof_pos = pos;                                                     \
+        prof_clock = now;                                                   \
+    } }while(0)
+#define LEXER_PROFILE_END(lex, kind) do{ if(prof){                         \
+        uint64_t now = lexer_profile_clock();                               \
+        prof->bytes[prof_state] += LEXER_PROFILE_POS(lex) - prof_pos;       \
+        prof->state_cycles[prof_state] += now - prof_clock;                 \
+        prof->kinds[kind] += 1;                                             \
+        prof->calls += 1;                                                   \
+        prof->cycles += now - prof_start;                                   \
+    } }while(0)
+#else
+#define LEXER_PROFILE_BEGIN(lex) ((void)0)
+#define LEXER_PROFILE_STEP(lex, next) ((void)0)
+#define LEXER_PROFILE_END(lex, kind) ((void)0)
+#endif
+
+void lexer_deinit(Lexer* lex){
+    line_index_deinit(&lex->line_index);
+    if(!lex->arena) free(lex->diags);
+    lex->diags = NULL;
+    lex->diag_len = 0;
+    lex->diag_cap = 0;
+}
+
+void lexer_report(Lexer* lex, LexerError code, Location loc){
+    if(lex->diag_len == lex->diag_cap){
+        uint32_t old = lex->diag_cap;
+        lex->diag_cap = old ? old * 2 : 16;
+        if(lex->arena){
+            lex->diags = arena_realloc(lex->arena, lex->diags, old * sizeof(LexerDiagnostic), lex->diag_cap * sizeof(LexerDiagnostic));
+        }else{
+            lex->diags = realloc(lex->diags, lex->diag_cap * sizeof(LexerDiagnostic));
+        }
+        if(!lex->diags){
+            fprintf(stderr, "[Lexing Error]: failed to grow diagnostics to %u entries\n", lex->diag_cap);
+            exit(1);
+        }
+    }
+    lex->diags[lex->diag_len++] = (LexerDiagnostic){ .code = code, .loc = loc };
+}
+
+const char* lexer_error_to_str(LexerError code){
+    switch(code){
+        case Error_unhandled_char: return "unhandled char";
+        case Error_string_literal_no_end_quote: return "string literal misses `\"`, stuck at eof";
+        case Error_char_literal_no_end_quote: return "char literal misses `'`, stuck at eof";
+        case Error_file_open: return "failed to open file";
+        case Error_file_stat: return "failed to stat file";
+        case Error_file_map: return "failed to map file";
+        case Error_stream_read: return "failed to read the input stream";
+        case Error_number_literal_invalid: return "invalid number literal";
+        case Error_comment_no_end: return "comment misses `*/`, stuck at eof";
+        case Error_file_read: return "failed to read file";
+    }
+    return "Error: Unknown error code";
+}
+
+void lexer_print_diagnostics(const Lexer* lex, FILE* out, const char* file_name){
+    // without line counting the lines are looked up, a stream window can't be
+    LineIndex index = {0};
+    if(LEXER_FIRST_LINE == 0 && lex->diag_len && !lex->stream) line_index_build(&index, lex->source, lex->src_len);
+    for(uint32_t i = 0; i < lex->diag_len; i++){
+        const LexerDiagnostic* d = &lex->diags[i];
+        uint32_t line = index.source ? line_index_lookup(&index, d->loc.offset).line : d->loc.line;
+        fprintf(out, "[Lexing Error]: %s:%u: %s", file_name, line, lexer_error_to_str(d->code));
+        // a stream has moved its window on since the report
+        if(d->code == Error_unhandled_char && !lex->stream) fprintf(out, " `%.*s`", (int)d->loc.len, lex->source + d->loc.offset);
+        if(d->code == Error_number_literal_invalid && !lex->stream) fprintf(out, " `%.*s`", (int)d->loc.len, lex->source + d->loc.offset);
+        fprintf(out, "\n");
+    }
+    line_index_deinit(&index);
+}
+
+// Reuses the storage of a previous build. Newlines are collected a block at
+// a time so the array only has to have room for one more block.
+void line_index_build(LineIndex* index, const char* source, uint32_t src_len){
+    enum { block = 1 << 16 };
+    const LexerKernels* k = lexer_kernels_detect();
+    index->source = source;
+    index->src_len = src_len;
+    index->len = 0;
+    for(uint32_t begin = 0; begin < src_len; begin += block){
+        uint32_t end = src_len - begin > block ? begin + block : src_len;
+        if(index->len + (end - begin) > index->cap){
+            uint32_t cap = index->cap ? index->cap : block;
+            while(cap < index->len + (end - begin)) cap *= 2;
+            index->newlines = realloc(index->newlines, cap * sizeof(uint32_t));
+            if(!index->newlines){
+                fprintf(stderr, "[Lexing Error]: failed to grow the line index to %u lines\n", cap);
+                exit(1);
+            }
+            index->cap = cap;
+        }
+        index->len += k->find_newlines(source, begin, end, &index->newlines[index->len]);
+    }
+}
+
+void line_index_deinit(LineIndex* index){
+    free(index->newlines);
+    *index = (LineIndex){0};
+}
+
+LineColumn line_index_lookup(const LineIndex* index, uint32_t offset){
+    // the line is one more than the number of newlines before `offset`
+    uint32_t lo = 0, hi = index->len;
+    while(lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        if(index->newlines[mid] < offset) lo = mid + 1;
+        else hi = mid;
+    }
+    uint32_t start = lo ? index->newlines[lo - 1] + 1 : 0;
+    return (LineColumn){ .line = lo + 1, .column = offset - start + 1 };
+}
+
+// Returns `line` (1-based) of the source without its '\n', or NULL past the
+// last line.
+const char* line_index_line(const LineIndex* index, uint32_t line, uint32_t* len){
+    if(line == 0 || line > index->len + 1) return NULL;
+    uint32_t start = line > 1 ? index->newlines[line - 2] + 1 : 0;
+    uint32_t end = line <= index->len ? index->newlines[line - 1] : index->src_len;
+    *len = end - start;
+    return index->source + start;
+}
+
+static const LineIndex* lexer_line_index(Lexer* lex){
+    if(lex->stream || lex->line_index.source != lex->source) line_index_build(&lex->line_index, lex->source, lex->src_len);
+    return &lex->line_index;
+}
+
+// Builds the lexer's line index on first use. A stream lexer only indexes
+// its current window.
+LineColumn lexer_line_column(Lexer* lex, uint32_t offset){
+    return line_index_lookup(lexer_line_index(lex), offset);
+}
+
+const char* lexer_get_line(Lexer* lex, const Token* token, uint32_t* len){
+    if(lex->stream) return token_get_line(lex->source, token, len);
+    const LineIndex* index = lexer_line_index(lex);
+    return line_index_line(index, line_index_lookup(index, token->loc.offset).line, len);
+}
+
+// The line holding `token`, found by scanning around it: no index, for a
+// single lookup.
+const char* token_get_line(const char* source, const Token* token, uint32_t* len){
+    uint32_t start = token->loc.offset;
+    while(start > 0 && source[start - 1] != '\n') start -= 1;
+    uint32_t end = lexer_kernels_detect()->skip_line(source, token->loc.offset);
+    *len = end - start;
+    return source + start;
+}
+
+TokenKind keyword_lookup(const char* ident, uint32_t len){
+    if(len < KEYWORD_MIN_LEN || len > KEYWORD_MAX_LEN) return Tok_identifier;
+    const KeywordEntry* e = &KeywordsTable[KEYWORD_SLOT(len, ident[0], ident[len - 1], KEYWORDS_HASH_MUL, KEYWORDS_HASH_BITS)];
+    if(e->len == len && !memcmp(ident, e->name, len)) return e->kind;
+    return Tok_identifier;
+}
+
+TokenKind builtin_lookup(const char* name, uint32_t len){
+    if(len < BUILTIN_MIN_LEN || len > BUILTIN_MAX_LEN) return Tok_hash;
+    const KeywordEntry* e = &BuiltinsTable[KEYWORD_SLOT(len, name[0], name[len - 1], BUILTINS_HASH_MUL, BUILTINS_HASH_BITS)];
+    if(e->len == len && !memcmp(name, e->name, len)) return e->kind;
+    return Tok_hash;
+}
+
+// A multiply-xorshift over 8 byte words, identifiers are short
+static uint32_t interner_hash(const char* name, uint32_t len){
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+    while(len >= 8){
+        uint64_t w;
+        memcpy(&w, name, 8);
+        h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+        h ^= h >> 31;
+        name += 8;
+        len -= 8;
+    }
+    uint64_t w = 0;
+    for(uint32_t i = 0; i < len; i++) w |= (uint64_t)(uint8_t)name[i] << (i * 8);
+    h = (h ^ w) * 0x94d049bb133111ebull;
+    h ^= h >> 29;
+    return (uint32_t)h | 1; // never 0, an empty slot
+}
+
+static void interner_grow_slots(Interner* in, uint32_t count){
+    free(in->slots);
+    in->slots = calloc(count, sizeof(uint64_t));
+    if(!in->slots){
+        fprintf(stderr, "[Lexing Error]: failed to allocate %u interner slots\n", count);
+        exit(1);
+    }
+    in->slot_mask = count - 1;
+}
+
+void interner_init(Interner* in, uint32_t size_hint){
+    *in = (Interner){0};
+    arena_init(&in->strings, INTERNER_CHUNK, 0);
+    uint32_t slots = 1024;
+    while(slots / 2 < size_hint) slots *= 2;
+    interner_grow_slots(in, slots);
+    interner_intern(in, "", 0);
+}
+
+void interner_deinit(Interner* in){
+    arena_deinit(&in->strings);
+    free(in->slots);
+    free(in->names);
+    *in = (Interner){0};
+}
+
+// Returns the slot holding `name`, or the empty slot it would go to.
+static uint64_t* interner_probe(const Interner* in, const char* name, uint32_t len, uint32_t hash){
+    for(uint32_t i = hash & in->slot_mask;; i = (i + 1) & in->slot_mask){
+        uint64_t slot = in->slots[i];
+        if(slot == 0) return &in->slots[i];
+        if((uint32_t)(slot >> 32) != hash) continue;
+        StrView v = in->names[(uint32_t)slot];
+        if(v.len == len && !memcmp(v.ptr, name, len)) return &in->slots[i];
+    }
+}
+
+uint32_t interner_intern(Interner* in, const char* name, uint32_t len){
+    uint32_t hash = interner_hash(name, len);
+    uint64_t* slot = interner_probe(in, name, len, hash);
+    if(*slot) return (uint32_t)*slot;
+
+    if(in->len == in->cap){
+        in->cap = in->cap ? in->cap * 2 : 1024;
+        in->names = realloc(in->names, in->cap * sizeof(StrView));
+        if(!in->names){
+            fprintf(stderr, "[Lexing Error]: failed to grow the interner to %u names\n", in->cap);
+            exit(1);
+        }
+    }
+    uint32_t id = in->len++;
+    in->names[id] = (StrView){ .ptr = arena_strndup(&in->strings, name, len), .len = len };
+    *slot = (uint64_t)hash << 32 | id;
+
+    // at most half full, re-insert from the hashes kept in the slots
+    if(in->len * 2 > in->slot_mask + 1){
+        uint64_t* old = in->slots;
+        uint32_t count = in->slot_mask + 1;
+        in->slots = NULL;
+        interner_grow_slots(in, count * 2);
+        for(uint32_t i = 0; i < count; i++){
+            if(!old[i]) continue;
+            uint32_t j = (uint32_t)(old[i] >> 32) & in->slot_mask;
+            while(in->slots[j]) j = (j + 1) & in->slot_mask;
+            in->slots[j] = old[i];
+        }
+        free(old);
+    }
+    return id;
+}
+
+// 0 when `name` was never interned
+uint32_t interner_find(const Interner* in, const char* name, uint32_t len){
+    return (uint32_t)*interner_probe(in, name, len, interner_hash(name, len));
+}
+
+StrView interner_get(const Interner* in, uint32_t symbol){
+    return in->names[symbol];
+}
+
+// Interns every name of `from` into `into`. With `remap` (from->len entries)
+// remap[id in from] receives the id in `into`, for token_buffer_remap_symbols.
+void interner_merge(Interner* into, const Interner* from, uint32_t* remap){
+    for(uint32_t id = 0; id < from->len; id++){
+        uint32_t to = interner_intern(into, from->names[id].ptr, from->names[id].len);
+        if(remap) remap[id] = to;
+    }
+}
+
+// Number literals are lexed as preprocessing numbers (digits, letters, `_`,
+// `.`, a sign after an exponent letter and `'` between digits) and the run
+// is then checked against the C grammar and decoded in one more pass.
+
+// Eight decimal digits are checked and converted at once, as eight bytes of
+// one 64 bit word; the same trick as in the fast_float and simdjson parsers.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define NUMBER_SWAR 1
+#endif
+
+#ifdef NUMBER_SWAR
+static inline bool number_eight_digits(const char* p){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return ((v & 0xF0F0F0F0F0F0F0F0ull) | (((v + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+}
+
+static inline uint32_t number_parse_eight(const char* p){
+    uint64_t v;
+    memcpy(&v, p, 8);
+    v = (v & 0x0F0F0F0F0F0F0F0Full) * 2561 >> 8;
+    v = (v & 0x00FF00FF00FF00FFull) * 6553601 >> 16;
+    return (uint32_t)((v & 0x0000FFFF0000FFFFull) * 42949672960001ull >> 32);
+}
+#endif
+
+// the value of a digit in bases up to 36, anything else is above 35
+static const uint8_t NumberDigitTable[256] = {
+    ['0'] = 1, 2, 3, 4, 5, 6, 7, 8, 9, 10,
+    ['a'] = 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,
+    ['A'] = 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36,
+};
+
+// the table holds value + 1, so anything else wraps around to UINT32_MAX
+static inline uint32_t number_digit(char c){
+    return (uint32_t)NumberDigitTable[(uint8_t)c] - 1;
+}
+
+// End of a run of `base` digits, a `'` only counting between two of them.
+static const char* number_digits(const char* p, const char* end, uint32_t base){
+    const char* begin = p;
+    for(;;){
+        while(p < end && number_digit(*p) < base) p += 1;
+        if(p + 1 < end && *p == '\'' && p > begin && number_digit(p[1]) < base){
+            p += 2;
+            continue;
+        }
+        return p;
+    }
+}
+
+static uint64_t number_integer(const char* p, const char* end, uint32_t base, uint16_t* flags){
+    uint64_t v = 0;
+    bool overflow = false;
+    while(p < end){
+#ifdef NUMBER_SWAR
+        if(base == 10 && end - p >= 8 && number_eight_digits(p)){
+            uint64_t scaled;
+            overflow |= __builtin_mul_overflow(v, 100000000ull, &scaled);
+            overflow |= __builtin_add_overflow(scaled, (uint64_t)number_parse_eight(p), &v);
+            p += 8;
+            continue;
+        }
+#endif
+        if(*p != '\''){
+            overflow |= __builtin_mul_overflow(v, (uint64_t)base, &v);
+            overflow |= __builtin_add_overflow(v, (uint64_t)number_digit(*p), &v);
+        }
+        p += 1;
+    }
+    if(overflow){
+        *flags |= Number_overflow;
+        return UINT64_MAX;
+    }
+    return v;
+}
+
+static const double NumberPowersOf10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+// strtod on the literal without its digit separators, for what the exact
+// paths below can't take. Assumes the "C" locale, as the compiler would.
+static double number_strtod(const char* p, const char* end, uint16_t* flags){
+    char small[128];
+    size_t len = (size_t)(end - p);
+    char* buf = len < sizeof(small) ? small : (char*)malloc(len + 1);
+    if(!buf){
+        fprintf(stderr, "[Lexing Error]: failed to allocate %zu bytes for a float literal\n", len + 1);
+        exit(1);
+    }
+    size_t n = 0;
+    for(; p < end; p++) if(*p != '\'') buf[n++] = *p;
+    buf[n] = '\0';
+    double v = strtod(buf, NULL);
+    if(__builtin_isinf(v)) *flags |= Number_overflow;
+    if(buf != small) free(buf);
+    return v;
+}
+
+// Decimal floats with at most 19 significant digits and a power of ten
+// up to 22 are exact in doubles and take one multiplication or division
+// (Clinger's fast path); the others go through strtod.
+static double number_decimal_float(const char* int_begin, const char* int_end, const char* frac_begin, const char* frac_end,
+                                   int64_t exponent, const char* end, uint16_t* flags){
+    uint64_t m = 0;
+    uint32_t digits = 0;
+    bool truncated = false;
+    for(const char* p = int_begin; p < int_end; p++){
+        if(*p == '\'' || (m == 0 && *p == '0')) continue;
+        if(digits < 19){
+            m = m * 10 + (uint64_t)(*p - '0');
+            digits += 1;
+        }else{
+            exponent += 1;
+            truncated |= *p != '0';
+        }
+    }
+    for(const char* p = frac_begin; p < frac_end; p++){
+        if(*p == '\'') continue;
+        if(m == 0 && *p == '0'){
+            exponent -= 1;
+        }else if(digits < 19){
+            m = m * 10 + (uint64_t)(*p - '0');
+            digits += 1;
+            exponent -= 1;
+        }else{
+            truncated |= *p != '0';
+        }
+    }
+    if(m == 0) return 0.0;
+    if(!truncated && m <= (1ull << 53) && exponent >= -22 && exponent <= 22){
+        return exponent < 0 ? (double)m / NumberPowersOf10[-exponent] : (double)m * NumberPowersOf10[exponent];
+    }
+    return number_strtod(int_begin, end, flags);
+}
+
+// The suffix of a literal, after its digits and exponent. GNU imaginary
+// suffixes may come first or last.
+static bool number_suffix(const char* p, const char* end, uint16_t* flags){
+    if(p < end && ((*p | 0x20) == 'i' || (*p | 0x20) == 'j')){
+        *flags |= Number_imaginary;
+        p += 1;
+    }else if(p < end && ((end[-1] | 0x20) == 'i' || (end[-1] | 0x20) == 'j')){
+        *flags |= Number_imaginary;
+        end -= 1;
+    }
+    size_t n = (size_t)(end - p);
+    if(*flags & Number_float){
+        if(n == 0) return true;
+        if(n == 1 && (*p | 0x20) == 'f'){
+            *flags |= Number_single;
+            return true;
+        }
+        if(n == 1 && (*p | 0x20) == 'l'){
+            *flags |= Number_long;
+            return true;
+        }
+        if(n == 2 && (p[0] == 'd' || p[0] == 'D') && (p[1] == p[0] + 'f' - 'd' || p[1] == p[0] || p[1] == p[0] + 'l' - 'd')){
+            *flags |= Number_decimal;
+            return true;
+        }
+        if(n >= 3 && (*p | 0x20) == 'f'){
+            static const char* const widths[] = { "16", "32", "64", "128", "32x", "64x", "32X", "64X" };
+            for(uint32_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++){
+                if(strlen(widths[i]) == n - 1 && !memcmp(p + 1, widths[i], n - 1)){
+                    *flags |= Number_interchange;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+    if(p < end && (*p | 0x20) == 'u'){
+        *flags |= Number_unsigned;
+        p += 1;
+    }
+    if(p < end && (*p == 'l' || *p == 'L')){
+        bool twice = p + 1 < end && p[1] == p[0];
+        *flags |= twice ? Number_long_long : Number_long;
+        p += twice ? 2 : 1;
+    }else if(p + 1 < end && ((p[0] == 'w' && p[1] == 'b') || (p[0] == 'W' && p[1] == 'B'))){
+        *flags |= Number_bit_precise;
+        p += 2;
+    }
+    if(!(*flags & Number_unsigned) && p < end && (*p | 0x20) == 'u'){
+        *flags |= Number_unsigned;
+        p += 1;
+    }
+    return p == end;
+}
+
+// Checks that `text` is a C integer or floating literal and decodes it:
+// integers into value->u, saturated with Number_overflow past UINT64_MAX,
+// floats into value->f. With a NULL `value` the literal is only checked.
+// Returns false for a malformed literal, `flags` is then meaningless.
+bool number_literal_decode(const char* text, uint32_t len, NumberValue* value, uint16_t* flags){
+    const char* p = text;
+    const char* end = text + len;
+    uint32_t base = 10;
+    *flags = 0;
+    if(len >= 2 && p[0] == '0' && ((p[1] | 0x20) == 'x' || (p[1] | 0x20) == 'b')){
+        base = (p[1] | 0x20) == 'x' ? 16 : 2;
+        *flags |= Number_based;
+        p += 2;
+    }else if(p[0] == '0'){
+        base = 8; // or the leading zero of a decimal float, 09.5
+    }
+    uint32_t digit_base = base == 8 ? 10 : base;
+    const char* int_begin = p;
+    const char* int_end = p = number_digits(p, end, digit_base);
+    const char* frac_begin = p;
+    const char* frac_end = p;
+    if(p < end && *p == '.' && base != 2){
+        *flags |= Number_float;
+        frac_begin = p + 1;
+        frac_end = p = number_digits(frac_begin, end, digit_base);
+    }
+    if(int_end == int_begin && frac_end == frac_begin) return false;
+
+    int64_t exponent = 0;
+    if(p < end && (*p | 0x20) == (base == 16 ? 'p' : 'e') && base != 2){
+        *flags |= Number_float;
+        p += 1;
+        bool negative = p < end && *p == '-';
+        if(p < end && (*p == '+' || *p == '-')) p += 1;
+        const char* digits = p;
+        p = number_digits(p, end, 10);
+        if(p == digits) return false;
+        for(const char* d = digits; d < p; d++){
+            if(*d != '\'' && exponent < 100000) exponent = exponent * 10 + (*d - '0');
+        }
+        if(negative) exponent = -exponent;
+    }else if(base == 16 && (*flags & Number_float)){
+        return false; // a hex float needs its exponent
+    }
+    const char* literal_end = p;
+    if(!number_suffix(p, end, flags)) return false;
+
+    if(!(*flags & Number_float)){
+        if(base == 8){
+            for(const char* d = int_begin; d < int_end; d++) if(*d == '8' || *d == '9') return false;
+            if(int_end - int_begin > 1) *flags |= Number_based;
+        }
+        if(value) value->u = number_integer(int_begin, int_end, base, flags);
+        return true;
+    }
+    if(value){
+        value->f = base == 16 ? number_strtod(text, literal_end, flags)
+                              : number_decimal_float(int_begin, int_end, frac_begin, frac_end, exponent, literal_end, flags);
+    }
+    return true;
+}
+
+uint32_t number_table_push(NumberTable* t, NumberValue value, uint16_t flags){
+    if(t->len == t->cap){
+        t->cap = t->cap ? t->cap * 2 : 256;
+        t->values = (NumberValue*)realloc(t->values, t->cap * sizeof(NumberValue));
+        t->flags = (uint16_t*)realloc(t->flags, t->cap * sizeof(uint16_t));
+        if(!t->values || !t->flags){
+            fprintf(stderr, "[Lexing Error]: failed to grow the number table to %u entries\n", t->cap);
+            exit(1);
+        }
+    }
+    t->values[t->len] = value;
+    t->flags[t->len] = flags;
+    return t->len++;
+}
+
+void number_table_deinit(NumberTable* t){
+    free(t->values);
+    free(t->flags);
+    *t = (NumberTable){0};
+}
+
+// Takes the preprocessing number whose first digit is at lex->index, its
+// token starting at result->loc.offset (on the `.` of `.5`), then checks it
+// as a whole: one bad digit or suffix makes all of it a Tok_error, as it
+// would for a compiler.
+static void lexer_number(Lexer* lex, Token* result){
+    for(;;){
+        uint32_t i = lex->kernels->skip_identifier(lex->source, lex->index);
+        // the byte after a `'` may not have been read yet
+        if(lex->stream && i + 1 >= lex->src_len && (lex->source[i] == '\0' || lex->source[i] == '\'')){
+            lex->index = i;
+            if(lexer_stream_refill(lex, result)) continue;
+            i = lex->index;
+        }
+        const char* src = lex->source;
+        char c = src[i];
+        if(c == '.' || ((c == '+' || c == '-') && ((src[i - 1] | 0x20) == 'e' || (src[i - 1] | 0x20) == 'p'))){
+            lex->index = i + 1;
+            continue;
+        }
+        if(c == '\'' && number_digit(src[i + 1]) < 36){
+            lex->index = i + 2;
+            continue;
+        }
+        lex->index = i;
+        break;
+    }
+    uint32_t len = lex->index - result->loc.offset;
+    NumberValue value;
+    uint16_t flags;
+    if(!number_literal_decode(lex->source + result->loc.offset, len, lex->numbers ? &value : NULL, &flags)){
+        result->kind = Tok_error;
+        result->loc.len = len;
+        lexer_report(lex, Error_number_literal_invalid, result->loc);
+        return;
+    }
+    result->kind = (flags & Number_float) ? Tok_float_literal : Tok_number_literal;
+    if(lex->numbers) result->symbol = number_table_push(lex->numbers, value, flags);
+}
+
+// The non-ASCII code points of identifiers (C23 Annex D): XID_Continue in
+// sorted runs of `first << 12 | (count - 1) << 1 | xid_start`, runs longer
+// than 2048 split. Unicode 14.0, made with Python's str.isidentifier().
+static const uint32_t UnicodeXidTable[] = {
+    0x000aa001, 0x000b5001, 0x000b7000, 0x000ba001, 0x000c002d, 0x000d803d, 0x000f8393, 0x002c6017,
+    0x002e0009, 0x002ec001, 0x002ee001, 0x003000de, 0x00370009, 0x00376003, 0x0037b005, 0x0037f001,
+    0x00386001, 0x00387000, 0x00388005, 0x0038c001, 0x0038e027, 0x003a30a5, 0x003f7115, 0x00483008,
+    0x0048a14b, 0x0053104b, 0x00559001, 0x00560051, 0x00591058, 0x005bf000, 0x005c1002, 0x005c4002,
+    0x005c7000, 0x005d0035, 0x005ef007, 0x00610014, 0x00620055, 0x0064b03c, 0x0066e003, 0x00670000,
+    0x006710c5, 0x006d5001, 0x006d600c, 0x006df00a, 0x006e5003, 0x006e7002, 0x006ea006, 0x006ee003,
+    0x006f0012, 0x006fa005, 0x006ff001, 0x00710001, 0x00711000, 0x0071203b, 0x00730034, 0x0074d0b1,
+    0x007a6014, 0x007b1001, 0x007c0012, 0x007ca041, 0x007eb010, 0x007f4003, 0x007fa001, 0x007fd000,
+    0x0080002b, 0x00816006, 0x0081a001, 0x0081b010, 0x00824001, 0x00825004, 0x00828001, 0x00829008,
+    0x00840031, 0x00859004, 0x00860015, 0x0087002f, 0x0088900b, 0x0089800e, 0x008a0053, 0x008ca02e,
+    0x008e3040, 0x0090406b, 0x0093a004, 0x0093d001, 0x0093e022, 0x00950001, 0x0095100c, 0x00958013,
+    0x00962002, 0x00966012, 0x0097101f, 0x00981004, 0x0098500f, 0x0098f003, 0x0099302b, 0x009aa00d,
+    0x009b2001, 0x009b6007, 0x009bc000, 0x009bd001, 0x009be00c, 0x009c7002, 0x009cb004, 0x009ce001,
+    0x009d7000, 0x009dc003, 0x009df005, 0x009e2002, 0x009e6012, 0x009f0003, 0x009fc001, 0x009fe000,
+    0x00a01004, 0x00a0500b, 0x00a0f003, 0x00a1302b, 0x00a2a00d, 0x00a32003, 0x00a35003, 0x00a38003,
+    0x00a3c000, 0x00a3e008, 0x00a47002, 0x00a4b004, 0x00a51000, 0x00a59007, 0x00a5e001, 0x00a66016,
+    0x00a72005, 0x00a75000, 0x00a81004, 0x00a85011, 0x00a8f005, 0x00a9302b, 0x00aaa00d, 0x00ab2003,
+    0x00ab5009, 0x00abc000, 0x00abd001, 0x00abe00e, 0x00ac7004, 0x00acb004, 0x00ad0001, 0x00ae0003,
+    0x00ae2002, 0x00ae6012, 0x00af9001, 0x00afa00a, 0x00b01004, 0x00b0500f, 0x00b0f003, 0x00b1302b,
+    0x00b2a00d, 0x00b32003, 0x00b35009, 0x00b3c000, 0x00b3d001, 0x00b3e00c, 0x00b47002, 0x00b4b004,
+    0x00b55004, 0x00b5c003, 0x00b5f005, 0x00b62002, 0x00b66012, 0x00b71001, 0x00b82000, 0x00b83001,
+    0x00b8500b, 0x00b8e005, 0x00b92007, 0x00b99003, 0x00b9c001, 0x00b9e003, 0x00ba3003, 0x00ba8005,
+    0x00bae017, 0x00bbe008, 0x00bc6004, 0x00bca006, 0x00bd0001, 0x00bd7000, 0x00be6012, 0x00c00008,
+    0x00c0500f, 0x00c0e005, 0x00c1202d, 0x00c2a01f, 0x00c3c000, 0x00c3d001, 0x00c3e00c, 0x00c46004,
+    0x00c4a006, 0x00c55002, 0x00c58005, 0x00c5d001, 0x00c60003, 0x00c62002, 0x00c66012, 0x00c80001,
+    0x00c81004, 0x00c8500f, 0x00c8e005, 0x00c9202d, 0x00caa013, 0x00cb5009, 0x00cbc000, 0x00cbd001,
+    0x00cbe00c, 0x00cc6004, 0x00cca006, 0x00cd5002, 0x00cdd003, 0x00ce0003, 0x00ce2002, 0x00ce6012,
+    0x00cf1003, 0x00d00006, 0x00d04011, 0x00d0e005, 0x00d12051, 0x00d3b002, 0x00d3d001, 0x00d3e00c,
+    0x00d46004, 0x00d4a006, 0x00d4e001, 0x00d54005, 0x00d57000, 0x00d5f005, 0x00d62002, 0x00d66012,
+    0x00d7a00b, 0x00d81004, 0x00d85023, 0x00d9a02f, 0x00db3011, 0x00dbd001, 0x00dc000d, 0x00dca000,
+    0x00dcf00a, 0x00dd6000, 0x00dd800e, 0x00de6012, 0x00df2002, 0x00e0105f, 0x00e31000, 0x00e32001,
+    0x00e3300e, 0x00e4000d, 0x00e4700e, 0x00e50012, 0x00e81003, 0x00e84001, 0x00e86009, 0x00e8c02f,
+    0x00ea5001, 0x00ea7013, 0x00eb1000, 0x00eb2001, 0x00eb3012, 0x00ebd001, 0x00ec0009, 0x00ec6001,
+    0x00ec800a, 0x00ed0012, 0x00edc007, 0x00f00001, 0x00f18002, 0x00f20012, 0x00f35000, 0x00f37000,
+    0x00f39000, 0x00f3e002, 0x00f4000f, 0x00f49047, 0x00f71026, 0x00f86002, 0x00f88009, 0x00f8d014,
+    0x00f99046, 0x00fc6000, 0x01000055, 0x0102b026, 0x0103f001, 0x01040012, 0x0105000b, 0x01056006,
+    0x0105a007, 0x0105e004, 0x01061001, 0x01062004, 0x01065003, 0x0106700c, 0x0106e005, 0x01071006,
+    0x01075019, 0x01082016, 0x0108e001, 0x0108f01c, 0x010a004b, 0x010c7001, 0x010cd001, 0x010d0055,
+    0x010fc299, 0x0124a007, 0x0125000d, 0x01258001, 0x0125a007, 0x01260051, 0x0128a007, 0x01290041,
+    0x012b2007, 0x012b800d, 0x012c0001, 0x012c2007, 0x012c801d, 0x012d8071, 0x01312007, 0x01318085,
+    0x0135d004, 0x01369010, 0x0138001f, 0x013a00ab, 0x013f800b, 0x014014d7, 0x0166f021, 0x01681033,
+    0x016a0095, 0x016ee015, 0x01700023, 0x01712006, 0x0171f025, 0x01732004, 0x01740023, 0x01752002,
+    0x01760019, 0x0176e005, 0x01772002, 0x01780067, 0x017b403e, 0x017d7001, 0x017dc001, 0x017dd000,
+    0x017e0012, 0x0180b004, 0x0180f014, 0x018200b1, 0x01880051, 0x018a9000, 0x018aa001, 0x018b008b,
+    0x0190003d, 0x01920016, 0x01930016, 0x01946012, 0x0195003b, 0x01970009, 0x01980057, 0x019b0033,
+    0x019d0014, 0x01a0002d, 0x01a17008, 0x01a20069, 0x01a55012, 0x01a60038, 0x01a7f014, 0x01a90012,
+    0x01aa7001, 0x01ab001a, 0x01abf01e, 0x01b00008, 0x01b0505d, 0x01b34020, 0x01b4500f, 0x01b50012,
+    0x01b6b010, 0x01b80004, 0x01b8303b, 0x01ba1018, 0x01bae003, 0x01bb0012, 0x01bba057, 0x01be601a,
+    0x01c00047, 0x01c24026, 0x01c40012, 0x01c4d005, 0x01c50012, 0x01c5a047, 0x01c80011, 0x01c90055,
+    0x01cbd005, 0x01cd0004, 0x01cd4028, 0x01ce9007, 0x01ced000, 0x01cee00b, 0x01cf4000, 0x01cf5003,
+    0x01cf7004, 0x01cfa001, 0x01d0017f, 0x01dc007e, 0x01e0022b, 0x01f1800b, 0x01f2004b, 0x01f4800b,
+    0x01f5000f, 0x01f59001, 0x01f5b001, 0x01f5d001, 0x01f5f03d, 0x01f80069, 0x01fb600d, 0x01fbe001,
+    0x01fc2005, 0x01fc600d, 0x01fd0007, 0x01fd600b, 0x01fe0019, 0x01ff2005, 0x01ff600d, 0x0203f002,
+    0x02054000, 0x02071001, 0x0207f001, 0x02090019, 0x020d0018, 0x020e1000, 0x020e5016, 0x02102001,
+    0x02107001, 0x0210a013, 0x02115001, 0x0211800b, 0x02124001, 0x02126001, 0x02128001, 0x0212a01f,
+    0x0213c007, 0x02145009, 0x0214e001, 0x02160051, 0x02c001c9, 0x02ceb007, 0x02cef004, 0x02cf2003,
+    0x02d0004b, 0x02d27001, 0x02d2d001, 0x02d3006f, 0x02d6f001, 0x02d7f000, 0x02d8002d, 0x02da000d,
+    0x02da800d, 0x02db000d, 0x02db800d, 0x02dc000d, 0x02dc800d, 0x02dd000d, 0x02dd800d, 0x02de003e,
+    0x03005005, 0x03021011, 0x0302a00a, 0x03031009, 0x03038009, 0x030410ab, 0x03099002, 0x0309d005,
+    0x030a10b3, 0x030fc007, 0x03105055, 0x031310bb, 0x031a003f, 0x031f001f, 0x03400fff, 0x03c00fff,
+    0x04400fff, 0x04c0037f, 0x04e00fff, 0x05600fff, 0x05e00fff, 0x06600fff, 0x06e00fff, 0x07600fff,
+    0x07e00fff, 0x08600fff, 0x08e00fff, 0x09600fff, 0x09e00d19, 0x0a4d005b, 0x0a500219, 0x0a61001f,
+    0x0a620012, 0x0a62a003, 0x0a64005d, 0x0a66f000, 0x0a674012, 0x0a67f03d, 0x0a69e002, 0x0a6a009f,
+    0x0a6f0002, 0x0a717011, 0x0a7220cd, 0x0a78b07f, 0x0a7d0003, 0x0a7d3001, 0x0a7d5009, 0x0a7f201f,
+    0x0a802000, 0x0a803005, 0x0a806000, 0x0a807007, 0x0a80b000, 0x0a80c02d, 0x0a823008, 0x0a82c000,
+    0x0a840067, 0x0a880002, 0x0a882063, 0x0a8b4022, 0x0a8d0012, 0x0a8e0022, 0x0a8f200b, 0x0a8fb001,
+    0x0a8fd003, 0x0a8ff014, 0x0a90a037, 0x0a92600e, 0x0a93002d, 0x0a947018, 0x0a960039, 0x0a980006,
+    0x0a98405d, 0x0a9b301a, 0x0a9cf001, 0x0a9d0012, 0x0a9e0009, 0x0a9e5000, 0x0a9e6013, 0x0a9f0012,
+    0x0a9fa009, 0x0aa00051, 0x0aa2901a, 0x0aa40005, 0x0aa43000, 0x0aa4400f, 0x0aa4c002, 0x0aa50012,
+    0x0aa6002d, 0x0aa7a001, 0x0aa7b004, 0x0aa7e063, 0x0aab0000, 0x0aab1001, 0x0aab2004, 0x0aab5003,
+    0x0aab7002, 0x0aab9009, 0x0aabe002, 0x0aac0001, 0x0aac1000, 0x0aac2001, 0x0aadb005, 0x0aae0015,
+    0x0aaeb008, 0x0aaf2005, 0x0aaf5002, 0x0ab0100b, 0x0ab0900b, 0x0ab1100b, 0x0ab2000d, 0x0ab2800d,
+    0x0ab30055, 0x0ab5c01b, 0x0ab700e5, 0x0abe300e, 0x0abec002, 0x0abf0012, 0x0ac00fff, 0x0b400fff,
+    0x0bc00fff, 0x0c400fff, 0x0cc00fff, 0x0d400747, 0x0d7b002d, 0x0d7cb061, 0x0f9002db, 0x0fa700d3,
+    0x0fb0000d, 0x0fb13009, 0x0fb1d001, 0x0fb1e000, 0x0fb1f013, 0x0fb2a019, 0x0fb38009, 0x0fb3e001,
+    0x0fb40003, 0x0fb43003, 0x0fb460d7, 0x0fbd3115, 0x0fc641b3, 0x0fd5007f, 0x0fd9206b, 0x0fdf0013,
+    0x0fe0001e, 0x0fe2001e, 0x0fe33002, 0x0fe4d004, 0x0fe71001, 0x0fe73001, 0x0fe77001, 0x0fe79001,
+    0x0fe7b001, 0x0fe7d001, 0x0fe7f0fb, 0x0ff10012, 0x0ff21033, 0x0ff3f000, 0x0ff41033, 0x0ff6606f,
+    0x0ff9e002, 0x0ffa003d, 0x0ffc200b, 0x0ffca00b, 0x0ffd200b, 0x0ffda005, 0x10000017, 0x1000d033,
+    0x10028025, 0x1003c003, 0x1003f01d, 0x1005001b, 0x100800f5, 0x10140069, 0x101fd000, 0x10280039,
+    0x102a0061, 0x102e0000, 0x1030003f, 0x1032d03b, 0x1035004b, 0x10376008, 0x1038003b, 0x103a0047,
+    0x103c800f, 0x103d1009, 0x1040013b, 0x104a0012, 0x104b0047, 0x104d8047, 0x1050004f, 0x10530067,
+    0x10570015, 0x1057c01d, 0x1058c00d, 0x10594003, 0x10597015, 0x105a301d, 0x105b300d, 0x105bb003,
+    0x1060026d, 0x1074002b, 0x1076000f, 0x1078000b, 0x10787053, 0x107b2011, 0x1080000b, 0x10808001,
+    0x1080a057, 0x10837003, 0x1083c001, 0x1083f02d, 0x1086002d, 0x1088003d, 0x108e0025, 0x108f4003,
+    0x1090002b, 0x10920033, 0x1098006f, 0x109be003, 0x10a00001, 0x10a01004, 0x10a05002, 0x10a0c006,
+    0x10a10007, 0x10a15005, 0x10a19039, 0x10a38004, 0x10a3f000, 0x10a60039, 0x10a80039, 0x10ac000f,
+    0x10ac9037, 0x10ae5002, 0x10b0006b, 0x10b4002b, 0x10b60025, 0x10b80023, 0x10c00091, 0x10c80065,
+    0x10cc0065, 0x10d00047, 0x10d24006, 0x10d30012, 0x10e80053, 0x10eab002, 0x10eb0003, 0x10f00039,
+    0x10f27001, 0x10f3002b, 0x10f46014, 0x10f70023, 0x10f82006, 0x10fb0029, 0x10fe002d, 0x11000004,
+    0x11003069, 0x1103801c, 0x11066014, 0x11071003, 0x11073002, 0x11075001, 0x1107f006, 0x11083059,
+    0x110b0014, 0x110c2000, 0x110d0031, 0x110f0012, 0x11100004, 0x11103047, 0x1112701a, 0x11136012,
+    0x11144001, 0x11145002, 0x11147001, 0x11150045, 0x11173000, 0x11176001, 0x11180004, 0x1118305f,
+    0x111b301a, 0x111c1007, 0x111c9006, 0x111ce016, 0x111da001, 0x111dc001, 0x11200023, 0x11213031,
+    0x1122c016, 0x1123e000, 0x1128000d, 0x11288001, 0x1128a007, 0x1128f01d, 0x1129f013, 0x112b005d,
+    0x112df016, 0x112f0012, 0x11300006, 0x1130500f, 0x1130f003, 0x1131302b, 0x1132a00d, 0x11332003,
+    0x11335009, 0x1133b002, 0x1133d001, 0x1133e00c, 0x11347002, 0x1134b004, 0x11350001, 0x11357000,
+    0x1135d009, 0x11362002, 0x1136600c, 0x11370008, 0x11400069, 0x11435022, 0x11447007, 0x11450012,
+    0x1145e000, 0x1145f005, 0x1148005f, 0x114b0026, 0x114c4003, 0x114c7001, 0x114d0012, 0x1158005d,
+    0x115af00c, 0x115b8010, 0x115d8007, 0x115dc002, 0x1160005f, 0x11630020, 0x11644001, 0x11650012,
+    0x11680055, 0x116ab018, 0x116b8001, 0x116c0012, 0x11700035, 0x1171d01c, 0x11730012, 0x1174000d,
+    0x11800057, 0x1182c01c, 0x118a007f, 0x118e0012, 0x118ff00f, 0x11909001, 0x1190c00f, 0x11915003,
+    0x1191802f, 0x1193000a, 0x11937002, 0x1193b006, 0x1193f001, 0x11940000, 0x11941001, 0x11942002,
+    0x11950012, 0x119a000f, 0x119aa04d, 0x119d100c, 0x119da00c, 0x119e1001, 0x119e3001, 0x119e4000,
+    0x11a00001, 0x11a01012, 0x11a0b04f, 0x11a3300c, 0x11a3a001, 0x11a3b006, 0x11a47000, 0x11a50001,
+    0x11a51014, 0x11a5c05b, 0x11a8a01e, 0x11a9d001, 0x11ab0091, 0x11c00011, 0x11c0a049, 0x11c2f00e,
+    0x11c3800e, 0x11c40001, 0x11c50012, 0x11c7203b, 0x11c9202a, 0x11ca901a, 0x11d0000d, 0x11d08003,
+    0x11d0b04b, 0x11d3100a, 0x11d3a000, 0x11d3c002, 0x11d3f00c, 0x11d46001, 0x11d47000, 0x11d50012,
+    0x11d6000b, 0x11d67003, 0x11d6a03f, 0x11d8a008, 0x11d90002, 0x11d93008, 0x11d98001, 0x11da0012,
+    0x11ee0025, 0x11ef3006, 0x11fb0001, 0x12000733, 0x124000dd, 0x12480187, 0x12f900c1, 0x1300085d,
+    0x1440048d, 0x16800471, 0x16a4003d, 0x16a60012, 0x16a7009d, 0x16ac0012, 0x16ad003b, 0x16af0008,
+    0x16b0005f, 0x16b3000c, 0x16b40007, 0x16b50012, 0x16b63029, 0x16b7d025, 0x16e4007f, 0x16f00095,
+    0x16f4f000, 0x16f50001, 0x16f5106c, 0x16f8f006, 0x16f93019, 0x16fe0003, 0x16fe3001, 0x16fe4000,
+    0x16ff0002, 0x17000fff, 0x17800fff, 0x18000fef, 0x188009ab, 0x18d00011, 0x1aff0007, 0x1aff500d,
+    0x1affd003, 0x1b000245, 0x1b150005, 0x1b164007, 0x1b170317, 0x1bc000d5, 0x1bc70019, 0x1bc80011,
+    0x1bc90013, 0x1bc9d002, 0x1cf0005a, 0x1cf3002c, 0x1d165008, 0x1d16d00a, 0x1d17b00e, 0x1d18500c,
+    0x1d1aa006, 0x1d242004, 0x1d4000a9, 0x1d45608d, 0x1d49e003, 0x1d4a2001, 0x1d4a5003, 0x1d4a9007,
+    0x1d4ae017, 0x1d4bb001, 0x1d4bd00d, 0x1d4c5081, 0x1d507007, 0x1d50d00f, 0x1d51600d, 0x1d51e037,
+    0x1d53b007, 0x1d540009, 0x1d546001, 0x1d54a00d, 0x1d5522a7, 0x1d6a8031, 0x1d6c2031, 0x1d6dc03d,
+    0x1d6fc031, 0x1d71603d, 0x1d736031, 0x1d75003d, 0x1d770031, 0x1d78a03d, 0x1d7aa031, 0x1d7c400f,
+    0x1d7ce062, 0x1da0006c, 0x1da3b062, 0x1da75000, 0x1da84000, 0x1da9b008, 0x1daa101c, 0x1df0003d,
+    0x1e00000c, 0x1e008020, 0x1e01b00c, 0x1e023002, 0x1e026008, 0x1e100059, 0x1e13000c, 0x1e13700d,
+    0x1e140012, 0x1e14e001, 0x1e29003b, 0x1e2ae000, 0x1e2c0057, 0x1e2ec01a, 0x1e7e000d, 0x1e7e8007,
+    0x1e7ed003, 0x1e7f001d, 0x1e800189, 0x1e8d000c, 0x1e900087, 0x1e94400c, 0x1e94b001, 0x1e950012,
+    0x1ee00007, 0x1ee05035, 0x1ee21003, 0x1ee24001, 0x1ee27001, 0x1ee29013, 0x1ee34007, 0x1ee39001,
+    0x1ee3b001, 0x1ee42001, 0x1ee47001, 0x1ee49001, 0x1ee4b001, 0x1ee4d005, 0x1ee51003, 0x1ee54001,
+    0x1ee57001, 0x1ee59001, 0x1ee5b001, 0x1ee5d001, 0x1ee5f001, 0x1ee61003, 0x1ee64001, 0x1ee67007,
+    0x1ee6c00d, 0x1ee74007, 0x1ee79007, 0x1ee7e001, 0x1ee80013, 0x1ee8b021, 0x1eea1005, 0x1eea5009,
+    0x1eeab021, 0x1fbf0012, 0x20000fff, 0x20800fff, 0x21000fff, 0x21800fff, 0x22000fff, 0x22800fff,
+    0x23000fff, 0x23800fff, 0x24000fff, 0x24800fff, 0x25000fff, 0x25800fff, 0x26000fff, 0x26800fff,
+    0x27000fff, 0x27800fff, 0x28000fff, 0x28800fff, 0x29000fff, 0x29800fff, 0x2a000dbf, 0x2a700fff,
+    0x2af00fff, 0x2b700071, 0x2b7401bb, 0x2b820fff, 0x2c020fff, 0x2c820d03, 0x2ceb0fff, 0x2d6b0fff,
+    0x2deb0fff, 0x2e6b0a61, 0x2f80043b, 0x30000fff, 0x30800fff, 0x31000695, 0xe01001de,
+};
+
+// 0 outside identifiers, else UnicodeXid_continue and for XID_Start also UnicodeXid_start
+enum { UnicodeXid_continue = 1, UnicodeXid_start = 2 };
+
+static uint32_t unicode_xid(uint32_t cp){
+    uint32_t lo = 0, hi = sizeof(UnicodeXidTable) / sizeof(UnicodeXidTable[0]);
+    uint32_t key = cp << 12 | 0xFFF;
+    while(lo < hi){
+        uint32_t mid = (lo + hi) / 2;
+        if(UnicodeXidTable[mid] <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    if(lo == 0) return 0;
+    uint32_t run = UnicodeXidTable[lo - 1];
+    if(cp - (run >> 12) > ((run >> 1) & 0x7FF)) return 0;
+    return UnicodeXid_continue | (run & 1 ? UnicodeXid_start : 0);
+}
+
+// Takes the non-ASCII code point at lex->index into the identifier being
+// lexed when it may stand there (XID_Start at the start, XID_Continue
+// after) and returns true. Otherwise an identifier ends before it, and a
+// token that would start with it becomes a Tok_error over the sequence.
+// Past lex->utf8_end the bytes are checked while they are decoded.
+static bool lexer_utf8_identifier(Lexer* lex, Token* result, bool start){
+    uint32_t cp = 0, n;
+    for(;;){
+        const char* at = lex->source + lex->index;
+        n = lex->index < lex->utf8_end ? utf8_decode_valid(at, &cp) : utf8_decode(at, &cp);
+        // a sequence cut by the end of a stream window
+        if(n || !lex->stream || lex->index + 4 <= lex->src_len || !lexer_stream_refill(lex, result)) break;
+    }
+    if(n && (unicode_xid(cp) & (start ? UnicodeXid_start : UnicodeXid_continue))){
+        lex->index += n;
+        return true;
+    }
+    if(start){
+        lex->index += n ? n : 1;
+        result->kind = Tok_error;
+        result->loc.len = lex->index - result->loc.offset;
+        lexer_report(lex, Error_unhandled_char, result->loc);
+    }
+    return false;
+}
+
+// Skips a block comment, `lex->index` just past its `/*`, up to after its
+// `*/`. At the end of the input the comment is left unterminated: `result`
+// becomes a Tok_error over it and false is returned. A stream lexer keeps
+// the comment in its window like a literal, so it still starts the token.
+static bool lexer_block_comment(Lexer* lex, Token* result){
+    uint32_t body = lex->index; // the `*` of the `/*` can't end it
+    for(;;){
+        uint32_t i = lex->kernels->skip_comment(lex->source, lex->index);
+        if(LEXER_FIRST_LINE) lex->line += lex->kernels->count_newlines(lex->source, lex->index, i);
+        if(lex->source[i] == '*'){
+            lex->index = i + 2;
+            return true;
+        }
+        lex->index = i + 1;
+        if(i < lex->src_len) continue; // a NUL inside the comment
+        lex->index = i;
+        uint32_t from = result->loc.offset;
+        if(lex->stream && lexer_stream_refill(lex, result)){
+            // the `*` of the `*/` may have been the last byte read
+            body -= from;
+            if(lex->index > body && lex->source[lex->index - 1] == '*') lex->index -= 1;
+            continue;
+        }
+        result->kind = Tok_error;
+        result->loc.len = lex->index - result->loc.offset;
+        lexer_report(lex, Error_comment_no_end, result->loc);
+        return false;
+    }
+}
+
 Token lexer_next_token(Lexer* lex) { 
         LexingState state = Lexing_start;
         Token result = (Token){
@@ -277,22 +1999,29 @@ Token lexer_next_token(Lexer* lex) {
                 .line = lex->line, 
             },
         };
-loop: switch(state){
+        LEXER_PROFILE_BEGIN(lex);
+loop: LEXER_PROFILE_STEP(lex, state);
+      switch(state){
         case Lexing_start:{
              switch(lex->source[lex->index]){
                  case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
                      result.kind = Tok_eof;
                      goto end;
                  case ' ':
                  case '\t':
                      lex->index += 1;
+                     if(lex->source[lex->index] == ' ' || lex->source[lex->index] == '\t'){
+                         lex->index = lex->kernels->skip_blanks(lex->source, lex->index);
+                     }
                      result.loc.offset = lex->index;
                      goto loop;
                  
                  case '\n':
-                     lex->line += 1;
+                     LEXER_NEWLINE(lex);
                      lex->index += 1;
                      result.loc.offset = lex->index;
+                     result.loc.line = lex->line;
                      goto loop;
                 
                  case '#':
@@ -472,9 +2201,20 @@ loop: switch(state){
                      lex->index += 1;
                      goto end;
 
+                case '\x80' ... '\xff':
+                     if(lexer_utf8_identifier(lex, &result, true)){
+                         result.kind = Tok_identifier;
+                         state = Lexing_identifier;
+                         goto loop;
+                     }
+                     goto end;
+
                 default:
-                     fprintf(stderr , "[Lexing Error]: unhandled char `%c`\n",lex->source[lex->index]);
-                     longjmp(lex_err, Error_unhandled_char);
+                     lex->index += 1;
+                     result.kind = Tok_error;
+                     result.loc.len = 1;
+                     lexer_report(lex, Error_unhandled_char, result.loc);
+                     goto end;
              }
         }break;
         case Lexing_identifier:{
@@ -483,13 +2223,16 @@ loop: switch(state){
                  case 'A' ... 'Z':
                  case '0' ... '9':
                  case '_':
-                     lex->index += 1;
+                     lex->index = lex->kernels->skip_identifier(lex->source, lex->index + 1);
                      goto loop;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     // fallthrough
                  default:
-                     for(int i = 0; i < KEYWORDS_TABLE_LEN ; i++ ){
-                         if(!memcmp(&lex->source[result.loc.offset], KeywordsTable[i].name , lex->index - result.loc.offset)){
-                             result.kind = KeywordsTable[i].kind;
-                         }
+                     if((uint8_t)lex->source[lex->index] >= 0x80 && lexer_utf8_identifier(lex, &result, false)) goto loop;
+                     result.kind = keyword_lookup(&lex->source[result.loc.offset], lex->index - result.loc.offset);
+                     if(result.kind == Tok_identifier && lex->interner){
+                         result.symbol = interner_intern(lex->interner, &lex->source[result.loc.offset], lex->index - result.loc.offset);
                      }
                      goto end;
              }
@@ -497,20 +2240,25 @@ loop: switch(state){
         case Lexing_string_literal:{
              switch (lex->source[lex->index]) {
                 case '\\':
-                     lex->index += 2;
+                     if(LEXER_REFILL_AT(lex->index + 1)) goto loop;
+                     if(lex->source[lex->index + 1] == '\n') LEXER_NEWLINE(lex);
+                     lex->index += lex->source[lex->index + 1] ? 2 : 1;
                      goto loop;
                  case '"':
                      lex->index += 1;
                      goto end;
                 case '\n':
-                     lex->line += 1;
+                     LEXER_NEWLINE(lex);
                      lex->index += 1;
                      goto loop;
                 case '\0':
-                     fprintf(stderr , "[Lexing Error]: string literal misses `\"`, stuck at eof \n");
-                     longjmp(lex_err, Error_string_literal_no_end_quote);
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     result.kind = Tok_error;
+                     result.loc.len = lex->index - result.loc.offset;
+                     lexer_report(lex, Error_string_literal_no_end_quote, result.loc);
+                     goto end;
                  default:
-                     lex->index += 1;
+                     lex->index = lex->kernels->skip_string(lex->source, lex->index + 1);
                      goto loop;
              }
         }break;
@@ -520,23 +2268,30 @@ loop: switch(state){
                  case '\'':
                      lex->index += 1;
                      goto end;
+                case '\n':
+                     LEXER_NEWLINE(lex);
+                     lex->index += 1;
+                     goto loop;
                 case '\\':
-                     lex->index += 2;
+                     if(LEXER_REFILL_AT(lex->index + 1)) goto loop;
+                     if(lex->source[lex->index + 1] == '\n') LEXER_NEWLINE(lex);
+                     lex->index += lex->source[lex->index + 1] ? 2 : 1;
                      goto loop;
+                case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     result.kind = Tok_error;
+                     result.loc.len = lex->index - result.loc.offset;
+                     lexer_report(lex, Error_char_literal_no_end_quote, result.loc);
+                     goto end;
                  default:
-                     lex->index += 1;
+                     lex->index = lex->kernels->skip_char(lex->source, lex->index + 1);
                      goto loop;
              }
         }break;
 
         case Lexing_number_literal:{
-             switch (lex->source[lex->index]) {
-                 case '0' ... '9':
-                     lex->index += 1;
-                     goto loop;
-                 default:
-                     goto end;
-             }
+             lexer_number(lex, &result);
+             goto end;
         }break;
 
         case Lexing_equal:{
@@ -545,6 +2300,9 @@ loop: switch(state){
                      lex->index += 1;
                      result.kind = Tok_equal_equal;
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -561,6 +2319,9 @@ loop: switch(state){
                      lex->index += 1;
                      result.kind = Tok_plus_plus;
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -583,6 +2344,9 @@ loop: switch(state){
                      result.kind = Tok_arrow;
                      goto end;
 
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -594,6 +2358,9 @@ loop: switch(state){
                      lex->index += 1;
                      result.kind = Tok_asterisk_equal;
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -609,6 +2376,13 @@ loop: switch(state){
                      lex->index += 1;
                      state = Lexing_single_line_comment;
                      goto loop;
+                 case '*':
+                     lex->index += 1;
+                     state = Lexing_multi_line_comment;
+                     goto loop;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -620,6 +2394,9 @@ loop: switch(state){
                      lex->index += 1;
                      result.kind = Tok_tilde_equal;
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -631,6 +2408,9 @@ loop: switch(state){
                      lex->index += 1;
                      result.kind = Tok_caret_equal;
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -647,6 +2427,9 @@ loop: switch(state){
                      lex->index += 1;
                      result.kind = Tok_ampersand_ampersand;
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -664,6 +2447,9 @@ loop: switch(state){
                      result.kind = Tok_pipe_pipe;
                      goto end;
 
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -676,6 +2462,9 @@ loop: switch(state){
                      result.kind = Tok_bang_equal;
                      goto end;
 
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -687,6 +2476,9 @@ loop: switch(state){
                      lex->index += 1;
                      result.kind = Tok_percent_equal;
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -702,6 +2494,7 @@ loop: switch(state){
                  case '<':
                      lex->index += 1;
                      result.kind = Tok_angle_bracket_left_left;
+                     (void)LEXER_REFILL_AT(lex->index);
                      if(lex->source[lex->index] == '='){
                         result.kind = Tok_angle_bracket_left_left_equal;
                         lex->index += 1;
@@ -709,6 +2502,9 @@ loop: switch(state){
                      }
                      goto end;
 
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -721,15 +2517,19 @@ loop: switch(state){
                      result.kind = Tok_angle_bracket_right_equal;
                      goto end;
 
-                 case '<':
+                 case '>':
                      lex->index += 1;
                      result.kind = Tok_angle_bracket_right_right;
+                     (void)LEXER_REFILL_AT(lex->index);
                      if(lex->source[lex->index] == '='){
                         result.kind = Tok_angle_bracket_right_right_equal;
                         lex->index += 1;
                      }
                      goto end;
 
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -738,23 +2538,32 @@ loop: switch(state){
      case Lexing_single_line_comment:{
              switch (lex->source[lex->index]) {
                  case '\n':
-                     lex->line++;
+                     LEXER_NEWLINE(lex);
                      lex->index += 1;
                      result.loc.offset = lex->index;
+                     result.loc.line = lex->line;
                      state = Lexing_start;
                      goto loop;
                  case '\0':
-                     lex->index += 1;
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
                      result.loc.offset = lex->index;
                      result.kind = Tok_eof;
                      goto end;
                  default:
-                     lex->index += 1;
+                     lex->index = lex->kernels->skip_line(lex->source, lex->index + 1);
                      result.loc.offset = lex->index;
                      goto loop;
              }
         }break;
 
+        case Lexing_multi_line_comment:{
+             if(!lexer_block_comment(lex, &result)) goto end;
+             result.loc.offset = lex->index;
+             result.loc.line = lex->line;
+             state = Lexing_start;
+             goto loop;
+        }break;
+
         case Lexing_colon:{
              switch (lex->source[lex->index]) {
                  case '=':
@@ -765,6 +2574,9 @@ loop: switch(state){
                      lex->index += 1;
                      result.kind = Tok_colon_colon;
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -772,15 +2584,21 @@ loop: switch(state){
 
         case Lexing_period:{
              switch (lex->source[lex->index]) {
+                 case '0' ... '9':
+                     state = Lexing_number_literal;
+                     goto loop;
                  case '.':
                      result.kind = Tok_ellipsis2;
                      lex->index += 1;
-                     
+                     (void)LEXER_REFILL_AT(lex->index);
                      if(lex->source[lex->index] == '.') {
                         result.kind = Tok_ellipsis3;
                         lex->index += 1;
                      }
                      goto end;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     goto end;
                  default:
                      goto end;
              }
@@ -793,12 +2611,11 @@ loop: switch(state){
                  case '_':
                      lex->index += 1;
                      goto loop;
+                 case '\0':
+                     if(LEXER_REFILL_AT(lex->index)) goto loop;
+                     // fallthrough
                  default:
-                     for(int i = 0; i < BUILTINS_TABLE_LEN ; i++ ){
-                         if(!memcmp(&lex->source[result.loc.offset], BuiltinsTable[i].name , lex->index - result.loc.offset)){
-                             result.kind = BuiltinsTable[i].kind;
-                         }
-                     }
+                     result.kind = builtin_lookup(&lex->source[result.loc.offset], lex->index - result.loc.offset);
                      goto end;
              }
          }break;
@@ -807,123 +2624,832 @@ loop: switch(state){
 
 end:
     result.loc.len = lex->index - result.loc.offset;
+    LEXER_PROFILE_END(lex, result.kind);
     return result;
 }
 
+// Table driven engine. A byte is first mapped to one of LEXER_CLASS_COUNT
+// classes, then the (state, class) edge says what to do with it. Every
+// punctuator is an edge list of the same lists below, so a new operator is
+// new edges, not new code. Edges into run states (identifiers, literals,
+// comments, blanks) hand over to a loop of their own. A missing edge accepts
+// the token read so far without taking the byte. Both tables are built by
+// the compiler from the lists; a duplicate entry trips -Woverride-init.
+#define LEXER_CLASSES(X) \
+    X(other) X(nul) X(blank) X(newline) X(alpha) X(digit) X(quote) X(apostrophe) X(hash) \
+    X(l_paren) X(r_paren) X(l_brace) X(r_brace) X(l_bracket) X(r_bracket) X(semicolon) X(comma) \
+    X(dollar) X(at) X(question) X(equal) X(plus) X(minus) X(asterisk) X(slash) X(percent) X(colon) \
+    X(period) X(tilde) X(caret) X(ampersand) X(lt) X(gt) X(pipe) X(bang) X(utf8)
+
+// X(bytes, class), bytes not listed are `other`
+#define LEXER_CLASS_BYTES(X) \
+    X('\0', nul) X(' ', blank) X('\t', blank) X('\n', newline) \
+    X('a' ... 'z', alpha) X('A' ... 'Z', alpha) X('_', alpha) X('0' ... '9', digit) \
+    X('"', quote) X('\'', apostrophe) X('#', hash) \
+    X('(', l_paren) X(')', r_paren) X('{', l_brace) X('}', r_brace) X('[', l_bracket) X(']', r_bracket) \
+    X(';', semicolon) X(',', comma) X('$', dollar) X('@', at) X('?', question) \
+    X('=', equal) X('+', plus) X('-', minus) X('*', asterisk) X('/', slash) X('%', percent) \
+    X(':', colon) X('.', period) X('~', tilde) X('^', caret) X('&', ampersand) X('<', lt) X('>', gt) \
+    X('|', pipe) X('!', bang) X(0x80 ... 0xff, utf8)
+
+// X(state, label): the states with edges of their own. `accept` has none and
+// must stay first, so that a zeroed edge accepts.
+#define LEXER_DFA_STATES(X) \
+    X(accept, accept) X(start, step) \
+    X(equal, shift) X(plus, shift) X(minus, shift) X(asterisk, shift) X(slash, shift) X(percent, shift) \
+    X(colon, shift) X(tilde, shift) X(caret, shift) X(ampersand, shift) X(lt, shift) X(lt_lt, shift) \
+    X(gt, shift) X(gt_gt, shift) X(pipe, shift) X(bang, shift) X(period, shift) X(period2, shift)
+
+// X(target, label): edge targets that finish the token or run a loop
+#define LEXER_DFA_ACTIONS(X) \
+    X(done, done) X(identifier, identifier) X(number, number) X(string, string) X(char, char) \
+    X(comment, comment) X(block_comment, block_comment) X(blank, blank) X(newline, newline) X(hash, hash) X(nul, nul) X(error, error) X(utf8, utf8)
+
+// X(state, class, kind, target): taking a `class` byte in `state` makes the
+// token a `kind` and goes on in `target`
+#define LEXER_DFA_EDGES(X) \
+    X(start, nul, Tok_eof, nul) \
+    X(start, blank, Tok_eof, blank) \
+    X(start, newline, Tok_eof, newline) \
+    X(start, alpha, Tok_identifier, identifier) \
+    X(start, digit, Tok_number_literal, number) \
+    X(start, quote, Tok_string_literal, string) \
+    X(start, apostrophe, Tok_char_literal, char) \
+    X(start, hash, Tok_hash, hash) \
+    X(start, other, Tok_error, error) \
+    X(start, utf8, Tok_identifier, utf8) \
+    X(start, l_paren, Tok_l_paren, done) \
+    X(start, r_paren, Tok_r_paren, done) \
+    X(start, l_brace, Tok_l_brace, done) \
+    X(start, r_brace, Tok_r_brace, done) \
+    X(start, l_bracket, Tok_l_bracket, done) \
+    X(start, r_bracket, Tok_r_bracket, done) \
+    X(start, semicolon, Tok_semicolon, done) \
+    X(start, comma, Tok_comma, done) \
+    X(start, dollar, Tok_dollar_sign, done) \
+    X(start, at, Tok_at_sign, done) \
+    X(start, question, Tok_questionmark, done) \
+    X(start, equal, Tok_equal, equal) \
+    X(start, plus, Tok_plus, plus) \
+    X(start, minus, Tok_minus, minus) \
+    X(start, asterisk, Tok_asterisk, asterisk) \
+    X(start, slash, Tok_slash, slash) \
+    X(start, percent, Tok_percent, percent) \
+    X(start, colon, Tok_colon, colon) \
+    X(start, period, Tok_period, period) \
+    X(start, tilde, Tok_tilde, tilde) \
+    X(start, caret, Tok_caret, caret) \
+    X(start, ampersand, Tok_ampersand, ampersand) \
+    X(start, lt, Tok_angle_bracket_left, lt) \
+    X(start, gt, Tok_angle_bracket_right, gt) \
+    X(start, pipe, Tok_pipe, pipe) \
+    X(start, bang, Tok_bang, bang) \
+    X(equal, equal, Tok_equal_equal, done) \
+    X(plus, plus, Tok_plus_plus, done) \
+    X(plus, equal, Tok_plus_equal, done) \
+    X(minus, minus, Tok_minus_minus, done) \
+    X(minus, equal, Tok_minus_equal, done) \
+    X(minus, gt, Tok_arrow, done) \
+    X(asterisk, equal, Tok_asterisk_equal, done) \
+    X(slash, equal, Tok_slash_equal, done) \
+    X(slash, slash, Tok_slash, comment) \
+    X(slash, asterisk, Tok_slash, block_comment) \
+    X(percent, equal, Tok_percent_equal, done) \
+    X(colon, equal, Tok_colon_equal, done) \
+    X(colon, colon, Tok_colon_colon, done) \
+    X(tilde, equal, Tok_tilde_equal, done) \
+    X(caret, equal, Tok_caret_equal, done) \
+    X(ampersand, equal, Tok_ampersand_equal, done) \
+    X(ampersand, ampersand, Tok_ampersand_ampersand, done) \
+    X(lt, equal, Tok_angle_bracket_left_equal, done) \
+    X(lt, lt, Tok_angle_bracket_left_left, lt_lt) \
+    X(lt_lt, equal, Tok_angle_bracket_left_left_equal, done) \
+    X(gt, equal, Tok_angle_bracket_right_equal, done) \
+    X(gt, gt, Tok_angle_bracket_right_right, gt_gt) \
+    X(gt_gt, equal, Tok_angle_bracket_right_right_equal, done) \
+    X(pipe, equal, Tok_pipe_equal, done) \
+    X(pipe, pipe, Tok_pipe_pipe, done) \
+    X(bang, equal, Tok_bang_equal, done) \
+    X(period, period, Tok_ellipsis2, period2) \
+    X(period, digit, Tok_number_literal, number) \
+    X(period2, period, Tok_ellipsis3, done)
+
+#define LEXER_CLASS_ENUM(name) LexerClass_##name,
+enum { LEXER_CLASSES(LEXER_CLASS_ENUM) LEXER_CLASS_COUNT };
+
+#define LEXER_DFA_ENUM(name, label) LexerDfa_##name,
+enum { LEXER_DFA_STATES(LEXER_DFA_ENUM) LEXER_DFA_ROWS };
+enum { LexerDfa_last_row = LEXER_DFA_ROWS - 1, LEXER_DFA_ACTIONS(LEXER_DFA_ENUM) LEXER_DFA_TARGETS };
+_Static_assert(LEXER_DFA_TARGETS <= 256 && LEXER_CLASS_COUNT <= 256, "dfa tables hold bytes");
+
+typedef struct LexerDfaEdge {
+    uint8_t kind;
+    uint8_t target;
+} LexerDfaEdge;
+
+static const uint8_t LexerClassTable[256] = {
+#define LEXER_CLASS_BYTE_ENTRY(bytes, name) [bytes] = LexerClass_##name,
+    LEXER_CLASS_BYTES(LEXER_CLASS_BYTE_ENTRY)
+};
 
-const char* token_enum_to_str(TokenKind kind){
-    switch (kind) {
-        case Tok_eof: return "eof";
-        case Tok_identifier: return "identifier";
-        case Tok_number_literal: return "number_literal";
-        case Tok_string_literal: return "string_literal";
-        case Tok_char_literal: return "char_literal";
-        case Tok_l_paren: return "l_paren";
-        case Tok_r_paren: return "r_paren";
-        case Tok_l_brace: return "l_brace";
-        case Tok_r_brace: return "r_brace";
-        case Tok_l_bracket: return "l_bracket";
-        case Tok_r_bracket: return "r_bracket";
-        case Tok_period: return "period";
-        case Tok_ellipsis2: return "ellipsis2";
-        case Tok_ellipsis3: return "ellipsis3";
-        case Tok_colon: return "colon";
-        case Tok_colon_equal: return "colon_equal";
-        case Tok_colon_colon: return "colon_colon";
-        case Tok_equal: return "equal";
-        case Tok_equal_equal: return "equal_equal";
-        case Tok_semicolon: return "semicolon";
-        case Tok_comma: return "comma";
-        case Tok_bang: return "bang";
-        case Tok_bang_equal: return "bang_equal";
-        case Tok_questionmark: return "questionmark";
-        case Tok_dollar_sign: return "dollar_sign";
-        case Tok_at_sign: return "at_sign";
-        case Tok_hash: return "hash";
-        case Tok_plus: return "plus";
-        case Tok_plus_plus: return "plus_plus";
-        case Tok_plus_equal: return "plus_equal";
-        case Tok_minus: return "minus";
-        case Tok_minus_minus: return "minus_minus";
-        case Tok_minus_equal: return "minus_equal";
-        case Tok_arrow: return "arrow";
-        case Tok_asterisk: return "asterisk";
-        case Tok_asterisk_equal: return "asterisk_equal";
-        case Tok_slash: return "slash";
-        case Tok_slash_equal: return "slash_equal";
-        case Tok_percent: return "percent";
-        case Tok_percent_equal: return "percent_equal";
-        case Tok_pipe: return "pipe";
-        case Tok_pipe_equal :return "pipe_equal";
-        case Tok_pipe_pipe: return "pipe_pipe";
-        case Tok_ampersand: return "ampersand";
-        case Tok_ampersand_equal: return "ampersand_equal";
-        case Tok_ampersand_ampersand: return "ampersand_ampersand";
-        case Tok_caret: return "caret";
-        case Tok_caret_equal: return "caret_equal";
-        case Tok_tilde: return "tilde";
-        case Tok_tilde_equal: return "tilde_equal";
-        
-        case Tok_angle_bracket_left: return "angle_bracket_left";
-        case Tok_angle_bracket_left_left: return "angle_bracket_left_left";
-        case Tok_angle_bracket_left_left_equal: return "angle_bracket_left_left_equal";
-        case Tok_angle_bracket_left_equal: return "angle_bracket_left_equal";
-        
-        case Tok_angle_bracket_right: return "angle_bracket_right";
-        case Tok_angle_bracket_right_right: return "angle_bracket_right_right";
-        case Tok_angle_bracket_right_right_equal: return "angle_bracket_right_right_equal";
-        case Tok_angle_bracket_right_equal: return "angle_bracket_right_equal";
-        
-        case Tok_keyword_return: return "keyword_return";
-        case Tok_keyword_const: return "keyword_const";
-        case Tok_keyword_let: return "keyword_let";
-        case Tok_keyword_static: return "keyword_static";
-        case Tok_keyword_if: return "keyword_if";
-        case Tok_keyword_else: return "keyword_else";
-        case Tok_keyword_for: return "keyword_for";
-        case Tok_keyword_while: return "keyword_while";
-        case Tok_keyword_do: return "keyword_do";
-        case Tok_keyword_goto: return "keyword_goto";
-        case Tok_keyword_switch: return "keyword_switch";
-        case Tok_keyword_case: return "keyword_case";
-        case Tok_keyword_break: return "keyword_break";
-        case Tok_keyword_default: return "keyword_default";
-        case Tok_keyword_struct: return "keyword_struct";
-        case Tok_keyword_enum: return "keyword_enum";
-        case Tok_keyword_union: return "keyword_union";
-        case Tok_keyword_typedef: return "keyword_typedef";
-        case Tok_keyword_sizeof: return "keyword_sizeof";
-        case Tok_Keyword_signed: return "Keyword_signed";
-        case Tok_keyword_unsigned: return "keyword_unsigned";
-        case Tok_keyword_int: return "keyword_int";
-        case Tok_keyword_bool: return "keyword_bool";
-        case Tok_keyword_char: return "keyword_char";
-        case Tok_keyword_short: return "keyword_short";
-        case Tok_keyword_long: return "keyword_long";
-        case Tok_keyword_float: return "keyword_float";
-        case Tok_keyword_double: return "keyword_double";
-        case Tok_keyword_true: return "keyword_true";
-        case Tok_keyword_false: return "keyword_false";
-        case Tok_keyword_u8: return "keyword_u8";
-        case Tok_keyword_i8: return "keyword_i8";
-        case Tok_keyword_u16: return "keyword_u16";
-        case Tok_keyword_i16: return "keyword_i16";
-        case Tok_keyword_u32: return "keyword_u32";
-        case Tok_keyword_i32: return "keyword_i32";
-        case Tok_keyword_u64: return "keyword_u64";
-        case Tok_keyword_i64: return "keyword_i64";
-        case Tok_keyword_f32: return "keyword_f32";
-        case Tok_keyword_f64: return "keyword_f64";
-        case Tok_builtin_include: return "builtin_include";
-        case Tok_builtin_embed: return "builtin_embed";
-        case Tok_builtin_define: return "builtin_define";
-        case Tok_builtin_ifdef: return "builtin_ifdef";
-        case Tok_builtin_ifndef: return "builtin_ifndef";
-        case Tok_builtin_endif: return "builtin_endif";
+static const LexerDfaEdge LexerDfaTable[LEXER_DFA_ROWS][LEXER_CLASS_COUNT] = {
+#define LEXER_DFA_EDGE_ENTRY(from, cls, tok, to) \
+    [LexerDfa_##from][LexerClass_##cls] = { .kind = tok, .target = LexerDfa_##to },
+    LEXER_DFA_EDGES(LEXER_DFA_EDGE_ENTRY)
+};
+
+// Computed goto where the compiler has it: every edge jumps straight to its
+// target instead of going through one shared switch.
+#if defined(__GNUC__)
+#define LEXER_DFA_LABEL_ENTRY(name, label) [LexerDfa_##name] = &&dfa_##label,
+#define LEXER_DFA_DISPATCH(target) goto *targets[target]
+#else
+#define LEXER_DFA_CASE(name, label) case LexerDfa_##name: goto dfa_##label;
+#define LEXER_DFA_DISPATCH(target) \
+    switch(target){ LEXER_DFA_STATES(LEXER_DFA_CASE) LEXER_DFA_ACTIONS(LEXER_DFA_CASE) default: goto dfa_accept; }
+#endif
+
+// Same tokens, diagnostics, lines and symbols as lexer_next_token, stream
+// lexers included, but with one table lookup per byte class instead of a
+// switch per state. The C_LEXER_PROFILE hooks only live in lexer_next_token.
+Token lexer_next_token_dfa(Lexer* lex){
+#if defined(__GNUC__)
+    static void* const targets[LEXER_DFA_TARGETS] = {
+        LEXER_DFA_STATES(LEXER_DFA_LABEL_ENTRY)
+        LEXER_DFA_ACTIONS(LEXER_DFA_LABEL_ENTRY)
+    };
+#endif
+    Token result = (Token){
+        .kind = Tok_eof,
+        .loc = (Location){ .offset = lex->index, .len = 1, .line = lex->line },
+    };
+    uint32_t state = LexerDfa_start;
+    LexerDfaEdge edge;
+
+dfa_step:
+    edge = LexerDfaTable[state][LexerClassTable[(uint8_t)lex->source[lex->index]]];
+    LEXER_DFA_DISPATCH(edge.target);
+
+dfa_shift:
+    lex->index += 1;
+    result.kind = (TokenKind)edge.kind;
+    state = edge.target;
+    goto dfa_step;
+
+dfa_done:
+    lex->index += 1;
+    result.kind = (TokenKind)edge.kind;
+    goto end;
+
+dfa_accept:
+    if(LEXER_REFILL_AT(lex->index)) goto dfa_step;
+    goto end;
+
+dfa_nul:
+    if(LEXER_REFILL_AT(lex->index)) goto dfa_step;
+    result.kind = Tok_eof;
+    goto end;
+
+dfa_blank:
+    lex->index += 1;
+    if(lex->source[lex->index] == ' ' || lex->source[lex->index] == '\t'){
+        lex->index = lex->kernels->skip_blanks(lex->source, lex->index);
+    }
+    result.loc.offset = lex->index;
+    goto dfa_step;
+
+dfa_newline:
+    LEXER_NEWLINE(lex);
+    lex->index += 1;
+    result.loc.offset = lex->index;
+    result.loc.line = lex->line;
+    goto dfa_step;
+
+dfa_error:
+    lex->index += 1;
+    result.kind = Tok_error;
+    result.loc.len = 1;
+    lexer_report(lex, Error_unhandled_char, result.loc);
+    goto end;
+
+dfa_utf8:
+    if(!lexer_utf8_identifier(lex, &result, true)) goto end;
+    goto dfa_identifier_rest;
+
+dfa_identifier:
+    lex->index += 1;
+dfa_identifier_rest:
+    lex->index = lex->kernels->skip_identifier(lex->source, lex->index);
+    if(LEXER_REFILL_AT(lex->index)) goto dfa_identifier_rest;
+    if((uint8_t)lex->source[lex->index] >= 0x80 && lexer_utf8_identifier(lex, &result, false)) goto dfa_identifier_rest;
+    result.kind = keyword_lookup(&lex->source[result.loc.offset], lex->index - result.loc.offset);
+    if(result.kind == Tok_identifier && lex->interner){
+        result.symbol = interner_intern(lex->interner, &lex->source[result.loc.offset], lex->index - result.loc.offset);
+    }
+    goto end;
+
+dfa_number:
+    lexer_number(lex, &result);
+    goto end;
+
+dfa_hash:
+    lex->index += 1;
+    result.kind = Tok_hash;
+    result.loc.offset = lex->index;
+    for(;;){
+        char c = lex->source[lex->index];
+        if((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_'){
+            lex->index += 1;
+        }else if(!(c == '\0' && LEXER_REFILL_AT(lex->index))){
+            break;
+        }
+    }
+    result.kind = builtin_lookup(&lex->source[result.loc.offset], lex->index - result.loc.offset);
+    goto end;
+
+dfa_string:
+    result.kind = Tok_string_literal;
+    lex->index += 1;
+    for(;;){
+        switch(lex->source[lex->index]){
+            case '\\':
+                if(LEXER_REFILL_AT(lex->index + 1)) continue;
+                if(lex->source[lex->index + 1] == '\n') LEXER_NEWLINE(lex);
+                lex->index += lex->source[lex->index + 1] ? 2 : 1;
+                continue;
+            case '"':
+                lex->index += 1;
+                goto end;
+            case '\n':
+                LEXER_NEWLINE(lex);
+                lex->index += 1;
+                continue;
+            case '\0':
+                if(LEXER_REFILL_AT(lex->index)) continue;
+                result.kind = Tok_error;
+                result.loc.len = lex->index - result.loc.offset;
+                lexer_report(lex, Error_string_literal_no_end_quote, result.loc);
+                goto end;
+            default:
+                lex->index = lex->kernels->skip_string(lex->source, lex->index + 1);
+                continue;
+        }
+    }
+
+dfa_char:
+    result.kind = Tok_char_literal;
+    lex->index += 1;
+    for(;;){
+        switch(lex->source[lex->index]){
+            case '\\':
+                if(LEXER_REFILL_AT(lex->index + 1)) continue;
+                if(lex->source[lex->index + 1] == '\n') LEXER_NEWLINE(lex);
+                lex->index += lex->source[lex->index + 1] ? 2 : 1;
+                continue;
+            case '\'':
+                lex->index += 1;
+                goto end;
+            case '\n':
+                LEXER_NEWLINE(lex);
+                lex->index += 1;
+                continue;
+            case '\0':
+                if(LEXER_REFILL_AT(lex->index)) continue;
+                result.kind = Tok_error;
+                result.loc.len = lex->index - result.loc.offset;
+                lexer_report(lex, Error_char_literal_no_end_quote, result.loc);
+                goto end;
+            default:
+                lex->index = lex->kernels->skip_char(lex->source, lex->index + 1);
+                continue;
+        }
+    }
+
+dfa_comment:
+    lex->index += 1;
+    for(;;){
+        switch(lex->source[lex->index]){
+            case '\n':
+                LEXER_NEWLINE(lex);
+                lex->index += 1;
+                result.loc.offset = lex->index;
+                result.loc.line = lex->line;
+                state = LexerDfa_start;
+                goto dfa_step;
+            case '\0':
+                if(LEXER_REFILL_AT(lex->index)) continue;
+                result.loc.offset = lex->index;
+                result.kind = Tok_eof;
+                goto end;
+            default:
+                lex->index = lex->kernels->skip_line(lex->source, lex->index + 1);
+                result.loc.offset = lex->index;
+                continue;
+        }
+    }
+
+dfa_block_comment:
+    lex->index += 1;
+    if(!lexer_block_comment(lex, &result)) goto end;
+    result.loc.offset = lex->index;
+    result.loc.line = lex->line;
+    state = LexerDfa_start;
+    goto dfa_step;
+
+end:
+    result.loc.len = lex->index - result.loc.offset;
+    return result;
+}
+
+void token_buffer_init(TokenBuffer* buf, uint32_t flags, size_t size_hint){
+    *buf = (TokenBuffer){ .flags = flags };
+    if(size_hint) token_buffer_reserve(buf, (uint32_t)(size_hint / TOKEN_BUFFER_BYTES_PER_TOKEN) + 16);
+}
+
+void token_buffer_init_arena(TokenBuffer* buf, uint32_t flags, size_t size_hint, Arena* arena){
+    *buf = (TokenBuffer){ .flags = flags, .arena = arena };
+    if(size_hint) token_buffer_reserve(buf, (uint32_t)(size_hint / TOKEN_BUFFER_BYTES_PER_TOKEN) + 16);
+}
+
+static void* token_buffer_column(TokenBuffer* buf, void* column, uint32_t cap, size_t size){
+    if(!buf->arena) return realloc(column, cap * size);
+    return arena_realloc(buf->arena, column, buf->cap * size, cap * size);
+}
+
+void token_buffer_reserve(TokenBuffer* buf, uint32_t cap){
+    if(cap <= buf->cap) return;
+    buf->kinds = token_buffer_column(buf, buf->kinds, cap, sizeof(uint8_t));
+    buf->offsets = token_buffer_column(buf, buf->offsets, cap, sizeof(uint32_t));
+    if(buf->flags & TokenBuffer_lengths) buf->lengths = token_buffer_column(buf, buf->lengths, cap, sizeof(uint32_t));
+    if(buf->flags & TokenBuffer_lines) buf->lines = token_buffer_column(buf, buf->lines, cap, sizeof(uint32_t));
+    if(buf->flags & TokenBuffer_symbols) buf->symbols = token_buffer_column(buf, buf->symbols, cap, sizeof(uint32_t));
+    if(!buf->kinds || !buf->offsets
+       || ((buf->flags & TokenBuffer_lengths) && !buf->lengths)
+       || ((buf->flags & TokenBuffer_lines) && !buf->lines)
+       || ((buf->flags & TokenBuffer_symbols) && !buf->symbols)) {
+        fprintf(stderr, "[Lexing Error]: failed to grow token buffer to %u tokens\n", cap);
+        exit(1);
+    }
+    buf->cap = cap;
+}
+
+void token_buffer_push(TokenBuffer* buf, Token tok){
+    if(buf->len == buf->cap) token_buffer_reserve(buf, buf->cap ? buf->cap * 2 : 256);
+    uint32_t i = buf->len++;
+    buf->kinds[i] = (uint8_t)tok.kind;
+    buf->offsets[i] = tok.loc.offset;
+    if(buf->lengths) buf->lengths[i] = tok.loc.len;
+    if(buf->lines) buf->lines[i] = tok.loc.line;
+    if(buf->symbols) buf->symbols[i] = tok.symbol;
+}
+
+void token_buffer_reset(TokenBuffer* buf){
+    buf->len = 0;
+}
+
+void token_buffer_deinit(TokenBuffer* buf){
+    if(buf->arena){
+        *buf = (TokenBuffer){0};
+        return;
+    }
+    free(buf->kinds);
+    free(buf->offsets);
+    free(buf->lengths);
+    free(buf->lines);
+    free(buf->symbols);
+    *buf = (TokenBuffer){0};
+}
+
+// Re-lexes the token that starts at `offset`. Builtins and `#` record the
+// offset after the hash, so their name is rescanned the way Lexing_builtin does.
+uint32_t token_len_at(const char* source, TokenKind kind, uint32_t offset){
+    if(kind == Tok_eof) return 0;
+    if(kind == Tok_hash || (kind >= Tok_builtin_include && kind <= Tok_builtin_endif)){
+        uint32_t end = offset;
+        while((source[end] >= 'a' && source[end] <= 'z') || (source[end] >= 'A' && source[end] <= 'Z') || source[end] == '_') end += 1;
+        return end - offset;
+    }
+    Lexer lex = lexer_init_s(source, offset);
+    lex.index = offset;
+    uint32_t len = lexer_next_token(&lex).loc.len;
+    lexer_deinit(&lex);
+    return len;
+}
+
+// `source` is only needed when the buffer has no lengths column; lines read
+// as 0 without a lines column.
+Token token_buffer_get(const TokenBuffer* buf, const char* source, uint32_t i){
+    TokenKind kind = (TokenKind)buf->kinds[i];
+    uint32_t offset = buf->offsets[i];
+    return (Token){
+        .kind = kind,
+        .loc = (Location){
+            .offset = offset,
+            .len = buf->lengths ? buf->lengths[i] : token_len_at(source, kind, offset),
+            .line = buf->lines ? buf->lines[i] : 0,
+        },
+        .symbol = buf->symbols ? buf->symbols[i] : 0,
+    };
+}
+
+// Appends every remaining token, the final Tok_eof included, and returns how
+// many were added. An empty buffer is first sized from the bytes left to lex.
+uint32_t lexer_tokenize_all(Lexer* lex, TokenBuffer* out){
+    _Static_assert(TOKEN_KIND_COUNT <= 256, "token kinds are stored as bytes");
+    if(out->cap == 0) token_buffer_reserve(out, (lex->src_len - lex->index) / TOKEN_BUFFER_BYTES_PER_TOKEN + 16);
+    uint32_t start = out->len;
+    for(;;){
+        Token tok = lexer_next_token(lex);
+        token_buffer_push(out, tok);
+        if(tok.kind == Tok_eof) break;
+    }
+    return out->len - start;
+}
+
+// Is the `#` at `hash` the first token of its line? Blanks may precede it,
+// and a backslash at the end of the line before continues that line into it.
+// So may block comments: `blank_to` is the end of the last comment that
+// itself started a line, as a comment is one blank even across lines.
+static bool lexer_line_leading(const char* src, uint32_t hash, uint32_t blank_to){
+    uint32_t i = hash;
+    while(i > 0 && (src[i - 1] == ' ' || src[i - 1] == '\t' || src[i - 1] == '\f' || src[i - 1] == '\v' || src[i - 1] == '\r')) i -= 1;
+    if(i == 0 || i == blank_to) return true;
+    if(src[i - 1] != '\n') return false;
+    i -= 1;
+    if(i > 0 && src[i - 1] == '\r') i -= 1;
+    return i == 0 || src[i - 1] != '\\';
+}
+
+// Index after the literal opened by the quote at `index`: past its closing
+// quote, or at the end of its line when it has none.
+static uint32_t lexer_skip_quoted(const char* src, uint32_t index){
+    char quote = src[index++];
+    for(;;){
+        char c = src[index];
+        if(c == quote) return index + 1;
+        if(c == '\n' || c == '\0') return index;
+        index += c == '\\' && src[index + 1] != '\0' ? 2 : 1;
+    }
+}
+
+// A quote inside a number, as in 1'000'000 or 0xffff'ffff, separates digits.
+static bool lexer_digit_separator(const char* src, uint32_t quote){
+    uint32_t i = quote;
+    for(; i > 0; i--){
+        char c = src[i - 1];
+        if(!((c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z') || c == '_' || c == '.' || c == '\'')) break;
+    }
+    return i < quote && ((src[i] >= '0' && src[i] <= '9') || (src[i] == '.' && src[i + 1] >= '0' && src[i + 1] <= '9'));
+}
+
+// Returns the next directive, as lexer_next_token returns a `#` first on its
+// line (Tok_hash or a Tok_builtin_*, offset after the hash), or Tok_eof.
+// Only the directive names go through the state machine: in between, the
+// text kernel jumps to the next quote, slash or hash, literals are skipped
+// to their closing quote and comments to their end, so a `#` inside either
+// is never taken for a directive. The rest of a directive line is skipped
+// the same way on the next call. Lines are counted with a vector pass over
+// the skipped bytes unless C_LEXER_NO_LINES. Not for streaming lexers.
+Token lexer_next_directive(Lexer* lex){
+    const char* src = lex->source;
+    const LexerKernels* k = lex->kernels;
+    uint32_t i = lex->index;
+    uint32_t blank_to = UINT32_MAX;
+    for(;;){
+        i = k->skip_text(src, i);
+        switch(src[i]){
+            case '"':
+                i = lexer_skip_quoted(src, i);
+                break;
+            case '\'':
+                i = lexer_digit_separator(src, i) ? i + 1 : lexer_skip_quoted(src, i);
+                break;
+            case '/':
+                if(src[i + 1] == '/'){
+                    // up to a newline no backslash escapes
+                    for(;;){
+                        i = k->skip_line(src, i + 1);
+                        if(src[i] != '\n' || !(src[i - 1] == '\\' || (src[i - 1] == '\r' && src[i - 2] == '\\'))) break;
+                    }
+                }else if(src[i + 1] == '*'){
+                    bool leading = lexer_line_leading(src, i, blank_to);
+                    i = k->skip_comment(src, i + 2);
+                    while(src[i] == '\0' && i < lex->src_len) i = k->skip_comment(src, i + 1);
+                    if(src[i] == '*') i += 2;
+                    if(leading) blank_to = i;
+                }else{
+                    i += 1;
+                }
+                break;
+            case '#':
+                if(lexer_line_leading(src, i, blank_to)){
+                    if(LEXER_FIRST_LINE) lex->line += k->count_newlines(src, lex->index, i);
+                    lex->index = i;
+                    return lexer_next_token(lex);
+                }
+                i += 1;
+                break;
+            default: // '\0'
+                if(i < lex->src_len){
+                    i += 1;
+                    break;
+                }
+                if(LEXER_FIRST_LINE) lex->line += k->count_newlines(src, lex->index, i);
+                lex->index = i;
+                return (Token){ .kind = Tok_eof, .loc = { .offset = i, .len = 0, .line = lex->line } };
+        }
+    }
+}
+
+// lexer_tokenize_all for directives only: appends the token of every
+// remaining directive and the final Tok_eof, and returns how many were added.
+uint32_t lexer_scan_directives(Lexer* lex, TokenBuffer* out){
+    if(out->cap == 0) token_buffer_reserve(out, (lex->src_len - lex->index) / 256 + 16);
+    uint32_t start = out->len;
+    for(;;){
+        Token tok = lexer_next_directive(lex);
+        token_buffer_push(out, tok);
+        if(tok.kind == Tok_eof) break;
     }
+    return out->len - start;
+}
+
+_Static_assert((LEXER_LOOKAHEAD & (LEXER_LOOKAHEAD - 1)) == 0, "LEXER_LOOKAHEAD must be a power of two");
+
+void lexer_lookahead_init(LexerLookahead* la, Lexer* lexer){
+    assert(!lexer->stream);
+    la->lexer = lexer;
+    la->first = 0;
+    la->head = 0;
+    la->tail = 0;
+}
+
+// the state a checkpoint at `tail` restores
+static LexerCheckpoint lexer_lookahead_mark(const LexerLookahead* la){
+    const Lexer* lex = la->lexer;
+    return (LexerCheckpoint){
+        .pos = la->tail,
+        .index = lex->index,
+        .line = lex->line,
+        .diag_len = lex->diag_len,
+        .number_len = lex->numbers ? lex->numbers->len : 0,
+    };
+}
+
+// The token `n` places after the next one, lexing up to it if needed.
+// `n` must stay below LEXER_LOOKAHEAD; past the end it is Tok_eof.
+Token lexer_peek(LexerLookahead* la, uint32_t n){
+    assert(n < LEXER_LOOKAHEAD);
+    while(la->tail - la->head <= n){
+        uint32_t slot = la->tail & (LEXER_LOOKAHEAD - 1);
+        la->marks[slot] = lexer_lookahead_mark(la);
+        la->tokens[slot] = lexer_next_token(la->lexer);
+        la->tail += 1;
+    }
+    return la->tokens[(la->head + n) & (LEXER_LOOKAHEAD - 1)];
+}
+
+Token lexer_lookahead_next(LexerLookahead* la){
+    uint32_t slot = la->head & (LEXER_LOOKAHEAD - 1);
+    if(la->head == la->tail){
+        la->marks[slot] = lexer_lookahead_mark(la);
+        la->tokens[slot] = lexer_next_token(la->lexer);
+        la->tail += 1;
+    }
+    la->head += 1;
+    return la->tokens[slot];
+}
+
+// Where lexer_rewind comes back to: the next token to hand out.
+LexerCheckpoint lexer_checkpoint(const LexerLookahead* la){
+    if(la->head < la->tail) return la->marks[la->head & (LEXER_LOOKAHEAD - 1)];
+    return lexer_lookahead_mark(la);
+}
+
+// Makes the token at `cp` the next one again. Within the ring that only
+// moves `head`; further back the lexer goes back to `cp` and the ring is
+// emptied, the tokens are then lexed again as they are peeked.
+void lexer_rewind(LexerLookahead* la, LexerCheckpoint cp){
+    assert(cp.pos <= la->tail);
+    if(cp.pos >= la->first && la->tail - cp.pos <= LEXER_LOOKAHEAD){
+        la->head = cp.pos;
+        return;
+    }
+    Lexer* lex = la->lexer;
+    lex->index = cp.index;
+    lex->line = cp.line;
+    lex->diag_len = cp.diag_len;
+    if(lex->numbers) lex->numbers->len = cp.number_len;
+    la->first = cp.pos;
+    la->head = cp.pos;
+    la->tail = cp.pos;
+}
+
+// Rewrites the symbols of tokens [first, len) through the `remap` table of
+// an interner_merge, once their own interner has been merged into another.
+void token_buffer_remap_symbols(TokenBuffer* buf, uint32_t first, const uint32_t* remap){
+    if(!buf->symbols) return;
+    for(uint32_t i = first; i < buf->len; i++) buf->symbols[i] = remap[buf->symbols[i]];
+}
+
+
+// `#` and builtins record the offset after the hash, their scan starts on it
+static bool token_kind_hashed(TokenKind kind){
+    return kind == Tok_hash || (kind >= Tok_builtin_include && kind <= Tok_builtin_endif);
+}
+
+// Moves tokens [from, len) to start at `to`, adding the deltas to their
+// offsets and lines on the way, and grows the buffer if needed.
+static void token_buffer_shift_tail(TokenBuffer* buf, uint32_t from, uint32_t to, uint32_t offset_delta, uint32_t line_delta){
+    uint32_t n = buf->len - from;
+    if(to + n > buf->cap){
+        uint32_t cap = buf->cap ? buf->cap : 256;
+        while(cap < to + n) cap *= 2;
+        token_buffer_reserve(buf, cap);
+    }
+    if(to != from){
+        memmove(&buf->kinds[to], &buf->kinds[from], n * sizeof(uint8_t));
+        if(buf->lengths) memmove(&buf->lengths[to], &buf->lengths[from], n * sizeof(uint32_t));
+        if(buf->symbols) memmove(&buf->symbols[to], &buf->symbols[from], n * sizeof(uint32_t));
+    }
+    // one pass per column, backwards when the tail moves up
+    uint32_t* offsets = buf->offsets;
+    uint32_t* lines = buf->lines;
+    if(to > from){
+        for(uint32_t i = n; i-- > 0;) offsets[to + i] = offsets[from + i] + offset_delta;
+        if(lines) for(uint32_t i = n; i-- > 0;) lines[to + i] = lines[from + i] + line_delta;
+    }else{
+        for(uint32_t i = 0; i < n; i++) offsets[to + i] = offsets[from + i] + offset_delta;
+        if(lines && (line_delta || to != from)) for(uint32_t i = 0; i < n; i++) lines[to + i] = lines[from + i] + line_delta;
+    }
+    buf->len = to + n;
+}
+
+// Brings `buf`, a complete lexer_tokenize_all result for the source before
+// `edit`, up to date with `source`, the text after it. Lexing restarts at the
+// start of the first token that reaches the edit, counting the byte after its
+// end that a token looks at, or of the token before it when the edit is in
+// the blanks in front. It stops at the first new token that starts past the
+// inserted bytes at the old position of an old token of the same kind. Both
+// lexers then scan the same bytes from Lexing_start, so the old tail is kept
+// and only shifted: offsets by the size change and lines by the line
+// difference of that token. The work is the edited region plus one pass over
+// each column of the later tokens, no re-lexing. Diagnostics are not kept,
+// the Tok_error tokens carry them. `interner` is the one the buffer's symbols
+// come from, NULL without a symbols column. Number literals are not decoded
+// again, relexed ones get symbol 0.
+TokenSplice token_buffer_relex(TokenBuffer* buf, const char* source, uint32_t src_len, TokenEdit edit, Interner* interner){
+    assert(buf->len > 0 && buf->kinds[buf->len - 1] == Tok_eof);
+    uint32_t lo = 0, hi = buf->len - 1;
+    while(lo < hi){
+        uint32_t mid = lo + (hi - lo) / 2;
+        if(buf->offsets[mid] < edit.offset) lo = mid + 1;
+        else hi = mid;
+    }
+    // the token before may reach into the edit. Without a lengths column its
+    // old length is gone, re-lexing it on the new bytes would tell nothing.
+    uint32_t first = lo;
+    if(buf->lengths){
+        while(first > 0 && buf->offsets[first - 1] + buf->lengths[first - 1] >= edit.offset) first -= 1;
+    }else if(first > 0){
+        first -= 1;
+    }
+    // a number also looks at the byte after a `'` that ends it
+    if(first > 0 && (buf->kinds[first - 1] == Tok_number_literal || buf->kinds[first - 1] == Tok_float_literal
+                     || buf->kinds[first - 1] == Tok_error)){
+        first -= 1;
+    }
+    // a scan from the start of a token is context free, but the edit may
+    // also have hit the blanks in front of it
+    uint32_t restart = buf->offsets[first] - token_kind_hashed((TokenKind)buf->kinds[first]);
+    if(first > 0 && restart >= edit.offset){
+        first -= 1;
+        restart = buf->offsets[first] - token_kind_hashed((TokenKind)buf->kinds[first]);
+    }
+
+    Lexer lex = lexer_init_s(source, src_len);
+    lex.interner = interner;
+    lex.index = first ? restart : 0;
+    lex.line = first && buf->lines ? buf->lines[first] : LEXER_FIRST_LINE;
+
+    TokenBuffer fresh;
+    token_buffer_init(&fresh, buf->flags, 0);
+    uint32_t edit_end = edit.offset + edit.inserted;
+    uint32_t old = first; // candidate old token to line up with
+    bool synced = false;
+    for(;;){
+        Token tok = lexer_next_token(&lex);
+        token_buffer_push(&fresh, tok);
+        uint32_t start = tok.loc.offset - token_kind_hashed(tok.kind);
+        if(start >= edit_end){
+            uint32_t at = tok.loc.offset - edit.inserted + edit.deleted;
+            while(old < buf->len && buf->offsets[old] < at) old += 1;
+            if(old < buf->len && buf->offsets[old] == at && buf->kinds[old] == tok.kind){
+                synced = true;
+                break;
+            }
+        }
+        if(tok.kind == Tok_eof) break;
+    }
+
+    // the tokens [first, old] are replaced by `fresh`, its last one lines up with `old`
+    uint32_t removed = (synced ? old + 1 : buf->len) - first;
+    uint32_t tail = first + removed;
+    // the token that lined up starts on the same line in both streams
+    uint32_t line_delta = buf->lines && synced ? fresh.lines[fresh.len - 1] - buf->lines[old] : 0;
+    uint32_t offset_delta = edit.inserted - edit.deleted;
+    token_buffer_shift_tail(buf, tail, first + fresh.len, offset_delta, line_delta);
+    memcpy(&buf->kinds[first], fresh.kinds, fresh.len * sizeof(uint8_t));
+    memcpy(&buf->offsets[first], fresh.offsets, fresh.len * sizeof(uint32_t));
+    if(buf->lengths) memcpy(&buf->lengths[first], fresh.lengths, fresh.len * sizeof(uint32_t));
+    if(buf->lines) memcpy(&buf->lines[first], fresh.lines, fresh.len * sizeof(uint32_t));
+    if(buf->symbols) memcpy(&buf->symbols[first], fresh.symbols, fresh.len * sizeof(uint32_t));
+
+    TokenSplice splice = { .first = first, .removed = removed, .added = fresh.len };
+    token_buffer_deinit(&fresh);
+    lexer_deinit(&lex);
+    return splice;
+}
+
+#define TOKEN_KIND_NAME(name) [Tok_##name] = #name,
+#define KEYWORD_KIND_NAME(word, first, last) [Tok_keyword_##word] = "keyword_" #word,
+#define BUILTIN_KIND_NAME(word, first, last) [Tok_builtin_##word] = "builtin_" #word,
+
+static const char* const TokenKindNames[TOKEN_KIND_COUNT] = {
+    C_LEXER_TOKENS(TOKEN_KIND_NAME)
+    C_LEXER_KEYWORDS_C11(KEYWORD_KIND_NAME)
+    C_LEXER_KEYWORDS_SINCE_C23(KEYWORD_KIND_NAME)
+    C_LEXER_KEYWORDS_EXTENDED(KEYWORD_KIND_NAME)
+    C_LEXER_BUILTINS(BUILTIN_KIND_NAME)
+};
+
+const char* token_enum_to_str(TokenKind kind){
+    if((uint32_t)kind < TOKEN_KIND_COUNT) return TokenKindNames[kind];
     return "Error: Unknown enum kind";
 }
 
+const char* lexing_state_to_str(LexingState state){
+    switch(state){
+        case Lexing_start: return "start";
+        case Lexing_identifier: return "identifier";
+        case Lexing_number_literal: return "number_literal";
+        case Lexing_string_literal: return "string_literal";
+        case Lexing_char_literal: return "char_literal";
+        case Lexing_equal: return "equal";
+        case Lexing_plus: return "plus";
+        case Lexing_minus: return "minus";
+        case Lexing_asterisk: return "asterisk";
+        case Lexing_slash: return "slash";
+        case Lexing_percent: return "percent";
+        case Lexing_colon: return "colon";
+        case Lexing_tilde: return "tilde";
+        case Lexing_caret: return "caret";
+        case Lexing_ampersand: return "ampersand";
+        case Lexing_angle_bracket_left: return "angle_bracket_left";
+        case Lexing_angle_bracket_right: return "angle_bracket_right";
+        case Lexing_pipe: return "pipe";
+        case Lexing_bang: return "bang";
+        case Lexing_period: return "period";
+        case Lexing_single_line_comment: return "single_line_comment";
+        case Lexing_multi_line_comment: return "multi_line_comment";
+        case Lexing_builtin: return "builtin";
+    }
+    return "Error: Unknown lexing state";
+}
+
+void lexer_profile_add(LexerProfile* into, const LexerProfile* from){
+    for(uint32_t s = 0; s < LEXING_STATE_COUNT; s++){
+        into->transitions[s] += from->transitions[s];
+        into->bytes[s] += from->bytes[s];
+        into->state_cycles[s] += from->state_cycles[s];
+    }
+    for(uint32_t k = 0; k < TOKEN_KIND_COUNT; k++) into->kinds[k] += from->kinds[k];
+    into->calls += from->calls;
+    into->cycles += from->cycles;
+}
+
+void lexer_profile_print(const LexerProfile* p, FILE* out){
+    uint64_t bytes = 0;
+    for(uint32_t s = 0; s < LEXING_STATE_COUNT; s++) bytes += p->bytes[s];
+    double all_cycles = p->cycles ? (double)p->cycles : 1;
+    fprintf(out, "calls %llu, %.1f cycles/token, %.2f cycles/byte\n", (unsigned long long)p->calls,
+            p->calls ? (double)p->cycles / (double)p->calls : 0, bytes ? (double)p->cycles / (double)bytes : 0);
+    fprintf(out, "  %-22s %12s %14s %7s %14s %7s\n", "state", "entered", "bytes", "bytes%", "cycles", "cycles%");
+    for(uint32_t s = 0; s < LEXING_STATE_COUNT; s++){
+        if(!p->transitions[s]) continue;
+        fprintf(out, "  %-22s %12llu %14llu %6.2f%% %14llu %6.2f%%\n", lexing_state_to_str((LexingState)s),
+                (unsigned long long)p->transitions[s], (unsigned long long)p->bytes[s],
+                bytes ? 100.0 * (double)p->bytes[s] / (double)bytes : 0,
+                (unsigned long long)p->state_cycles[s], 100.0 * (double)p->state_cycles[s] / all_cycles);
+    }
+    fprintf(out, "  %-22s %12s\n", "token kind", "returned");
+    for(uint32_t k = 0; k < TOKEN_KIND_COUNT; k++){
+        if(!p->kinds[k]) continue;
+        fprintf(out, "  %-22s %12llu %6.2f%%\n", token_enum_to_str((TokenKind)k), (unsigned long long)p->kinds[k],
+                100.0 * (double)p->kinds[k] / (double)p->calls);
+    }
+}
+
 
 #ifdef __cplusplus
 }
@@ -946,7 +3472,7 @@ CFile cfile_init_alloc(const char* file_name){
     f.size = ftell(f.fp);
     fseek(f.fp, 0, SEEK_SET);
  
-    f.buffer = calloc(f.size + 1, sizeof(char));
+    f.buffer = calloc(f.size + CFILE_PADDING, sizeof(char));
     
     if(!f.buffer) {
         fprintf(stderr, "[Lexing Error]: failed to allocate memory buffer for file `%s`\n",file_name);
@@ -962,12 +3488,105 @@ CFile cfile_init_alloc(const char* file_name){
     return  f;
 }
 
+// Maps `file_name` read-only instead of copying it. The bytes after the file
+// content up to at least CFILE_PADDING are zero: the tail of the last file
+// page is zero filled by the kernel, and an anonymous mapping reserved
+// underneath covers the rest when the size is a multiple of the page size.
+// Returns 0 or a LexerError (errno is left set), never exits. The file must
+// not be truncated while it is mapped.
+int cfile_init_mmap(CFile* file, const char* file_name){
+    *file = (CFile){0};
+    file->name = file_name;
+
+    int fd = open(file_name, O_RDONLY);
+    if(fd < 0) return Error_file_open;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+        close(fd);
+        return Error_file_stat;
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t size = (size_t)st.st_size;
+    size_t file_span = (size + page - 1) & ~(page - 1);
+    size_t map_size = (size + CFILE_PADDING + page - 1) & ~(page - 1);
+
+    char* base = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(base == MAP_FAILED){
+        close(fd);
+        return Error_file_map;
+    }
+
+    if(size > 0){
+        int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+        flags |= MAP_POPULATE;
+#endif
+        if(mmap(base, file_span, PROT_READ, flags, fd, 0) == MAP_FAILED){
+            munmap(base, map_size);
+            close(fd);
+            return Error_file_map;
+        }
+        madvise(base, file_span, MADV_SEQUENTIAL);
+    }
+    close(fd);
+
+    file->size = size;
+    file->buffer = base;
+    file->map_size = map_size;
+    return 0;
+}
+
 void cfile_deinit(CFile* file){
-    free(file->buffer);
-    fclose(file->fp);
+    if(file->arena){
+        // the buffer goes with the arena
+    }else if(file->map_size){
+        munmap(file->buffer, file->map_size);
+    }else{
+        free(file->buffer);
+    }
+    if(file->fp) fclose(file->fp);
    *file = (CFile){0};
 }
 
+// Reads `file_name` into a buffer taken from `arena`, zero padded like
+// cfile_init_alloc, so a batch of files is released by one arena_reset.
+// Returns 0 or a LexerError (errno is left set), never exits.
+int cfile_init_arena(CFile* file, const char* file_name, Arena* arena){
+    *file = (CFile){0};
+    file->name = file_name;
+
+    int fd = open(file_name, O_RDONLY);
+    if(fd < 0) return Error_file_open;
+
+    struct stat st;
+    if(fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)){
+        close(fd);
+        return Error_file_stat;
+    }
+
+    size_t size = (size_t)st.st_size;
+    char* buffer = arena_alloc_aligned(arena, size + CFILE_PADDING, 64);
+    size_t n = 0;
+    while(n < size){
+        ssize_t got = read(fd, buffer + n, size - n);
+        if(got < 0 && errno == EINTR) continue;
+        if(got <= 0){
+            close(fd);
+            return Error_file_read;
+        }
+        n += (size_t)got;
+    }
+    close(fd);
+    memset(buffer + size, 0, CFILE_PADDING);
+
+    file->size = size;
+    file->buffer = buffer;
+    file->arena = arena;
+    return 0;
+}
+
 const char* token_buf_noalloc(const char* source,Token* tok){
     static char tok_buf[1024 * 10];
     memset(tok_buf, 0, 1024 * 10);
@@ -0,0 +1,628 @@
+// you need to define IMPEL_C_LEXER_DRIVER before including this header
+// (plus IMPEL_C_LEXER and IMPEL_C_LEXER_PARALLEL in one translation unit), link with -pthread
+// (it also pulls in the c_token_cache.h and c_file_loader.h implementations, don't define
+// IMPEL_C_TOKEN_CACHE or IMPEL_C_FILE_LOADER elsewhere)
+//
+// Lexes many files on a work-stealing thread pool and aggregates statistics.
+// Files are sorted largest first and dealt round-robin into one deque per
+// worker. A worker pops from the front of its own deque and, once it is
+// empty, steals from the back of the others, so the big files start early
+// and the small ones fill the gaps at the end. A single file too big to be
+// balanced that way is itself lexed with lexer_tokenize_parallel.
+// Every worker keeps one Lexer, one TokenBuffer and one read buffer for all
+// of its files, and one Interner when identifiers are interned: the workers'
+// interners are merged into the driver's once all files are done.
+// With `trace` set, every worker also records when it loaded and lexed each
+// file, and the spans are written as Chrome trace JSON (chrome://tracing or
+// ui.perfetto.dev) once the run is over.
+// With `cache_dir` set, a file whose content is already in the token cache
+// is mapped back from it instead of being lexed, and every lexed file is
+// added to it (see c_token_cache.h).
+// With `directives_only` set, files are scanned with lexer_scan_directives
+// instead: on_file gets one token per `#` directive, enough for dependency
+// discovery at a fraction of the cost, and the token cache is not used.
+// With `batched_io` set, the files below LEXER_DRIVER_MMAP_BYTES are read
+// by a FileLoader (io_uring, or a pread pool, see c_file_loader.h) in the
+// order they were added, with many reads in flight, and the workers take
+// them as they arrive once their deques are drained; the bigger files are
+// still mapped by the workers. It pays off on a cold page cache, where a
+// worker would otherwise sit out the latency of every open and read.
+
+#ifndef C_LEXER_DRIVER_H
+#define C_LEXER_DRIVER_H
+#include "c_lexer.h"
+#include "c_lexer_parallel.h"
+#if defined(IMPEL_C_LEXER_DRIVER) && !defined(IMPEL_C_TOKEN_CACHE)
+#define IMPEL_C_TOKEN_CACHE
+#endif
+#include "c_token_cache.h"
+#if defined(IMPEL_C_LEXER_DRIVER) && !defined(IMPEL_C_FILE_LOADER)
+#define IMPEL_C_FILE_LOADER
+#endif
+#include "c_file_loader.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <dirent.h>
+#include <errno.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// smaller files are read into the worker's buffer, bigger ones are mapped
+#ifndef LEXER_DRIVER_MMAP_BYTES
+#define LEXER_DRIVER_MMAP_BYTES (256u * 1024u)
+#endif
+
+// files above this size that would also exceed a fair share of the total
+// work are split across all threads
+#ifndef LEXER_DRIVER_SPLIT_BYTES
+#define LEXER_DRIVER_SPLIT_BYTES (16u * 1024u * 1024u)
+#endif
+
+typedef struct LexerStats {
+    uint64_t files;
+    uint64_t failed_files; // could not be opened or read
+    uint64_t bytes;
+    uint64_t tokens;
+    uint64_t lines;
+    uint64_t diagnostics;
+    uint64_t symbols; // distinct identifiers, with LexerDriver.interner
+    uint64_t cache_hits;   // files taken from LexerDriver.cache_dir
+    uint64_t cache_misses; // files lexed and stored into it
+    uint64_t invalid_utf8; // files that are not valid UTF-8
+    uint64_t kinds[TOKEN_KIND_COUNT];
+    double seconds;
+} LexerStats;
+
+// Called on the worker thread after each file, while its tokens and
+// diagnostics are still alive. Must be thread safe.
+typedef void (*LexerDriverFileFn)(void* ctx, const CFile* file, const TokenBuffer* tokens, const Lexer* lexer);
+
+typedef struct LexerDriver {
+    char** paths;
+    uint64_t* sizes;
+    uint32_t len;
+    uint32_t cap;
+    uint32_t threads;
+    uint32_t token_flags; // TokenBufferFlags for the buffers handed to on_file
+    LexerDriverFileFn on_file;
+    void* ctx;
+    // when set, on_file sees symbols of the worker's interner (lexer->interner)
+    // and all of them end up merged into this one
+    Interner* interner;
+    FILE* trace;           // receives the per-file spans as Chrome trace JSON
+    LexerProfile* profile; // sum of the workers' profiles, under C_LEXER_PROFILE
+    const char* cache_dir; // token cache directory, created when missing
+    bool directives_only;  // lexes the `#` directives only, see above
+    bool batched_io;       // reads the small files with a FileLoader, see above
+} LexerDriver;
+
+void lexer_driver_init(LexerDriver* driver, uint32_t threads);
+void lexer_driver_deinit(LexerDriver* driver);
+bool lexer_driver_add_file(LexerDriver* driver, const char* path);
+bool lexer_driver_add_path(LexerDriver* driver, const char* path);
+bool lexer_driver_add_list(LexerDriver* driver, FILE* list);
+void lexer_driver_run(LexerDriver* driver, LexerStats* stats);
+void lexer_stats_add(LexerStats* into, const LexerStats* from);
+void lexer_stats_print(const LexerStats* stats, FILE* out, bool kinds);
+
+#ifdef IMPEL_C_LEXER_DRIVER
+
+void lexer_driver_init(LexerDriver* d, uint32_t threads){
+    *d = (LexerDriver){0};
+    if(threads == 0){
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? (uint32_t)cpus : 1;
+    }
+    d->threads = threads;
+}
+
+void lexer_driver_deinit(LexerDriver* d){
+    for(uint32_t i = 0; i < d->len; i++) free(d->paths[i]);
+    free(d->paths);
+    free(d->sizes);
+    *d = (LexerDriver){0};
+}
+
+// adds one regular file, whatever its extension
+bool lexer_driver_add_file(LexerDriver* d, const char* path){
+    struct stat st;
+    if(stat(path, &st) < 0 || !S_ISREG(st.st_mode)) return false;
+    if(d->len == d->cap){
+        d->cap = d->cap ? d->cap * 2 : 1024;
+        d->paths = (char**)realloc(d->paths, d->cap * sizeof(char*));
+        d->sizes = (uint64_t*)realloc(d->sizes, d->cap * sizeof(uint64_t));
+        if(!d->paths || !d->sizes){
+            fprintf(stderr, "[Lexing Error]: failed to grow driver file list to %u entries\n", d->cap);
+            exit(1);
+        }
+    }
+    d->paths[d->len] = strdup(path);
+    if(!d->paths[d->len]){
+        fprintf(stderr, "[Lexing Error]: failed to copy the path `%s`\n", path);
+        exit(1);
+    }
+    d->sizes[d->len] = (uint64_t)st.st_size;
+    d->len += 1;
+    return true;
+}
+
+static bool lexer_driver_is_source(const char* name){
+    const char* dot = strrchr(name, '.');
+    return dot && (!strcmp(dot, ".c") || !strcmp(dot, ".h"));
+}
+
+// adds a file, or every `.c` and `.h` file below a directory; symlinks are not followed
+bool lexer_driver_add_path(LexerDriver* d, const char* path){
+    struct stat st;
+    if(lstat(path, &st) < 0) return false;
+    if(S_ISREG(st.st_mode)) return lexer_driver_add_file(d, path);
+    if(!S_ISDIR(st.st_mode)) return false;
+
+    DIR* dir = opendir(path);
+    if(!dir) return false;
+    size_t base = strlen(path);
+    struct dirent* e;
+    while((e = readdir(dir))){
+        if(!strcmp(e->d_name, ".") || !strcmp(e->d_name, "..")) continue;
+        size_t n = base + 1 + strlen(e->d_name) + 1;
+        char* child = (char*)malloc(n);
+        if(!child){
+            fprintf(stderr, "[Lexing Error]: failed to allocate a path of %zu bytes\n", n);
+            exit(1);
+        }
+        snprintf(child, n, "%s/%s", path, e->d_name);
+        unsigned char type = e->d_type;
+        if(type == DT_UNKNOWN && lstat(child, &st) == 0){
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+        if(type == DT_DIR){
+            lexer_driver_add_path(d, child);
+        }else if(type == DT_REG && lexer_driver_is_source(e->d_name)){
+            lexer_driver_add_file(d, child);
+        }
+        free(child);
+    }
+    closedir(dir);
+    return true;
+}
+
+// adds every path of a newline separated list
+bool lexer_driver_add_list(LexerDriver* d, FILE* list){
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    bool ok = true;
+    while((n = getline(&line, &cap, list)) > 0){
+        while(n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r')) line[--n] = '\0';
+        if(n == 0) continue;
+        ok &= lexer_driver_add_path(d, line);
+    }
+    free(line);
+    return ok;
+}
+
+void lexer_stats_add(LexerStats* into, const LexerStats* from){
+    into->files += from->files;
+    into->failed_files += from->failed_files;
+    into->bytes += from->bytes;
+    into->tokens += from->tokens;
+    into->lines += from->lines;
+    into->diagnostics += from->diagnostics;
+    into->cache_hits += from->cache_hits;
+    into->cache_misses += from->cache_misses;
+    into->invalid_utf8 += from->invalid_utf8;
+    for(uint32_t k = 0; k < TOKEN_KIND_COUNT; k++) into->kinds[k] += from->kinds[k];
+}
+
+typedef struct LexerTraceSpan {
+    uint32_t task;
+    uint32_t tokens;
+    bool cached;
+    uint64_t start_ns;
+    uint64_t loaded_ns;
+    uint64_t end_ns;
+} LexerTraceSpan;
+
+static uint64_t lexer_driver_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+typedef struct LexerDriverWorker {
+    LexerDriver* driver;
+    struct LexerDriverWorker* all;
+    uint32_t worker_len;      // of `all`, at most one per file
+    FileLoader* loader;       // the small files with batched_io, else NULL
+    uint32_t id;
+    uint32_t* tasks;          // file indices, largest first
+    _Atomic uint64_t range;   // head << 32 | tail into `tasks`
+    uint64_t split_bytes;
+    Lexer lexer;
+    TokenBuffer tokens;
+    Interner interner;
+    char* scratch;
+    size_t scratch_cap;
+    LexerStats stats;
+    LexerProfile profile;
+    LexerTraceSpan* spans;
+    uint32_t span_len;
+    uint32_t span_cap;
+    bool started;
+    pthread_t thread;
+} LexerDriverWorker;
+
+static bool lexer_driver_pop(LexerDriverWorker* w, uint32_t* task){
+    uint64_t r = atomic_load(&w->range);
+    for(;;){
+        uint32_t head = (uint32_t)(r >> 32), tail = (uint32_t)r;
+        if(head >= tail) return false;
+        if(atomic_compare_exchange_weak(&w->range, &r, (uint64_t)(head + 1) << 32 | tail)){
+            *task = w->tasks[head];
+            return true;
+        }
+    }
+}
+
+static bool lexer_driver_steal(LexerDriverWorker* victim, uint32_t* task){
+    uint64_t r = atomic_load(&victim->range);
+    for(;;){
+        uint32_t head = (uint32_t)(r >> 32), tail = (uint32_t)r;
+        if(head >= tail) return false;
+        if(atomic_compare_exchange_weak(&victim->range, &r, (uint64_t)head << 32 | (tail - 1))){
+            *task = victim->tasks[tail - 1];
+            return true;
+        }
+    }
+}
+
+// small files go through the worker's read buffer, big ones are mapped.
+// Offsets are 32 bit, a bigger file fails rather than lex its first 4 GiB.
+static int lexer_driver_load(LexerDriverWorker* w, const char* path, uint64_t size, CFile* file){
+    if(size > UINT32_MAX - CFILE_PADDING) return Error_file_map;
+    if(size >= LEXER_DRIVER_MMAP_BYTES){
+        int err = cfile_init_mmap(file, path);
+        if(!err && file->size > UINT32_MAX - CFILE_PADDING){
+            cfile_deinit(file);
+            return Error_file_map;
+        }
+        return err;
+    }
+
+    *file = (CFile){ .name = path };
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return Error_file_open;
+    if(size + CFILE_PADDING > w->scratch_cap){
+        w->scratch_cap = (size_t)size + CFILE_PADDING > w->scratch_cap * 2 ? (size_t)size + CFILE_PADDING : w->scratch_cap * 2;
+        free(w->scratch);
+        w->scratch = (char*)malloc(w->scratch_cap);
+        if(!w->scratch){
+            fprintf(stderr, "[Lexing Error]: failed to allocate a %zu bytes read buffer\n", w->scratch_cap);
+            exit(1);
+        }
+    }
+    size_t got = 0;
+    while(got < size){
+        ssize_t n = read(fd, w->scratch + got, (size_t)size - got);
+        if(n < 0 && errno == EINTR) continue;
+        if(n < 0){
+            close(fd);
+            return Error_file_read;
+        }
+        if(n == 0) break; // shrunk since it was listed
+        got += (size_t)n;
+    }
+    close(fd);
+    memset(w->scratch + got, 0, CFILE_PADDING);
+    file->size = got;
+    file->buffer = w->scratch;
+    return 0;
+}
+
+// lexes one loaded file, `start_ns` is when its load began
+static void lexer_driver_lex_file(LexerDriverWorker* w, uint32_t task, const CFile* loaded, uint64_t start_ns){
+    LexerDriver* d = w->driver;
+    CFile file = *loaded;
+    uint64_t loaded_ns = d->trace ? lexer_driver_now_ns() : 0;
+
+    LexerStats* s = &w->stats;
+    token_buffer_reset(&w->tokens);
+    bool cached = false;
+    uint64_t hash = 0;
+    if(d->cache_dir && !d->directives_only){
+        hash = token_cache_hash(file.buffer, file.size);
+        cached = token_cache_load(d->cache_dir, hash, file.buffer, (uint32_t)file.size, &w->tokens, &w->lexer) == TokenCache_hit;
+        s->cache_hits += cached;
+        s->cache_misses += !cached;
+        if(cached) s->invalid_utf8 += w->lexer.kernels->validate_utf8(file.buffer, (uint32_t)file.size) < file.size;
+    }
+    if(!cached){
+        lexer_reset(&w->lexer, file.buffer, (uint32_t)file.size);
+        s->invalid_utf8 += lexer_validate_utf8(&w->lexer) < file.size;
+        if(d->directives_only){
+            lexer_scan_directives(&w->lexer, &w->tokens);
+        }else if(file.size >= w->split_bytes){
+            lexer_tokenize_parallel(&w->lexer, &w->tokens, d->threads);
+        }else{
+            lexer_tokenize_all(&w->lexer, &w->tokens);
+        }
+        if(d->cache_dir && !d->directives_only) token_cache_store(d->cache_dir, hash, (uint32_t)file.size, &w->tokens, &w->lexer);
+    }
+
+    s->files += 1;
+    s->bytes += file.size;
+    s->tokens += w->tokens.len - 1; // without Tok_eof
+    // not counted under C_LEXER_NO_LINES
+    if(LEXER_FIRST_LINE) s->lines += w->lexer.line - 1 + (file.size && file.buffer[file.size - 1] != '\n');
+    s->diagnostics += w->lexer.diag_len;
+    for(uint32_t i = 0; i < w->tokens.len; i++) s->kinds[w->tokens.kinds[i]] += 1;
+
+    if(d->on_file) d->on_file(d->ctx, &file, &w->tokens, &w->lexer);
+
+    if(d->trace){
+        if(w->span_len == w->span_cap){
+            w->span_cap = w->span_cap ? w->span_cap * 2 : 256;
+            w->spans = (LexerTraceSpan*)realloc(w->spans, w->span_cap * sizeof(LexerTraceSpan));
+            if(!w->spans){
+                fprintf(stderr, "[Lexing Error]: failed to grow the trace to %u spans\n", w->span_cap);
+                exit(1);
+            }
+        }
+        w->spans[w->span_len++] = (LexerTraceSpan){
+            .task = task,
+            .tokens = w->tokens.len - 1,
+            .cached = cached,
+            .start_ns = start_ns,
+            .loaded_ns = loaded_ns,
+            .end_ns = lexer_driver_now_ns(),
+        };
+    }
+}
+
+static void lexer_driver_lex(LexerDriverWorker* w, uint32_t task){
+    LexerDriver* d = w->driver;
+    CFile file;
+    uint64_t start_ns = d->trace ? lexer_driver_now_ns() : 0;
+    if(lexer_driver_load(w, d->paths[task], d->sizes[task], &file) != 0){
+        w->stats.failed_files += 1;
+        return;
+    }
+    lexer_driver_lex_file(w, task, &file, start_ns);
+    if(file.map_size) cfile_deinit(&file);
+}
+
+// takes the next file off the loader, the span's load time is the wait for it
+static bool lexer_driver_lex_loaded(LexerDriverWorker* w){
+    uint64_t start_ns = w->driver->trace ? lexer_driver_now_ns() : 0;
+    LoadedFile loaded;
+    if(!file_loader_next(w->loader, &loaded)) return false;
+    // a listed small file may have grown past what lexer_driver_load allows
+    if(loaded.error || loaded.file.size > UINT32_MAX - CFILE_PADDING){
+        file_loader_release(w->loader, &loaded);
+        w->stats.failed_files += 1;
+        return true;
+    }
+    lexer_driver_lex_file(w, loaded.task, &loaded.file, start_ns);
+    file_loader_release(w->loader, &loaded);
+    return true;
+}
+
+static void lexer_trace_string(FILE* out, const char* str){
+    fputc('"', out);
+    for(const unsigned char* p = (const unsigned char*)str; *p; p++){
+        if(*p == '"' || *p == '\\') fprintf(out, "\\%c", *p);
+        else if(*p < 0x20) fprintf(out, "\\u%04x", *p);
+        else fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+// one complete ("X") event per file on its worker's track, microseconds since `epoch_ns`
+static void lexer_driver_write_trace(LexerDriver* d, const LexerDriverWorker* workers, uint32_t threads, uint64_t epoch_ns){
+    FILE* out = d->trace;
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(uint32_t t = 0; t < threads; t++){
+        fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}}",
+                t ? ",\n" : "", t, t);
+    }
+    for(uint32_t t = 0; t < threads; t++){
+        const LexerDriverWorker* w = &workers[t];
+        for(uint32_t i = 0; i < w->span_len; i++){
+            const LexerTraceSpan* span = &w->spans[i];
+            fprintf(out, ",\n{\"name\":");
+            lexer_trace_string(out, d->paths[span->task]);
+            fprintf(out, ",\"cat\":\"lex\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,"
+                         "\"args\":{\"bytes\":%llu,\"tokens\":%u,\"load_us\":%.3f,\"cached\":%s}}",
+                    t, (double)(span->start_ns - epoch_ns) / 1e3, (double)(span->end_ns - span->start_ns) / 1e3,
+                    (unsigned long long)d->sizes[span->task], span->tokens,
+                    (double)(span->loaded_ns - span->start_ns) / 1e3, span->cached ? "true" : "false");
+        }
+    }
+    fprintf(out, "\n]}\n");
+    fflush(out);
+}
+
+static void* lexer_driver_worker(void* arg){
+    LexerDriverWorker* w = (LexerDriverWorker*)arg;
+    uint32_t task;
+    for(;;){
+        if(lexer_driver_pop(w, &task)){
+            lexer_driver_lex(w, task);
+            continue;
+        }
+        bool stole = false;
+        for(uint32_t i = 1; i < w->worker_len && !stole; i++){
+            LexerDriverWorker* victim = &w->all[(w->id + i) % w->worker_len];
+            if(lexer_driver_steal(victim, &task)){
+                lexer_driver_lex(w, task);
+                stole = true;
+            }
+        }
+        if(stole) continue;
+        // every deque is drained and no task is ever pushed back, what is
+        // left are the files still coming from the loader
+        if(!w->loader || !lexer_driver_lex_loaded(w)) return NULL;
+    }
+}
+
+typedef struct LexerDriverTask {
+    uint64_t size;
+    uint32_t index;
+} LexerDriverTask;
+
+static int lexer_driver_by_size(const void* a, const void* b){
+    uint64_t sa = ((const LexerDriverTask*)a)->size;
+    uint64_t sb = ((const LexerDriverTask*)b)->size;
+    return sa < sb ? 1 : sa > sb ? -1 : 0;
+}
+
+void lexer_driver_run(LexerDriver* d, LexerStats* stats){
+    uint64_t t0 = lexer_driver_now_ns();
+    *stats = (LexerStats){0};
+
+    // no more workers than files, a file split across threads still gets
+    // all of d->threads
+    uint32_t threads = d->threads ? d->threads : 1;
+    if(threads > d->len && d->len > 0) threads = d->len;
+
+    LexerDriverTask* order = (LexerDriverTask*)malloc((d->len + 1) * sizeof(LexerDriverTask));
+    LexerDriverWorker* workers = (LexerDriverWorker*)calloc(threads, sizeof(LexerDriverWorker));
+    if(!order || !workers){
+        fprintf(stderr, "[Lexing Error]: failed to allocate %u driver workers\n", threads);
+        exit(1);
+    }
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < d->len; i++){
+        order[i] = (LexerDriverTask){ .size = d->sizes[i], .index = i };
+        total += d->sizes[i];
+    }
+
+    // with batched_io the small files go to the loader in the order they
+    // were added, which keeps the files of one directory together
+    FileLoader loader;
+    FileLoader* batched = NULL;
+    uint32_t* loads = NULL;
+    uint32_t dealt = d->len;
+    if(d->batched_io){
+        loads = (uint32_t*)malloc((d->len + 1) * sizeof(uint32_t));
+        if(!loads){
+            fprintf(stderr, "[Lexing Error]: failed to allocate a load order of %u files\n", d->len);
+            exit(1);
+        }
+        uint32_t load_len = 0;
+        dealt = 0;
+        for(uint32_t i = 0; i < d->len; i++){
+            if(d->sizes[i] < LEXER_DRIVER_MMAP_BYTES) loads[load_len++] = i;
+            else order[dealt++] = order[i];
+        }
+        if(load_len && file_loader_start(&loader, d->paths, loads, load_len, 0, true)){
+            batched = &loader;
+        }else{
+            dealt = d->len;
+            for(uint32_t i = 0; i < d->len; i++) order[i] = (LexerDriverTask){ .size = d->sizes[i], .index = i };
+        }
+    }
+    qsort(order, dealt, sizeof(LexerDriverTask), lexer_driver_by_size);
+
+    uint64_t fair_share = total / threads;
+    uint32_t per_worker = dealt / threads + 1;
+    for(uint32_t t = 0; t < threads; t++){
+        LexerDriverWorker* w = &workers[t];
+        w->driver = d;
+        w->all = workers;
+        w->worker_len = threads;
+        w->id = t;
+        w->loader = batched;
+        w->split_bytes = fair_share > LEXER_DRIVER_SPLIT_BYTES ? fair_share : LEXER_DRIVER_SPLIT_BYTES;
+        w->tasks = (uint32_t*)malloc(per_worker * sizeof(uint32_t));
+        if(!w->tasks){
+            fprintf(stderr, "[Lexing Error]: failed to allocate a task list of %u entries\n", per_worker);
+            exit(1);
+        }
+        uint32_t n = 0;
+        for(uint32_t i = t; i < dealt; i += threads) w->tasks[n++] = order[i].index;
+        atomic_init(&w->range, (uint64_t)n);
+        w->lexer = lexer_init_s("", 0);
+        if(d->profile) w->lexer.profile = &w->profile;
+        if(d->interner){
+            interner_init(&w->interner, 0);
+            w->lexer.interner = &w->interner;
+        }
+        // cache entries of an interning run have to carry the symbols
+        uint32_t flags = d->token_flags | (d->cache_dir && d->interner ? TokenBuffer_symbols : 0);
+        token_buffer_init(&w->tokens, flags, 0);
+    }
+
+    // a worker whose thread could not start still has its deque stolen from
+    for(uint32_t t = 1; t < threads; t++){
+        workers[t].started = pthread_create(&workers[t].thread, NULL, lexer_driver_worker, &workers[t]) == 0;
+    }
+    lexer_driver_worker(&workers[0]);
+    for(uint32_t t = 1; t < threads; t++){
+        if(workers[t].started) pthread_join(workers[t].thread, NULL);
+    }
+    if(batched) file_loader_stop(batched);
+    free(loads);
+
+    for(uint32_t t = 0; t < threads; t++){
+        LexerDriverWorker* w = &workers[t];
+        lexer_stats_add(stats, &w->stats);
+        if(d->profile) lexer_profile_add(d->profile, &w->profile);
+        if(d->interner){
+            interner_merge(d->interner, &w->interner, NULL);
+            interner_deinit(&w->interner);
+        }
+    }
+    if(d->interner) stats->symbols = d->interner->len - 1; // without the empty name
+    uint64_t t1 = lexer_driver_now_ns();
+    stats->seconds = (double)(t1 - t0) * 1e-9;
+
+    if(d->trace) lexer_driver_write_trace(d, workers, threads, t0);
+    for(uint32_t t = 0; t < threads; t++){
+        LexerDriverWorker* w = &workers[t];
+        lexer_deinit(&w->lexer);
+        token_buffer_deinit(&w->tokens);
+        free(w->scratch);
+        free(w->tasks);
+        free(w->spans);
+    }
+    free(workers);
+    free(order);
+}
+
+void lexer_stats_print(const LexerStats* s, FILE* out, bool kinds){
+    double secs = s->seconds > 0 ? s->seconds : 1e-9;
+    fprintf(out, "files        %llu", (unsigned long long)s->files);
+    if(s->failed_files) fprintf(out, " (%llu unreadable)", (unsigned long long)s->failed_files);
+    fprintf(out, "\n");
+    fprintf(out, "bytes        %llu\n", (unsigned long long)s->bytes);
+    fprintf(out, "tokens       %llu\n", (unsigned long long)s->tokens);
+    fprintf(out, "lines        %llu\n", (unsigned long long)s->lines);
+    fprintf(out, "diagnostics  %llu\n", (unsigned long long)s->diagnostics);
+    if(s->invalid_utf8) fprintf(out, "not utf-8    %llu files\n", (unsigned long long)s->invalid_utf8);
+    if(s->symbols) fprintf(out, "symbols      %llu\n", (unsigned long long)s->symbols);
+    if(s->cache_hits || s->cache_misses){
+        fprintf(out, "cache        %llu hits, %llu misses\n", (unsigned long long)s->cache_hits, (unsigned long long)s->cache_misses);
+    }
+    fprintf(out, "time         %.3f s\n", s->seconds);
+    fprintf(out, "throughput   %.1f MB/s, %.1f Mtokens/s, %.0f files/s\n",
+            (double)s->bytes / secs / 1e6, (double)s->tokens / secs / 1e6, (double)s->files / secs);
+    if(!kinds) return;
+    uint64_t all = 0;
+    for(uint32_t k = 0; k < TOKEN_KIND_COUNT; k++) all += s->kinds[k];
+    for(uint32_t k = 0; k < TOKEN_KIND_COUNT; k++){
+        if(!s->kinds[k]) continue;
+        fprintf(out, "  %-36s %12llu  %5.2f%%\n", token_enum_to_str((TokenKind)k), (unsigned long long)s->kinds[k],
+                100.0 * (double)s->kinds[k] / (double)all);
+    }
+}
+
+#endif // IMPEL_C_LEXER_DRIVER
+
+#ifdef __cplusplus
+}
+#endif
+#endif // C_LEXER_DRIVER_H
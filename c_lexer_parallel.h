@@ -0,0 +1,229 @@
+// you need to define IMPEL_C_LEXER_PARALLEL before including this header
+// (c_lexer.h still needs IMPEL_C_LEXER in one translation unit), link with -pthread
+//
+// Lexes one large buffer on several threads. The buffer is cut into chunks
+// at newline boundaries and every chunk is lexed speculatively, as if it
+// started between two tokens. A string literal can still span a cut, so the
+// chunks are stitched back together on the calling thread: a serial lexer
+// produces the first token at each cut and the chunk's tokens are only
+// copied from the first one that starts at the same offset with the same
+// kind and length. From such a token on both lexers see the same bytes in
+// Lexing_start, so the rest of the chunk is exactly what a serial run gives.
+// Lines are counted from 0 inside a chunk and get rebased on that same token,
+// and so are the diagnostics the chunk reported after it. With an Interner
+// every chunk interns into its own, and only the symbols of copied tokens
+// are interned into the lexer's, so the ids come out as in a serial run.
+// A NumberTable is handled the same way: chunks decode into their own and
+// the values of copied literals are appended to the lexer's in token order.
+
+#ifndef C_LEXER_PARALLEL_H
+#define C_LEXER_PARALLEL_H
+#include "c_lexer.h"
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// chunks smaller than this are not worth a thread
+#ifndef LEXER_PARALLEL_MIN_CHUNK
+#define LEXER_PARALLEL_MIN_CHUNK (256u * 1024u)
+#endif
+
+uint32_t lexer_tokenize_parallel(Lexer* lexer, TokenBuffer* out, uint32_t threads);
+
+#ifdef IMPEL_C_LEXER_PARALLEL
+
+typedef struct LexerChunk {
+    const Lexer* lexer;
+    uint32_t begin;
+    uint32_t end;
+    TokenBuffer tokens;    // lengths and lines, lines counted from 0 at `begin`
+    Lexer lex;             // holds the chunk's speculative diagnostics
+    Interner interner;     // speculative symbols, when the lexer interns
+    NumberTable numbers;   // speculative number values, when the lexer decodes them
+    uint32_t* remap;       // chunk symbol -> lexer symbol, 0 until first copied
+    uint32_t resume_index; // lexer state right after the last token kept
+    uint32_t resume_line;
+    LexerProfile profile;  // the chunk's share, when the lexer is profiled
+    bool started;
+    pthread_t thread;
+} LexerChunk;
+
+static void* lexer_chunk_worker(void* arg){
+    LexerChunk* c = (LexerChunk*)arg;
+    Lexer* lex = &c->lex;
+    for(;;){
+        Token tok = lexer_next_token(lex);
+        if(tok.kind != Tok_eof && tok.loc.offset >= c->end) break;
+        token_buffer_push(&c->tokens, tok);
+        c->resume_index = lex->index;
+        c->resume_line = lex->line;
+        if(tok.kind == Tok_eof) break;
+    }
+    return NULL;
+}
+
+static void token_buffer_append_rebased(TokenBuffer* out, const TokenBuffer* from, uint32_t first, uint32_t line_delta){
+    uint32_t n = from->len - first;
+    if(out->len + n > out->cap){
+        uint32_t cap = out->cap ? out->cap : 256;
+        while(cap < out->len + n) cap *= 2;
+        token_buffer_reserve(out, cap);
+    }
+    memcpy(&out->kinds[out->len], &from->kinds[first], n * sizeof(uint8_t));
+    memcpy(&out->offsets[out->len], &from->offsets[first], n * sizeof(uint32_t));
+    if(out->lengths) memcpy(&out->lengths[out->len], &from->lengths[first], n * sizeof(uint32_t));
+    if(out->lines){
+        for(uint32_t i = 0; i < n; i++) out->lines[out->len + i] = from->lines[first + i] + line_delta;
+    }
+    if(out->symbols) memset(&out->symbols[out->len], 0, n * sizeof(uint32_t));
+    out->len += n;
+}
+
+// Interns the symbols of the tokens copied from chunk `c`, from `first` on,
+// into `into` and appends their number values to `numbers`, in token order.
+// `dst` may be NULL when the output keeps no symbols, the names still go
+// into `into`.
+static void lexer_chunk_intern(LexerChunk* c, Interner* into, NumberTable* numbers, uint32_t* dst, uint32_t first){
+    const TokenBuffer* t = &c->tokens;
+    for(uint32_t i = first; i < t->len; i++){
+        uint32_t sym = t->symbols[i];
+        if(t->kinds[i] == Tok_number_literal || t->kinds[i] == Tok_float_literal){
+            if(!numbers) continue;
+            sym = number_table_push(numbers, c->numbers.values[sym], c->numbers.flags[sym]);
+            if(dst) dst[i - first] = sym;
+            continue;
+        }
+        if(!into) continue;
+        if(sym && !c->remap[sym]){
+            StrView name = interner_get(&c->interner, sym);
+            c->remap[sym] = interner_intern(into, name.ptr, name.len);
+        }
+        if(dst) dst[i - first] = c->remap[sym];
+    }
+}
+
+// Appends the same tokens lexer_tokenize_all would, Tok_eof included, and
+// leaves `lexer` where a serial run would, with the same diagnostics.
+uint32_t lexer_tokenize_parallel(Lexer* lex, TokenBuffer* out, uint32_t threads){
+    uint32_t remaining = lex->src_len - lex->index;
+    if(threads > remaining / LEXER_PARALLEL_MIN_CHUNK) threads = remaining / LEXER_PARALLEL_MIN_CHUNK;
+    if(threads <= 1) return lexer_tokenize_all(lex, out);
+
+    LexerChunk* chunks = (LexerChunk*)calloc(threads, sizeof(LexerChunk));
+    if(!chunks){
+        fprintf(stderr, "[Lexing Error]: failed to allocate %u lexer chunks\n", threads);
+        exit(1);
+    }
+
+    uint32_t n = 0;
+    uint32_t begin = lex->index;
+    for(uint32_t i = 0; i < threads && begin < lex->src_len; i++){
+        uint32_t end = lex->src_len;
+        if(i + 1 < threads){
+            uint32_t target = lex->index + (uint32_t)((uint64_t)remaining * (i + 1) / threads);
+            if(target < begin) target = begin;
+            const char* nl = (const char*)memchr(&lex->source[target], '\n', lex->src_len - target);
+            if(nl) end = (uint32_t)(nl - lex->source) + 1;
+        }
+        LexerChunk* c = &chunks[n++];
+        c->lexer = lex;
+        c->begin = begin;
+        c->end = end;
+        c->lex = lexer_init_s(lex->source, lex->src_len);
+        c->lex.kernels = lex->kernels;
+        c->lex.index = begin;
+        c->lex.line = 0;
+        if(lex->profile) c->lex.profile = &c->profile;
+        c->resume_index = begin;
+        uint32_t flags = TokenBuffer_lengths | TokenBuffer_lines;
+        if(lex->interner){
+            interner_init(&c->interner, 0);
+            c->lex.interner = &c->interner;
+            flags |= TokenBuffer_symbols;
+        }
+        if(lex->numbers){
+            c->lex.numbers = &c->numbers;
+            flags |= TokenBuffer_symbols;
+        }
+        token_buffer_init(&c->tokens, flags, end - begin);
+        begin = end;
+    }
+
+    for(uint32_t i = 0; i < n; i++){
+        // a chunk without a thread is left empty and lexed by the serial pass
+        chunks[i].started = pthread_create(&chunks[i].thread, NULL, lexer_chunk_worker, &chunks[i]) == 0;
+    }
+    for(uint32_t i = 0; i < n; i++){
+        if(chunks[i].started) pthread_join(chunks[i].thread, NULL);
+    }
+
+    uint32_t start = out->len;
+    if(out->cap == 0) token_buffer_reserve(out, remaining / TOKEN_BUFFER_BYTES_PER_TOKEN + 16);
+    Lexer serial = *lex;
+    uint32_t ci = 0, k = 0;
+    for(;;){
+        Token tok = lexer_next_token(&serial);
+        while(ci + 1 < n && tok.loc.offset >= chunks[ci].end){
+            ci += 1;
+            k = 0;
+        }
+        token_buffer_push(out, tok);
+        if(tok.kind == Tok_eof) break;
+
+        LexerChunk* c = &chunks[ci];
+        const TokenBuffer* t = &c->tokens;
+        while(k < t->len && t->offsets[k] < tok.loc.offset) k += 1;
+        if(k == t->len || t->offsets[k] != tok.loc.offset || t->kinds[k] != tok.kind || t->lengths[k] != tok.loc.len) continue;
+
+        // the lines only differ by where the chunk started counting
+        uint32_t line_delta = tok.loc.line - t->lines[k];
+        uint32_t copied = out->len;
+        token_buffer_append_rebased(out, t, k + 1, line_delta);
+        if(lex->interner && !c->remap){
+            c->remap = (uint32_t*)calloc(c->interner.len, sizeof(uint32_t));
+            if(!c->remap){
+                fprintf(stderr, "[Lexing Error]: failed to allocate a symbol remap of %u entries\n", c->interner.len);
+                exit(1);
+            }
+        }
+        if(lex->interner || lex->numbers){
+            lexer_chunk_intern(c, serial.interner, serial.numbers, out->symbols ? &out->symbols[copied] : NULL, k + 1);
+        }
+        // keep the diagnostics of the copied tokens only: the chunk may also have
+        // reported on the token it stopped at. Error tokens are never empty, so
+        // offsets tell them apart even where a `#` shares its offset.
+        uint32_t first = k + 1 < t->len ? t->offsets[k + 1] : UINT32_MAX;
+        uint32_t last = t->offsets[t->len - 1];
+        for(uint32_t d = 0; d < c->lex.diag_len; d++){
+            LexerDiagnostic diag = c->lex.diags[d];
+            if(diag.loc.offset < first || diag.loc.offset > last) continue;
+            diag.loc.line += line_delta;
+            lexer_report(&serial, diag.code, diag.loc);
+        }
+        k = t->len;
+        serial.index = c->resume_index;
+        serial.line = c->resume_line + line_delta;
+        if(out->kinds[out->len - 1] == Tok_eof) break;
+    }
+    *lex = serial;
+
+    for(uint32_t i = 0; i < n; i++){
+        if(lex->profile) lexer_profile_add(lex->profile, &chunks[i].profile);
+        token_buffer_deinit(&chunks[i].tokens);
+        lexer_deinit(&chunks[i].lex);
+        if(lex->interner) interner_deinit(&chunks[i].interner);
+        if(lex->numbers) number_table_deinit(&chunks[i].numbers);
+        free(chunks[i].remap);
+    }
+    free(chunks);
+    return out->len - start;
+}
+
+#endif // IMPEL_C_LEXER_PARALLEL
+
+#ifdef __cplusplus
+}
+#endif
+#endif // C_LEXER_PARALLEL_H
@@ -0,0 +1,1657 @@
+// you need to define IMPEL_C_PARSER before including this header
+// (c_lexer.h still needs IMPEL_C_LEXER in one translation unit)
+//
+// Parses the tokens of a TokenBuffer into a flat syntax tree. Every node is
+// 16 bytes in one array and refers to its children by u32 index, lists live
+// in a second u32 array, so a tree costs two growing arrays and not one
+// allocation per node. With an arena both come from it and the tree is
+// dropped with the rest of the file by the next arena_reset.
+// Expressions are parsed by precedence climbing (Pratt) over the lexer's
+// operator tokens, statements and declarations by recursive descent. The
+// grammar is C23 with the extended language on top: `let name [: type]
+// [= init];` and the fixed width types u8 ... f64.
+// Nothing is preprocessed. Directive lines are skipped, GNU attributes, asm
+// labels and `[[...]]` are dropped and the GNU spellings of keywords
+// (__inline__, __restrict ...) are read as the keywords. Type names are the
+// typedefs seen so far plus what only a type can be: `a b`, `a *b;` at the
+// start of a statement, `(a *)` and `(a)b`; a name taken for a type stays one
+// for the rest of the file, scopes are not tracked.
+// An error doesn't stop the parse: it is recorded, the statement or
+// declaration is skipped up to its `;` or `}` and parsing goes on from there.
+
+#ifndef C_PARSER_H
+#define C_PARSER_H
+#include "c_lexer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// deeper nesting of expressions, statements or declarators is an error
+#ifndef AST_MAX_DEPTH
+#define AST_MAX_DEPTH 512
+#endif
+
+// first guesses for the array sizes, from the tokens left after the directives
+#define AST_TOKENS_PER_NODE 1
+#define AST_TOKENS_PER_EXTRA 3
+
+// What the lhs and rhs of a node hold. A list is a count followed by the
+// nodes, extra[0] is the empty list so 0 reads as one.
+typedef enum AstField {
+    AstField_none,
+    AstField_node,   // a node, 0 when absent
+    AstField_list,   // extra[i] nodes at extra[i + 1 ...]
+    AstField_pair,   // nodes at extra[i] and extra[i + 1], 0 when absent
+    AstField_triple, // nodes at extra[i] ... extra[i + 2]
+    AstField_value,  // a number
+} AstField;
+
+// Node kinds: X(name, lhs, rhs) gives Ast_<name> and what its fields hold.
+// `token` indexes the TokenBuffer: the operator, keyword or literal, and for
+// a declaration its name (the first token and AstFlag_unnamed without one).
+//   string         lhs: adjacent literals, concatenated
+//   unary, postfix, binary, assign   op: the operator
+//   ternary, if    rhs: then and else
+//   member         op: Tok_period or Tok_arrow, rhs: the Ast_ident
+//   sizeof         op: sizeof or alignof, lhs: an expression or a type
+//   call           rhs: arguments, types as well, as in va_arg(ap, int)
+//   generic_assoc  lhs: the type, 0 for default
+//   designator     op: Tok_period or Tok_l_bracket, lhs: field or index,
+//                  rhs: the value, another designator for `.a.b = x`
+//   type_base      lhs: AstBase, rhs: the record, enum or typedef name, the
+//                  operand of typeof and _Atomic(), the width of _BitInt
+//   type_function  rhs: parameters, op: Tok_ellipsis3 when variadic
+//   type_record    token: struct or union, lhs: name, rhs: fields
+//   type_enum      lhs: name, rhs: enumerators
+//   var_decl, let_decl   lhs: type (0 for an inferred let), rhs: initializer
+//   fn_decl        lhs: the type_function, rhs: body, 0 for a prototype
+//   field          rhs: bit width
+//   for            lhs: init (an expression or decl_list), condition, step
+//   case           lhs: value, a Tok_ellipsis3 binary for a GNU range
+#define C_PARSER_NODES(X) \
+    X(root, list, none) \
+    X(ident, none, none) X(number, none, none) X(float_number, none, none) \
+    X(char_literal, none, none) X(string, value, none) X(bool_literal, none, none) X(nullptr, none, none) \
+    X(unary, node, none) X(postfix, node, none) X(binary, node, node) X(assign, node, node) \
+    X(ternary, node, pair) X(call, node, list) X(index, node, node) X(member, node, node) \
+    X(cast, node, node) X(compound_literal, node, node) X(sizeof, node, none) \
+    X(generic, node, list) X(generic_assoc, node, node) X(stmt_expr, node, none) \
+    X(init_list, list, none) X(designator, node, node) \
+    X(type_base, value, node) X(type_pointer, node, none) X(type_array, node, node) \
+    X(type_function, node, list) X(type_record, node, list) X(type_enum, node, list) \
+    X(var_decl, node, node) X(let_decl, node, node) X(fn_decl, node, node) X(typedef_decl, node, none) \
+    X(param, node, none) X(field, node, node) X(enumerator, node, none) X(static_assert, node, node) \
+    X(decl_list, list, none) \
+    X(block, list, none) X(expr_stmt, node, none) X(empty, none, none) X(if, node, pair) \
+    X(while, node, node) X(do_while, node, node) X(for, triple, node) X(switch, node, node) \
+    X(case, node, node) X(default, node, none) X(label, node, none) X(goto, node, none) \
+    X(return, node, none) X(break, none, none) X(continue, none, none) \
+    X(error, none, none)
+
+#define AST_KIND_ENUM(name, lhs, rhs) Ast_##name,
+
+typedef enum AstKind {
+    C_PARSER_NODES(AST_KIND_ENUM)
+} AstKind;
+
+#define AST_KIND_COUNT (Ast_error + 1)
+
+// What a type_base names. `implicit` when only qualifiers or storage classes
+// were written: C23 `auto x = 1` and the implicit int of old code.
+#define C_PARSER_BASE_TYPES(X) \
+    X(implicit) X(void) X(bool) X(char) X(schar) X(uchar) X(short) X(ushort) \
+    X(int) X(uint) X(long) X(ulong) X(llong) X(ullong) X(float) X(double) X(ldouble) \
+    X(u8) X(i8) X(u16) X(i16) X(u32) X(i32) X(u64) X(i64) X(f32) X(f64) \
+    X(decimal32) X(decimal64) X(decimal128) X(bitint) \
+    X(record) X(enum) X(name) X(typeof)
+
+#define AST_BASE_ENUM(name) AstBase_##name,
+
+typedef enum AstBase {
+    C_PARSER_BASE_TYPES(AST_BASE_ENUM)
+} AstBase;
+
+// Storage classes and function specifiers go on declarations, qualifiers
+// and _Complex on types.
+#define C_PARSER_FLAGS(X) \
+    X(typedef) X(extern) X(static) X(thread_local) X(auto) X(register) X(constexpr) \
+    X(inline) X(noreturn) X(const) X(volatile) X(restrict) X(atomic) X(complex) \
+    X(unnamed) X(defined)
+
+#define AST_FLAG_BIT(name) AstFlagBit_##name,
+#define AST_FLAG_ENUM(name) AstFlag_##name = 1 << AstFlagBit_##name,
+
+enum { C_PARSER_FLAGS(AST_FLAG_BIT) AST_FLAG_COUNT };
+
+typedef enum AstFlags {
+    C_PARSER_FLAGS(AST_FLAG_ENUM)
+} AstFlags;
+
+#define AST_STORAGE_FLAGS (AstFlag_typedef | AstFlag_extern | AstFlag_static | AstFlag_thread_local | AstFlag_auto \
+                           | AstFlag_register | AstFlag_constexpr | AstFlag_inline | AstFlag_noreturn)
+
+#define C_PARSER_ERRORS(X) \
+    X(expected_token, "expected") \
+    X(expected_expression, "expected an expression") \
+    X(expected_declaration, "expected a declaration") \
+    X(expected_type, "expected a type") \
+    X(expected_name, "expected a name") \
+    X(invalid_type, "invalid combination of type specifiers") \
+    X(stray_brace, "unmatched `}`") \
+    X(too_deep, "nesting deeper than AST_MAX_DEPTH")
+
+#define PARSE_ERROR_ENUM(name, text) ParseError_##name,
+
+typedef enum ParseError {
+    C_PARSER_ERRORS(PARSE_ERROR_ENUM)
+} ParseError;
+
+typedef struct AstNode {
+    uint8_t kind;   // AstKind
+    uint8_t op;     // TokenKind of the operator, 0 elsewhere
+    uint16_t flags; // AstFlags
+    uint32_t token;
+    uint32_t lhs;
+    uint32_t rhs;
+} AstNode;
+
+typedef struct ParserDiagnostic {
+    ParseError code;
+    TokenKind expected; // for ParseError_expected_token
+    uint32_t token;     // where it went wrong, len of the buffer at its end
+} ParserDiagnostic;
+
+typedef struct Ast {
+    const char* source;
+    uint32_t src_len;
+    const TokenBuffer* tokens;
+    AstNode* nodes;     // nodes[0] is the Ast_root
+    uint32_t node_len;
+    uint32_t node_cap;
+    uint32_t* extra;
+    uint32_t extra_len;
+    uint32_t extra_cap;
+    ParserDiagnostic* diags;
+    uint32_t diag_len;
+    uint32_t diag_cap;
+    Arena* arena;       // owns the arrays when set
+    TokenBuffer lexed;  // the tokens of ast_parse_lexer
+} Ast;
+
+typedef struct AstList {
+    const uint32_t* nodes;
+    uint32_t len;
+} AstList;
+
+static inline AstList ast_list(const Ast* ast, uint32_t list){
+    return (AstList){ .nodes = ast->extra + list + 1, .len = ast->extra[list] };
+}
+
+void ast_init(Ast* ast, Arena* arena);
+void ast_deinit(Ast* ast);
+uint32_t ast_parse(Ast* ast, const char* source, uint32_t src_len, const TokenBuffer* tokens);
+uint32_t ast_parse_lexer(Ast* ast, Lexer* lexer);
+StrView ast_token_text(const Ast* ast, uint32_t token);
+const char* ast_kind_to_str(AstKind kind);
+const char* ast_base_to_str(AstBase base);
+const char* parse_error_to_str(ParseError code);
+void ast_print(const Ast* ast, uint32_t node, FILE* out);
+void ast_print_diagnostics(const Ast* ast, FILE* out, const char* file_name);
+
+
+#ifdef IMPEL_C_PARSER
+
+_Static_assert(TOKEN_KIND_COUNT <= 256, "operators are stored as bytes");
+_Static_assert(AST_KIND_COUNT <= 256, "node kinds are stored as bytes");
+_Static_assert(AST_FLAG_COUNT <= 16, "flags are stored in 16 bits");
+_Static_assert(sizeof(AstNode) == 16, "a node is 16 bytes");
+
+#define AST_KIND_NAME(name, lhs, rhs) [Ast_##name] = #name,
+#define AST_KIND_LHS(name, lhs, rhs) [Ast_##name] = AstField_##lhs,
+#define AST_KIND_RHS(name, lhs, rhs) [Ast_##name] = AstField_##rhs,
+#define AST_BASE_NAME(name) [AstBase_##name] = #name,
+#define AST_FLAG_NAME(name) [AstFlagBit_##name] = #name,
+#define PARSE_ERROR_TEXT(name, text) [ParseError_##name] = text,
+
+static const char* const AstKindNames[AST_KIND_COUNT] = { C_PARSER_NODES(AST_KIND_NAME) };
+static const uint8_t AstKindLhs[AST_KIND_COUNT] = { C_PARSER_NODES(AST_KIND_LHS) };
+static const uint8_t AstKindRhs[AST_KIND_COUNT] = { C_PARSER_NODES(AST_KIND_RHS) };
+static const char* const AstBaseNames[] = { C_PARSER_BASE_TYPES(AST_BASE_NAME) };
+static const char* const AstFlagNames[AST_FLAG_COUNT] = { C_PARSER_FLAGS(AST_FLAG_NAME) };
+static const char* const ParseErrorTexts[] = { C_PARSER_ERRORS(PARSE_ERROR_TEXT) };
+
+// Binary operators: X(token, left binding power, right binding power, node).
+// An operator binds while its left power is at least the minimum of the
+// operand being parsed, its right operand is parsed with its right power as
+// the minimum, so a right power below the left one is right associative.
+#define C_PARSER_INFIX(X) \
+    X(comma, 2, 3, binary) \
+    X(equal, 5, 4, assign) X(plus_equal, 5, 4, assign) X(minus_equal, 5, 4, assign) \
+    X(asterisk_equal, 5, 4, assign) X(slash_equal, 5, 4, assign) X(percent_equal, 5, 4, assign) \
+    X(ampersand_equal, 5, 4, assign) X(pipe_equal, 5, 4, assign) X(caret_equal, 5, 4, assign) \
+    X(angle_bracket_left_left_equal, 5, 4, assign) X(angle_bracket_right_right_equal, 5, 4, assign) \
+    X(questionmark, 7, 6, ternary) \
+    X(pipe_pipe, 8, 9, binary) X(ampersand_ampersand, 10, 11, binary) \
+    X(pipe, 12, 13, binary) X(caret, 14, 15, binary) X(ampersand, 16, 17, binary) \
+    X(equal_equal, 18, 19, binary) X(bang_equal, 18, 19, binary) \
+    X(angle_bracket_left, 20, 21, binary) X(angle_bracket_right, 20, 21, binary) \
+    X(angle_bracket_left_equal, 20, 21, binary) X(angle_bracket_right_equal, 20, 21, binary) \
+    X(angle_bracket_left_left, 22, 23, binary) X(angle_bracket_right_right, 22, 23, binary) \
+    X(plus, 24, 25, binary) X(minus, 24, 25, binary) \
+    X(asterisk, 26, 27, binary) X(slash, 26, 27, binary) X(percent, 26, 27, binary)
+
+// minimum binding powers: a full expression, one without a top level comma
+// (arguments, initializers), a conditional expression (array sizes, case
+// values, enumerators, bit widths) and the operand of a prefix operator
+#define PARSER_BP_EXPRESSION 0
+#define PARSER_BP_ASSIGN 4
+#define PARSER_BP_CONDITIONAL 6
+#define PARSER_BP_PREFIX 28
+
+#define PARSER_INFIX_LEFT(name, left, right, node) [Tok_##name] = left,
+#define PARSER_INFIX_RIGHT(name, left, right, node) [Tok_##name] = right,
+#define PARSER_INFIX_NODE(name, left, right, node) [Tok_##name] = Ast_##node,
+
+static const uint8_t ParserInfixLeft[TOKEN_KIND_COUNT] = { C_PARSER_INFIX(PARSER_INFIX_LEFT) };
+static const uint8_t ParserInfixRight[TOKEN_KIND_COUNT] = { C_PARSER_INFIX(PARSER_INFIX_RIGHT) };
+static const uint8_t ParserInfixNode[TOKEN_KIND_COUNT] = { C_PARSER_INFIX(PARSER_INFIX_NODE) };
+
+// how punctuators are written, for diagnostics and ast_print
+static const char* const ParserSpellings[TOKEN_KIND_COUNT] = {
+    [Tok_eof] = "end of file", [Tok_identifier] = "a name",
+    [Tok_l_paren] = "(", [Tok_r_paren] = ")", [Tok_l_brace] = "{", [Tok_r_brace] = "}",
+    [Tok_l_bracket] = "[", [Tok_r_bracket] = "]", [Tok_period] = ".", [Tok_ellipsis2] = "..",
+    [Tok_ellipsis3] = "...", [Tok_colon] = ":", [Tok_colon_equal] = ":=", [Tok_colon_colon] = "::",
+    [Tok_equal] = "=", [Tok_equal_equal] = "==", [Tok_semicolon] = ";", [Tok_comma] = ",",
+    [Tok_bang] = "!", [Tok_bang_equal] = "!=", [Tok_questionmark] = "?", [Tok_dollar_sign] = "$",
+    [Tok_at_sign] = "@", [Tok_hash] = "#", [Tok_plus] = "+", [Tok_plus_plus] = "++",
+    [Tok_plus_equal] = "+=", [Tok_minus] = "-", [Tok_minus_minus] = "--", [Tok_minus_equal] = "-=",
+    [Tok_arrow] = "->", [Tok_asterisk] = "*", [Tok_asterisk_equal] = "*=", [Tok_slash] = "/",
+    [Tok_slash_equal] = "/=", [Tok_percent] = "%", [Tok_percent_equal] = "%=", [Tok_pipe] = "|",
+    [Tok_pipe_equal] = "|=", [Tok_pipe_pipe] = "||", [Tok_ampersand] = "&", [Tok_ampersand_equal] = "&=",
+    [Tok_ampersand_ampersand] = "&&", [Tok_caret] = "^", [Tok_caret_equal] = "^=", [Tok_tilde] = "~",
+    [Tok_tilde_equal] = "~=", [Tok_angle_bracket_left] = "<", [Tok_angle_bracket_left_left] = "<<",
+    [Tok_angle_bracket_left_left_equal] = "<<=", [Tok_angle_bracket_left_equal] = "<=",
+    [Tok_angle_bracket_right] = ">", [Tok_angle_bracket_right_right] = ">>",
+    [Tok_angle_bracket_right_right_equal] = ">>=", [Tok_angle_bracket_right_equal] = ">=",
+};
+
+static const char* parser_spelling(TokenKind kind){
+    const char* name = ParserSpellings[kind];
+    if(name) return name;
+    name = token_enum_to_str(kind);
+    return strncmp(name, "keyword_", 8) ? name : name + 8;
+}
+
+// GNU spellings: the keyword they stand for, Tok_eof for a word that is
+// dropped and Tok_l_paren for one dropped with its parenthesized operand
+typedef struct ParserGnuWord {
+    const char* name;
+    uint32_t len;
+    TokenKind kind;
+} ParserGnuWord;
+
+#define PARSER_GNU_WORD(name, kind) { name, sizeof(name) - 1, kind }
+
+static const ParserGnuWord ParserGnuWords[] = {
+    PARSER_GNU_WORD("__attribute__", Tok_l_paren), PARSER_GNU_WORD("__attribute", Tok_l_paren),
+    PARSER_GNU_WORD("__declspec", Tok_l_paren), PARSER_GNU_WORD("__asm__", Tok_l_paren),
+    PARSER_GNU_WORD("__asm", Tok_l_paren), PARSER_GNU_WORD("asm", Tok_l_paren),
+    PARSER_GNU_WORD("__extension__", Tok_eof),
+    PARSER_GNU_WORD("__inline__", Tok_keyword_inline), PARSER_GNU_WORD("__inline", Tok_keyword_inline),
+    PARSER_GNU_WORD("__restrict__", Tok_keyword_restrict), PARSER_GNU_WORD("__restrict", Tok_keyword_restrict),
+    PARSER_GNU_WORD("__const__", Tok_keyword_const), PARSER_GNU_WORD("__const", Tok_keyword_const),
+    PARSER_GNU_WORD("__volatile__", Tok_keyword_volatile), PARSER_GNU_WORD("__volatile", Tok_keyword_volatile),
+    PARSER_GNU_WORD("__signed__", Tok_keyword_signed), PARSER_GNU_WORD("__signed", Tok_keyword_signed),
+    PARSER_GNU_WORD("__typeof__", Tok_keyword_typeof), PARSER_GNU_WORD("__typeof", Tok_keyword_typeof),
+    PARSER_GNU_WORD("__alignof__", Tok_keyword_alignof), PARSER_GNU_WORD("__alignof", Tok_keyword_alignof),
+    PARSER_GNU_WORD("__thread", Tok_keyword_thread_local), PARSER_GNU_WORD("__auto_type", Tok_keyword_auto),
+};
+
+#define PARSER_NO_NAME UINT32_MAX
+
+typedef struct Parser {
+    Ast* ast;
+    const char* source;
+    const TokenBuffer* tokens;
+    uint8_t* kinds;     // the tokens parsed, directive lines and GNU noise
+    uint32_t* index;    // left out, by kind and TokenBuffer index; Tok_eof last
+    uint32_t len;
+    uint32_t pos;
+    uint32_t* scratch;  // the nodes of the lists being built
+    uint32_t scratch_len;
+    uint32_t scratch_cap;
+    Interner types;     // typedef names, declared or guessed
+    uint32_t depth;
+    bool recovering;    // an error was reported, the rest of the statement is skipped
+} Parser;
+
+void ast_init(Ast* ast, Arena* arena){
+    *ast = (Ast){ .arena = arena };
+}
+
+void ast_deinit(Ast* ast){
+    if(!ast->arena){
+        free(ast->nodes);
+        free(ast->extra);
+        free(ast->diags);
+    }
+    token_buffer_deinit(&ast->lexed);
+    *ast = (Ast){0};
+}
+
+static void* ast_grow(Ast* ast, void* array, uint32_t old, uint32_t cap, size_t size){
+    void* grown = ast->arena ? arena_realloc(ast->arena, array, old * size, cap * size) : realloc(array, cap * size);
+    if(!grown){
+        fprintf(stderr, "[Parsing Error]: failed to grow the syntax tree to %u entries\n", cap);
+        exit(1);
+    }
+    return grown;
+}
+
+static void ast_reserve(Ast* ast, uint32_t nodes, uint32_t extra){
+    if(nodes > ast->node_cap){
+        ast->nodes = ast_grow(ast, ast->nodes, ast->node_cap, nodes, sizeof(AstNode));
+        ast->node_cap = nodes;
+    }
+    if(extra > ast->extra_cap){
+        ast->extra = ast_grow(ast, ast->extra, ast->extra_cap, extra, sizeof(uint32_t));
+        ast->extra_cap = extra;
+    }
+}
+
+static inline TokenKind parser_kind(const Parser* p){
+    return (TokenKind)p->kinds[p->pos];
+}
+
+static inline TokenKind parser_peek(const Parser* p, uint32_t n){
+    uint32_t i = p->pos + n;
+    return (TokenKind)p->kinds[i < p->len ? i : p->len - 1];
+}
+
+static inline uint32_t parser_token(const Parser* p){
+    return p->index[p->pos];
+}
+
+static inline void parser_advance(Parser* p){
+    if(p->pos + 1 < p->len) p->pos += 1;
+}
+
+static inline bool parser_accept(Parser* p, TokenKind kind){
+    if(parser_kind(p) != kind) return false;
+    parser_advance(p);
+    return true;
+}
+
+static StrView parser_text(const Parser* p, uint32_t pos){
+    Token tok = token_buffer_get(p->tokens, p->source, p->index[pos]);
+    return (StrView){ p->source + tok.loc.offset, tok.loc.len };
+}
+
+// Only the first error of a statement is kept, what follows it is mostly
+// fallout until parser_sync gets to the next one.
+static void parser_report(Parser* p, ParseError code, TokenKind expected){
+    if(p->recovering) return;
+    p->recovering = true;
+    Ast* ast = p->ast;
+    if(ast->diag_len == ast->diag_cap){
+        uint32_t old = ast->diag_cap;
+        ast->diag_cap = old ? old * 2 : 16;
+        ast->diags = ast_grow(ast, ast->diags, old, ast->diag_cap, sizeof(ParserDiagnostic));
+    }
+    ast->diags[ast->diag_len++] = (ParserDiagnostic){ .code = code, .expected = expected, .token = parser_token(p) };
+}
+
+static bool parser_expect(Parser* p, TokenKind kind){
+    if(parser_accept(p, kind)){
+        // the `;` parser_sync would stop after, without it the broken
+        // statement's sync would skip the next one
+        if(kind == Tok_semicolon) p->recovering = false;
+        return true;
+    }
+    parser_report(p, ParseError_expected_token, kind);
+    return false;
+}
+
+// Skips past the `;` ending the broken statement or up to the `}` closing
+// its block, braces opened on the way are skipped whole.
+static void parser_sync(Parser* p){
+    uint32_t depth = 0;
+    for(;;){
+        TokenKind kind = parser_kind(p);
+        if(kind == Tok_eof) break;
+        if(kind == Tok_l_brace){
+            depth += 1;
+        }else if(kind == Tok_r_brace){
+            if(depth == 0) break;
+            depth -= 1;
+            if(depth == 0){
+                parser_advance(p);
+                break;
+            }
+        }else if(kind == Tok_semicolon && depth == 0){
+            parser_advance(p);
+            break;
+        }
+        parser_advance(p);
+    }
+    p->recovering = false;
+}
+
+static bool parser_enter(Parser* p){
+    if(p->depth >= AST_MAX_DEPTH){
+        parser_report(p, ParseError_too_deep, Tok_eof);
+        return false;
+    }
+    p->depth += 1;
+    return true;
+}
+
+static uint32_t parser_node(Parser* p, AstKind kind, uint32_t token, uint32_t lhs, uint32_t rhs){
+    Ast* ast = p->ast;
+    if(ast->node_len == ast->node_cap) ast_reserve(ast, ast->node_cap * 2, 0);
+    ast->nodes[ast->node_len] = (AstNode){ .kind = (uint8_t)kind, .token = token, .lhs = lhs, .rhs = rhs };
+    return ast->node_len++;
+}
+
+static uint32_t parser_op_node(Parser* p, AstKind kind, TokenKind op, uint32_t token, uint32_t lhs, uint32_t rhs){
+    uint32_t node = parser_node(p, kind, token, lhs, rhs);
+    p->ast->nodes[node].op = (uint8_t)op;
+    return node;
+}
+
+static uint32_t parser_error_node(Parser* p){
+    return parser_node(p, Ast_error, parser_token(p), 0, 0);
+}
+
+// A declaration is named by its identifier, or by where it starts when it
+// has none.
+static uint32_t parser_decl(Parser* p, AstKind kind, uint32_t name, uint32_t first, uint32_t lhs, uint32_t rhs, uint16_t flags){
+    if(name == PARSER_NO_NAME) flags |= AstFlag_unnamed;
+    uint32_t node = parser_node(p, kind, p->index[name == PARSER_NO_NAME ? first : name], lhs, rhs);
+    p->ast->nodes[node].flags = flags;
+    return node;
+}
+
+static uint32_t parser_extra(Parser* p, const uint32_t* values, uint32_t n){
+    Ast* ast = p->ast;
+    if(ast->extra_len + n > ast->extra_cap){
+        uint32_t cap = ast->extra_cap;
+        while(cap < ast->extra_len + n) cap *= 2;
+        ast_reserve(ast, 0, cap);
+    }
+    uint32_t at = ast->extra_len;
+    memcpy(ast->extra + at, values, n * sizeof(uint32_t));
+    ast->extra_len += n;
+    return at;
+}
+
+static uint32_t parser_pair(Parser* p, uint32_t a, uint32_t b){
+    return parser_extra(p, (uint32_t[]){ a, b }, 2);
+}
+
+static void parser_push(Parser* p, uint32_t node){
+    if(p->scratch_len == p->scratch_cap){
+        p->scratch_cap = p->scratch_cap ? p->scratch_cap * 2 : 256;
+        p->scratch = realloc(p->scratch, p->scratch_cap * sizeof(uint32_t));
+        if(!p->scratch){
+            fprintf(stderr, "[Parsing Error]: failed to grow the parser stack to %u entries\n", p->scratch_cap);
+            exit(1);
+        }
+    }
+    p->scratch[p->scratch_len++] = node;
+}
+
+// Moves the nodes pushed since `top` into a list, the nested lists built in
+// between have already been moved out.
+static uint32_t parser_list(Parser* p, uint32_t top){
+    uint32_t n = p->scratch_len - top;
+    if(n == 0) return 0;
+    parser_push(p, n);
+    uint32_t list = parser_extra(p, &p->scratch[p->scratch_len - 1], 1);
+    parser_extra(p, p->scratch + top, n);
+    p->scratch_len = top;
+    return list;
+}
+
+static bool parser_is_type(const Parser* p, uint32_t pos){
+    if(pos >= p->len || p->kinds[pos] != Tok_identifier) return false;
+    StrView name = parser_text(p, pos);
+    return interner_find(&p->types, name.ptr, name.len) != 0;
+}
+
+static void parser_add_type(Parser* p, uint32_t pos){
+    StrView name = parser_text(p, pos);
+    interner_intern(&p->types, name.ptr, name.len);
+}
+
+static bool parser_storage_keyword(TokenKind kind){
+    switch(kind){
+        case Tok_keyword_typedef: case Tok_keyword_extern: case Tok_keyword_static:
+        case Tok_keyword_auto: case Tok_keyword_register: case Tok_keyword_inline:
+        case Tok_keyword__Noreturn: case Tok_keyword__Thread_local: case Tok_keyword_thread_local:
+        case Tok_keyword_constexpr: case Tok_keyword__Alignas: case Tok_keyword_alignas:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool parser_qualifier_keyword(TokenKind kind){
+    return kind == Tok_keyword_const || kind == Tok_keyword_volatile || kind == Tok_keyword_restrict || kind == Tok_keyword__Atomic;
+}
+
+// the keywords that start a type name
+static bool parser_type_keyword(TokenKind kind){
+    switch(kind){
+        case Tok_keyword_void: case Tok_keyword_char: case Tok_keyword_short: case Tok_keyword_int:
+        case Tok_keyword_long: case Tok_keyword_float: case Tok_keyword_double: case Tok_keyword_signed:
+        case Tok_keyword_unsigned: case Tok_keyword_bool: case Tok_keyword__Bool: case Tok_keyword__Complex:
+        case Tok_keyword__Imaginary: case Tok_keyword_struct: case Tok_keyword_union: case Tok_keyword_enum:
+        case Tok_keyword_const: case Tok_keyword_volatile: case Tok_keyword_restrict: case Tok_keyword__Atomic:
+        case Tok_keyword_typeof: case Tok_keyword_typeof_unqual: case Tok_keyword__BitInt:
+        case Tok_keyword__Decimal32: case Tok_keyword__Decimal64: case Tok_keyword__Decimal128:
+        case Tok_keyword_u8: case Tok_keyword_i8: case Tok_keyword_u16: case Tok_keyword_i16:
+        case Tok_keyword_u32: case Tok_keyword_i32: case Tok_keyword_u64: case Tok_keyword_i64:
+        case Tok_keyword_f32: case Tok_keyword_f64:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// a type name starts here, as an argument of a call or typeof
+static bool parser_at_type(const Parser* p){
+    return parser_type_keyword(parser_kind(p)) || parser_is_type(p, p->pos);
+}
+
+// Whether the identifier here can only be a type name: `a b`, and `a *b`
+// followed by what can follow a declarator, are declarations, not
+// expressions. A name guessed for a type is one from then on.
+static bool parser_guess_type(Parser* p){
+    if(parser_kind(p) != Tok_identifier) return false;
+    if(parser_is_type(p, p->pos)) return true;
+    TokenKind next = parser_peek(p, 1);
+    bool type = next == Tok_identifier;
+    if(next == Tok_asterisk){
+        uint32_t i = 2;
+        while(parser_peek(p, i) == Tok_asterisk || parser_qualifier_keyword(parser_peek(p, i))) i += 1;
+        TokenKind after = parser_peek(p, i);
+        type = after == Tok_comma || after == Tok_r_paren;
+        if(after == Tok_identifier){
+            TokenKind end = parser_peek(p, i + 1);
+            type = end == Tok_semicolon || end == Tok_equal || end == Tok_comma || end == Tok_l_bracket
+                || end == Tok_r_paren || end == Tok_l_paren;
+        }
+    }
+    if(type) parser_add_type(p, p->pos);
+    return type;
+}
+
+// Whether a declaration starts here, rather than a statement.
+static bool parser_at_declaration(Parser* p){
+    TokenKind kind = parser_kind(p);
+    if(parser_type_keyword(kind) || parser_storage_keyword(kind)) return true;
+    if(kind == Tok_keyword_let || kind == Tok_keyword_static_assert || kind == Tok_keyword__Static_assert) return true;
+    if(kind != Tok_identifier || parser_peek(p, 1) == Tok_colon) return false;
+    return parser_guess_type(p);
+}
+
+// Whether the `(` here opens a type name: a cast, compound literal or the
+// operand of sizeof. `(a *)` and `(a)b` can't be expressions.
+static bool parser_paren_type(Parser* p){
+    TokenKind next = parser_peek(p, 1);
+    if(parser_type_keyword(next)) return true;
+    if(next != Tok_identifier) return false;
+    if(parser_is_type(p, p->pos + 1)) return true;
+    uint32_t i = 2;
+    while(parser_peek(p, i) == Tok_asterisk) i += 1;
+    bool type = false;
+    if(i > 2){
+        type = parser_peek(p, i) == Tok_r_paren;
+    }else if(parser_peek(p, 2) == Tok_r_paren){
+        TokenKind after = parser_peek(p, 3);
+        type = after == Tok_identifier || after == Tok_number_literal || after == Tok_float_literal
+            || after == Tok_string_literal || after == Tok_char_literal;
+    }
+    if(type) parser_add_type(p, p->pos + 1);
+    return type;
+}
+
+static void parser_skip_group(Parser* p){
+    uint32_t depth = 0;
+    do{
+        TokenKind kind = parser_kind(p);
+        if(kind == Tok_eof) return;
+        if(kind == Tok_l_paren) depth += 1;
+        if(kind == Tok_r_paren) depth -= 1;
+        parser_advance(p);
+    }while(depth);
+}
+
+static uint32_t parser_name(Parser* p){
+    if(parser_kind(p) != Tok_identifier){
+        parser_report(p, ParseError_expected_name, Tok_eof);
+        return parser_error_node(p);
+    }
+    uint32_t node = parser_node(p, Ast_ident, parser_token(p), 0, 0);
+    parser_advance(p);
+    return node;
+}
+
+static uint32_t parse_expr_bp(Parser* p, uint32_t min_bp);
+static uint32_t parse_type_name(Parser* p);
+static uint32_t parse_initializer(Parser* p);
+static uint32_t parse_init_list(Parser* p);
+static uint32_t parse_block(Parser* p);
+static uint32_t parse_statement(Parser* p);
+static uint32_t parse_declarator(Parser* p, uint32_t type, uint32_t* name);
+static void parse_field_declaration(Parser* p);
+
+static uint32_t parse_generic(Parser* p){
+    uint32_t token = parser_token(p);
+    parser_advance(p);
+    parser_expect(p, Tok_l_paren);
+    uint32_t control = parse_expr_bp(p, PARSER_BP_ASSIGN);
+    uint32_t top = p->scratch_len;
+    while(!p->recovering && parser_accept(p, Tok_comma)){
+        uint32_t at = parser_token(p);
+        uint32_t type = 0;
+        if(!parser_accept(p, Tok_keyword_default)) type = parse_type_name(p);
+        parser_expect(p, Tok_colon);
+        uint32_t value = parse_expr_bp(p, PARSER_BP_ASSIGN);
+        parser_push(p, parser_node(p, Ast_generic_assoc, at, type, value));
+    }
+    parser_expect(p, Tok_r_paren);
+    return parser_node(p, Ast_generic, token, control, parser_list(p, top));
+}
+
+static uint32_t parse_prefix(Parser* p){
+    TokenKind kind = parser_kind(p);
+    uint32_t token = parser_token(p);
+    switch(kind){
+        case Tok_identifier:
+            parser_advance(p);
+            return parser_node(p, Ast_ident, token, 0, 0);
+        case Tok_number_literal:
+            parser_advance(p);
+            return parser_node(p, Ast_number, token, 0, 0);
+        case Tok_float_literal:
+            parser_advance(p);
+            return parser_node(p, Ast_float_number, token, 0, 0);
+        case Tok_char_literal:
+            parser_advance(p);
+            return parser_node(p, Ast_char_literal, token, 0, 0);
+        case Tok_keyword_true: case Tok_keyword_false:
+            parser_advance(p);
+            return parser_node(p, Ast_bool_literal, token, 0, 0);
+        case Tok_keyword_nullptr:
+            parser_advance(p);
+            return parser_node(p, Ast_nullptr, token, 0, 0);
+        case Tok_string_literal: {
+            uint32_t count = 0;
+            while(parser_accept(p, Tok_string_literal)) count += 1;
+            return parser_node(p, Ast_string, token, count, 0);
+        }
+        case Tok_l_paren: {
+            if(parser_peek(p, 1) == Tok_l_brace){
+                parser_advance(p);
+                uint32_t block = parse_block(p);
+                parser_expect(p, Tok_r_paren);
+                return parser_node(p, Ast_stmt_expr, token, block, 0);
+            }
+            if(parser_paren_type(p)){
+                parser_advance(p);
+                uint32_t type = parse_type_name(p);
+                parser_expect(p, Tok_r_paren);
+                if(parser_kind(p) == Tok_l_brace) return parser_node(p, Ast_compound_literal, token, type, parse_init_list(p));
+                return parser_node(p, Ast_cast, token, type, parse_expr_bp(p, PARSER_BP_PREFIX));
+            }
+            parser_advance(p);
+            uint32_t inner = parse_expr_bp(p, PARSER_BP_EXPRESSION);
+            parser_expect(p, Tok_r_paren);
+            return inner;
+        }
+        case Tok_plus: case Tok_minus: case Tok_bang: case Tok_tilde:
+        case Tok_asterisk: case Tok_ampersand: case Tok_plus_plus: case Tok_minus_minus:
+            parser_advance(p);
+            return parser_op_node(p, Ast_unary, kind, token, parse_expr_bp(p, PARSER_BP_PREFIX), 0);
+        case Tok_keyword_sizeof: case Tok_keyword_alignof: case Tok_keyword__Alignof: {
+            parser_advance(p);
+            uint32_t operand;
+            if(parser_kind(p) == Tok_l_paren && parser_paren_type(p)){
+                parser_advance(p);
+                operand = parse_type_name(p);
+                parser_expect(p, Tok_r_paren);
+            }else{
+                operand = parse_expr_bp(p, PARSER_BP_PREFIX);
+            }
+            return parser_op_node(p, Ast_sizeof, kind, token, operand, 0);
+        }
+        case Tok_keyword__Generic:
+            return parse_generic(p);
+        default:
+            parser_report(p, ParseError_expected_expression, Tok_eof);
+            return parser_error_node(p);
+    }
+}
+
+static uint32_t parse_arguments(Parser* p){
+    uint32_t top = p->scratch_len;
+    while(parser_kind(p) != Tok_r_paren && parser_kind(p) != Tok_eof && !p->recovering){
+        parser_push(p, parser_at_type(p) ? parse_type_name(p) : parse_expr_bp(p, PARSER_BP_ASSIGN));
+        if(!parser_accept(p, Tok_comma)) break;
+    }
+    parser_expect(p, Tok_r_paren);
+    return parser_list(p, top);
+}
+
+// The Pratt loop: a prefix expression, then postfix operators, which bind
+// tighter than anything, and binary operators as long as they bind at
+// least as tight as `min_bp`.
+static uint32_t parse_expr_bp(Parser* p, uint32_t min_bp){
+    if(!parser_enter(p)) return parser_error_node(p);
+    uint32_t lhs = parse_prefix(p);
+    while(!p->recovering){
+        TokenKind kind = parser_kind(p);
+        uint32_t token = parser_token(p);
+        if(kind == Tok_l_paren){
+            parser_advance(p);
+            lhs = parser_node(p, Ast_call, token, lhs, parse_arguments(p));
+            continue;
+        }
+        if(kind == Tok_l_bracket){
+            parser_advance(p);
+            uint32_t index = parse_expr_bp(p, PARSER_BP_EXPRESSION);
+            parser_expect(p, Tok_r_bracket);
+            lhs = parser_node(p, Ast_index, token, lhs, index);
+            continue;
+        }
+        if(kind == Tok_period || kind == Tok_arrow){
+            parser_advance(p);
+            lhs = parser_op_node(p, Ast_member, kind, token, lhs, parser_name(p));
+            continue;
+        }
+        if(kind == Tok_plus_plus || kind == Tok_minus_minus){
+            parser_advance(p);
+            lhs = parser_op_node(p, Ast_postfix, kind, token, lhs, 0);
+            continue;
+        }
+        uint32_t left = ParserInfixLeft[kind];
+        if(left == 0 || left < min_bp) break;
+        parser_advance(p);
+        if(kind == Tok_questionmark){
+            // GNU `a ?: b` leaves out the middle operand
+            uint32_t then = parser_kind(p) == Tok_colon ? 0 : parse_expr_bp(p, PARSER_BP_EXPRESSION);
+            parser_expect(p, Tok_colon);
+            uint32_t other = parse_expr_bp(p, ParserInfixRight[kind]);
+            lhs = parser_op_node(p, Ast_ternary, kind, token, lhs, parser_pair(p, then, other));
+        }else{
+            uint32_t rhs = parse_expr_bp(p, ParserInfixRight[kind]);
+            lhs = parser_op_node(p, (AstKind)ParserInfixNode[kind], kind, token, lhs, rhs);
+        }
+    }
+    p->depth -= 1;
+    return lhs;
+}
+
+static uint32_t parse_designation(Parser* p){
+    TokenKind kind = parser_kind(p);
+    if(kind != Tok_period && kind != Tok_l_bracket) return parse_initializer(p);
+    uint32_t token = parser_token(p);
+    parser_advance(p);
+    uint32_t target;
+    if(kind == Tok_period){
+        target = parser_name(p);
+    }else{
+        target = parse_expr_bp(p, PARSER_BP_CONDITIONAL);
+        parser_expect(p, Tok_r_bracket);
+    }
+    uint32_t value;
+    if(parser_kind(p) == Tok_period || parser_kind(p) == Tok_l_bracket){
+        value = parse_designation(p);
+    }else{
+        parser_expect(p, Tok_equal);
+        value = parse_initializer(p);
+    }
+    return parser_op_node(p, Ast_designator, kind, token, target, value);
+}
+
+static uint32_t parse_init_list(Parser* p){
+    uint32_t token = parser_token(p);
+    if(!parser_enter(p)) return parser_error_node(p);
+    parser_advance(p);
+    uint32_t top = p->scratch_len;
+    while(parser_kind(p) != Tok_r_brace && parser_kind(p) != Tok_eof && !p->recovering){
+        parser_push(p, parse_designation(p));
+        if(!parser_accept(p, Tok_comma)) break;
+    }
+    parser_expect(p, Tok_r_brace);
+    p->depth -= 1;
+    return parser_node(p, Ast_init_list, token, parser_list(p, top), 0);
+}
+
+static uint32_t parse_initializer(Parser* p){
+    if(parser_kind(p) == Tok_l_brace) return parse_init_list(p);
+    return parse_expr_bp(p, PARSER_BP_ASSIGN);
+}
+
+static uint16_t parse_qualifiers(Parser* p){
+    uint16_t flags = 0;
+    for(;;){
+        switch(parser_kind(p)){
+            case Tok_keyword_const: flags |= AstFlag_const; break;
+            case Tok_keyword_volatile: flags |= AstFlag_volatile; break;
+            case Tok_keyword_restrict: flags |= AstFlag_restrict; break;
+            case Tok_keyword__Atomic:
+                if(parser_peek(p, 1) == Tok_l_paren) return flags;
+                flags |= AstFlag_atomic;
+                break;
+            default:
+                return flags;
+        }
+        parser_advance(p);
+    }
+}
+
+static uint32_t parse_record(Parser* p){
+    uint32_t token = parser_token(p);
+    parser_advance(p);
+    uint32_t name = parser_kind(p) == Tok_identifier ? parser_name(p) : 0;
+    uint32_t fields = 0;
+    uint16_t flags = 0;
+    if(parser_accept(p, Tok_l_brace)){
+        flags = AstFlag_defined;
+        uint32_t top = p->scratch_len;
+        while(parser_kind(p) != Tok_r_brace && parser_kind(p) != Tok_eof){
+            uint32_t before = p->pos;
+            parse_field_declaration(p);
+            if(p->recovering) parser_sync(p);
+            if(p->pos == before) parser_advance(p);
+        }
+        parser_expect(p, Tok_r_brace);
+        fields = parser_list(p, top);
+    }else if(!name){
+        parser_report(p, ParseError_expected_name, Tok_eof);
+    }
+    uint32_t node = parser_node(p, Ast_type_record, token, name, fields);
+    p->ast->nodes[node].flags = flags;
+    return node;
+}
+
+static uint32_t parse_enum(Parser* p){
+    uint32_t token = parser_token(p);
+    parser_advance(p);
+    uint32_t name = parser_kind(p) == Tok_identifier ? parser_name(p) : 0;
+    // the C23 underlying type is checked and not kept
+    if(parser_accept(p, Tok_colon)) parse_type_name(p);
+    uint32_t list = 0;
+    uint16_t flags = 0;
+    if(parser_accept(p, Tok_l_brace)){
+        flags = AstFlag_defined;
+        uint32_t top = p->scratch_len;
+        while(parser_kind(p) != Tok_r_brace && !p->recovering){
+            if(parser_kind(p) != Tok_identifier){
+                parser_report(p, ParseError_expected_name, Tok_eof);
+                break;
+            }
+            uint32_t at = p->pos;
+            parser_advance(p);
+            uint32_t value = parser_accept(p, Tok_equal) ? parse_expr_bp(p, PARSER_BP_CONDITIONAL) : 0;
+            parser_push(p, parser_decl(p, Ast_enumerator, at, at, value, 0, 0));
+            if(!parser_accept(p, Tok_comma)) break;
+        }
+        parser_expect(p, Tok_r_brace);
+        list = parser_list(p, top);
+    }else if(!name){
+        parser_report(p, ParseError_expected_name, Tok_eof);
+    }
+    uint32_t node = parser_node(p, Ast_type_enum, token, name, list);
+    p->ast->nodes[node].flags = flags;
+    return node;
+}
+
+// a single word type specifier, more than one is an error
+static void parser_set_base(Parser* p, AstBase* base, AstBase value){
+    if(*base != AstBase_implicit) parser_report(p, ParseError_invalid_type, Tok_eof);
+    *base = value;
+}
+
+// Parses declaration specifiers into a type_base. Storage classes and
+// function specifiers go to `storage`, the base type is resolved from the
+// keywords in any order, `unsigned long long int` is AstBase_ullong.
+static uint32_t parse_specifiers(Parser* p, uint16_t* storage){
+    uint32_t token = parser_token(p);
+    AstBase base = AstBase_implicit;
+    uint32_t operand = 0;
+    uint16_t flags = 0;
+    uint32_t longs = 0, shorts = 0, ints = 0, signs = 0, unsigns = 0;
+    for(;;){
+        TokenKind kind = parser_kind(p);
+        switch(kind){
+            case Tok_keyword_typedef: *storage |= AstFlag_typedef; break;
+            case Tok_keyword_extern: *storage |= AstFlag_extern; break;
+            case Tok_keyword_static: *storage |= AstFlag_static; break;
+            case Tok_keyword_auto: *storage |= AstFlag_auto; break;
+            case Tok_keyword_register: *storage |= AstFlag_register; break;
+            case Tok_keyword_constexpr: *storage |= AstFlag_constexpr; break;
+            case Tok_keyword_inline: *storage |= AstFlag_inline; break;
+            case Tok_keyword__Noreturn: *storage |= AstFlag_noreturn; break;
+            case Tok_keyword__Thread_local: case Tok_keyword_thread_local: *storage |= AstFlag_thread_local; break;
+            case Tok_keyword_const: flags |= AstFlag_const; break;
+            case Tok_keyword_volatile: flags |= AstFlag_volatile; break;
+            case Tok_keyword_restrict: flags |= AstFlag_restrict; break;
+            case Tok_keyword__Complex: case Tok_keyword__Imaginary: flags |= AstFlag_complex; break;
+            case Tok_keyword_void: parser_set_base(p, &base, AstBase_void); break;
+            case Tok_keyword_bool: case Tok_keyword__Bool: parser_set_base(p, &base, AstBase_bool); break;
+            case Tok_keyword_char: parser_set_base(p, &base, AstBase_char); break;
+            case Tok_keyword_float: parser_set_base(p, &base, AstBase_float); break;
+            case Tok_keyword_double: parser_set_base(p, &base, AstBase_double); break;
+            case Tok_keyword_u8: parser_set_base(p, &base, AstBase_u8); break;
+            case Tok_keyword_i8: parser_set_base(p, &base, AstBase_i8); break;
+            case Tok_keyword_u16: parser_set_base(p, &base, AstBase_u16); break;
+            case Tok_keyword_i16: parser_set_base(p, &base, AstBase_i16); break;
+            case Tok_keyword_u32: parser_set_base(p, &base, AstBase_u32); break;
+            case Tok_keyword_i32: parser_set_base(p, &base, AstBase_i32); break;
+            case Tok_keyword_u64: parser_set_base(p, &base, AstBase_u64); break;
+            case Tok_keyword_i64: parser_set_base(p, &base, AstBase_i64); break;
+            case Tok_keyword_f32: parser_set_base(p, &base, AstBase_f32); break;
+            case Tok_keyword_f64: parser_set_base(p, &base, AstBase_f64); break;
+            case Tok_keyword__Decimal32: parser_set_base(p, &base, AstBase_decimal32); break;
+            case Tok_keyword__Decimal64: parser_set_base(p, &base, AstBase_decimal64); break;
+            case Tok_keyword__Decimal128: parser_set_base(p, &base, AstBase_decimal128); break;
+            case Tok_keyword_int: ints += 1; break;
+            case Tok_keyword_long: longs += 1; break;
+            case Tok_keyword_short: shorts += 1; break;
+            case Tok_keyword_signed: signs += 1; break;
+            case Tok_keyword_unsigned: unsigns += 1; break;
+            case Tok_keyword_struct: case Tok_keyword_union:
+                parser_set_base(p, &base, AstBase_record);
+                operand = parse_record(p);
+                continue;
+            case Tok_keyword_enum:
+                parser_set_base(p, &base, AstBase_enum);
+                operand = parse_enum(p);
+                continue;
+            case Tok_keyword__Atomic:
+                if(parser_peek(p, 1) != Tok_l_paren){
+                    flags |= AstFlag_atomic;
+                    break;
+                }
+                flags |= AstFlag_atomic;
+                // fallthrough
+            case Tok_keyword_typeof: case Tok_keyword_typeof_unqual:
+                parser_set_base(p, &base, AstBase_typeof);
+                parser_advance(p);
+                parser_expect(p, Tok_l_paren);
+                operand = parser_at_type(p) ? parse_type_name(p) : parse_expr_bp(p, PARSER_BP_EXPRESSION);
+                parser_expect(p, Tok_r_paren);
+                continue;
+            case Tok_keyword__BitInt:
+                parser_set_base(p, &base, AstBase_bitint);
+                parser_advance(p);
+                parser_expect(p, Tok_l_paren);
+                operand = parse_expr_bp(p, PARSER_BP_CONDITIONAL);
+                parser_expect(p, Tok_r_paren);
+                continue;
+            case Tok_keyword__Alignas: case Tok_keyword_alignas:
+                parser_advance(p);
+                if(parser_kind(p) == Tok_l_paren) parser_skip_group(p);
+                continue;
+            case Tok_identifier:
+                if(base == AstBase_implicit && !(longs | shorts | ints | signs | unsigns) && parser_guess_type(p)){
+                    base = AstBase_name;
+                    operand = parser_name(p);
+                    continue;
+                }
+                goto resolve;
+            default:
+                goto resolve;
+        }
+        parser_advance(p);
+    }
+resolve:
+    if(signs && unsigns) parser_report(p, ParseError_invalid_type, Tok_eof);
+    if(base == AstBase_implicit){
+        if(shorts) base = unsigns ? AstBase_ushort : AstBase_short;
+        else if(longs >= 2) base = unsigns ? AstBase_ullong : AstBase_llong;
+        else if(longs) base = unsigns ? AstBase_ulong : AstBase_long;
+        else if(ints || signs || unsigns) base = unsigns ? AstBase_uint : AstBase_int;
+        if(ints > 1 || longs > 2 || shorts > 1 || (shorts && longs)) parser_report(p, ParseError_invalid_type, Tok_eof);
+    }else if(base == AstBase_char && !(longs | shorts | ints)){
+        if(signs) base = AstBase_schar;
+        if(unsigns) base = AstBase_uchar;
+    }else if(base == AstBase_double && longs == 1 && !(shorts | ints | signs | unsigns)){
+        base = AstBase_ldouble;
+    }else if(longs | shorts | ints | signs | unsigns){
+        parser_report(p, ParseError_invalid_type, Tok_eof);
+    }
+    uint32_t node = parser_node(p, Ast_type_base, token, base, operand);
+    p->ast->nodes[node].flags = flags;
+    return node;
+}
+
+static uint32_t parse_parameters(Parser* p, bool* variadic){
+    uint32_t top = p->scratch_len;
+    if(parser_kind(p) == Tok_keyword_void && parser_peek(p, 1) == Tok_r_paren) parser_advance(p);
+    while(parser_kind(p) != Tok_r_paren && parser_kind(p) != Tok_eof && !p->recovering){
+        if(parser_accept(p, Tok_ellipsis3)){
+            *variadic = true;
+            break;
+        }
+        uint32_t first = p->pos;
+        uint32_t name = PARSER_NO_NAME;
+        uint16_t storage = 0;
+        uint32_t type;
+        TokenKind next = parser_peek(p, 1);
+        if(parser_kind(p) == Tok_identifier && !parser_is_type(p, p->pos) && (next == Tok_comma || next == Tok_r_paren)){
+            // an identifier list of an old style definition
+            type = parser_node(p, Ast_type_base, parser_token(p), AstBase_implicit, 0);
+            name = p->pos;
+            parser_advance(p);
+        }else if(parser_at_declaration(p)){
+            uint32_t base = parse_specifiers(p, &storage);
+            type = parse_declarator(p, base, &name);
+        }else{
+            parser_report(p, ParseError_expected_declaration, Tok_eof);
+            break;
+        }
+        parser_push(p, parser_decl(p, Ast_param, name, first, type, 0, storage));
+        if(!parser_accept(p, Tok_comma)) break;
+    }
+    parser_expect(p, Tok_r_paren);
+    return parser_list(p, top);
+}
+
+// Array and function suffixes, applied right to left: `a[2][3]` is an array
+// of 2 arrays of 3.
+static uint32_t parse_suffixes(Parser* p, uint32_t type){
+    TokenKind kind = parser_kind(p);
+    if(kind != Tok_l_bracket && kind != Tok_l_paren) return type;
+    if(!parser_enter(p)) return type;
+    uint32_t token = parser_token(p);
+    parser_advance(p);
+    uint32_t node;
+    if(kind == Tok_l_bracket){
+        while(parser_kind(p) == Tok_keyword_static || parser_qualifier_keyword(parser_kind(p))) parser_advance(p);
+        uint32_t size = 0;
+        if(parser_kind(p) == Tok_asterisk && parser_peek(p, 1) == Tok_r_bracket){
+            parser_advance(p);
+        }else if(parser_kind(p) != Tok_r_bracket){
+            size = parse_expr_bp(p, PARSER_BP_ASSIGN);
+        }
+        parser_expect(p, Tok_r_bracket);
+        node = parser_node(p, Ast_type_array, token, parse_suffixes(p, type), size);
+    }else{
+        bool variadic = false;
+        uint32_t params = parse_parameters(p, &variadic);
+        node = parser_op_node(p, Ast_type_function, variadic ? Tok_ellipsis3 : Tok_eof, token, parse_suffixes(p, type), params);
+    }
+    p->depth -= 1;
+    return node;
+}
+
+// Whether the `(` here opens a nested declarator, as in `int (*f)(void)`,
+// rather than parameters.
+static bool parser_nested_declarator(const Parser* p){
+    TokenKind next = parser_peek(p, 1);
+    if(next == Tok_asterisk || next == Tok_l_paren || next == Tok_caret) return true;
+    return next == Tok_identifier && !parser_is_type(p, p->pos + 1);
+}
+
+// Parses a declarator, abstract or not, around `type` and returns the type
+// it declares, `name` gets the position of the identifier. The suffixes
+// after a nested declarator apply before it: in `int (*f)[3]` f points to
+// arrays, so the nested part is built over a placeholder node that the
+// suffixed type is copied into.
+static uint32_t parse_declarator(Parser* p, uint32_t type, uint32_t* name){
+    if(!parser_enter(p)) return type;
+    for(;;){
+        TokenKind kind = parser_kind(p);
+        if(kind != Tok_asterisk && kind != Tok_caret) break;
+        uint32_t token = parser_token(p);
+        parser_advance(p);
+        uint16_t flags = parse_qualifiers(p);
+        type = parser_node(p, Ast_type_pointer, token, type, 0);
+        p->ast->nodes[type].flags = flags;
+    }
+    if(parser_kind(p) == Tok_l_paren && parser_nested_declarator(p)){
+        parser_advance(p);
+        uint32_t hole = parser_error_node(p);
+        uint32_t inner = parse_declarator(p, hole, name);
+        parser_expect(p, Tok_r_paren);
+        type = parse_suffixes(p, type);
+        p->ast->nodes[hole] = p->ast->nodes[type];
+        type = inner;
+    }else{
+        if(parser_kind(p) == Tok_identifier){
+            *name = p->pos;
+            parser_advance(p);
+        }
+        type = parse_suffixes(p, type);
+    }
+    p->depth -= 1;
+    return type;
+}
+
+static uint32_t parse_type_name(Parser* p){
+    uint32_t start = p->pos;
+    uint16_t storage = 0;
+    uint32_t base = parse_specifiers(p, &storage);
+    if(p->pos == start) parser_report(p, ParseError_expected_type, Tok_eof);
+    uint32_t name = PARSER_NO_NAME;
+    return parse_declarator(p, base, &name);
+}
+
+static uint32_t parse_static_assert(Parser* p){
+    uint32_t token = parser_token(p);
+    parser_advance(p);
+    parser_expect(p, Tok_l_paren);
+    uint32_t condition = parse_expr_bp(p, PARSER_BP_ASSIGN);
+    uint32_t message = parser_accept(p, Tok_comma) ? parse_expr_bp(p, PARSER_BP_ASSIGN) : 0;
+    parser_expect(p, Tok_r_paren);
+    parser_expect(p, Tok_semicolon);
+    return parser_node(p, Ast_static_assert, token, condition, message);
+}
+
+// let name [: type] [= initializer], ... ;
+static void parse_let(Parser* p){
+    parser_advance(p);
+    do{
+        if(parser_kind(p) != Tok_identifier){
+            parser_report(p, ParseError_expected_name, Tok_eof);
+            return;
+        }
+        uint32_t name = p->pos;
+        parser_advance(p);
+        uint32_t type = parser_accept(p, Tok_colon) ? parse_type_name(p) : 0;
+        uint32_t init = parser_accept(p, Tok_equal) ? parse_initializer(p) : 0;
+        parser_push(p, parser_decl(p, Ast_let_decl, name, name, type, init, 0));
+    }while(!p->recovering && parser_accept(p, Tok_comma));
+    parser_expect(p, Tok_semicolon);
+}
+
+
+// Parses one declaration and pushes its nodes, one per declarator or the
+// type alone for `struct s {...};`. A function declarator followed by a body
+// is a definition and ends the declaration.
+static void parse_declaration(Parser* p){
+    TokenKind kind = parser_kind(p);
+    if(kind == Tok_keyword_let){
+        parse_let(p);
+        return;
+    }
+    if(kind == Tok_keyword_static_assert || kind == Tok_keyword__Static_assert){
+        parser_push(p, parse_static_assert(p));
+        return;
+    }
+    uint32_t first = p->pos;
+    uint16_t storage = 0;
+    uint32_t base = parse_specifiers(p, &storage);
+    if(parser_accept(p, Tok_semicolon)){
+        parser_push(p, base);
+        return;
+    }
+    do{
+        uint32_t name = PARSER_NO_NAME;
+        uint32_t type = parse_declarator(p, base, &name);
+        if(name == PARSER_NO_NAME){
+            parser_report(p, ParseError_expected_name, Tok_eof);
+            return;
+        }
+        bool function = p->ast->nodes[type].kind == Ast_type_function;
+        if(storage & AstFlag_typedef){
+            parser_add_type(p, name);
+            parser_push(p, parser_decl(p, Ast_typedef_decl, name, first, type, 0, storage));
+        }else if(function && parser_kind(p) == Tok_l_brace){
+            uint32_t body = parse_block(p);
+            parser_push(p, parser_decl(p, Ast_fn_decl, name, first, type, body, storage));
+            return;
+        }else if(function){
+            parser_push(p, parser_decl(p, Ast_fn_decl, name, first, type, 0, storage));
+        }else{
+            uint32_t init = parser_accept(p, Tok_equal) ? parse_initializer(p) : 0;
+            parser_push(p, parser_decl(p, Ast_var_decl, name, first, type, init, storage));
+        }
+    }while(!p->recovering && parser_accept(p, Tok_comma));
+    parser_expect(p, Tok_semicolon);
+}
+
+// A member declaration of a struct or union: the declarators may have a bit
+// width or be left out, for an anonymous member or padding.
+static void parse_field_declaration(Parser* p){
+    TokenKind kind = parser_kind(p);
+    if(kind == Tok_keyword_static_assert || kind == Tok_keyword__Static_assert){
+        parser_push(p, parse_static_assert(p));
+        return;
+    }
+    uint32_t first = p->pos;
+    uint16_t storage = 0;
+    uint32_t base = parse_specifiers(p, &storage);
+    if(p->pos == first){
+        parser_report(p, ParseError_expected_declaration, Tok_eof);
+        return;
+    }
+    if(parser_accept(p, Tok_semicolon)){
+        parser_push(p, parser_decl(p, Ast_field, PARSER_NO_NAME, first, base, 0, storage));
+        return;
+    }
+    do{
+        uint32_t name = PARSER_NO_NAME;
+        uint32_t type = parser_kind(p) == Tok_colon ? base : parse_declarator(p, base, &name);
+        uint32_t width = parser_accept(p, Tok_colon) ? parse_expr_bp(p, PARSER_BP_CONDITIONAL) : 0;
+        parser_push(p, parser_decl(p, Ast_field, name, first, type, width, storage));
+    }while(!p->recovering && parser_accept(p, Tok_comma));
+    parser_expect(p, Tok_semicolon);
+}
+
+// declarations where a statement is expected, after a label or in a for
+static uint32_t parse_decl_list(Parser* p){
+    uint32_t token = parser_token(p);
+    uint32_t top = p->scratch_len;
+    parse_declaration(p);
+    return parser_node(p, Ast_decl_list, token, parser_list(p, top), 0);
+}
+
+static uint32_t parse_block(Parser* p){
+    uint32_t token = parser_token(p);
+    if(!parser_expect(p, Tok_l_brace) || !parser_enter(p)) return parser_error_node(p);
+    uint32_t top = p->scratch_len;
+    while(parser_kind(p) != Tok_r_brace && parser_kind(p) != Tok_eof){
+        uint32_t before = p->pos;
+        if(parser_at_declaration(p)){
+            parse_declaration(p);
+        }else{
+            parser_push(p, parse_statement(p));
+        }
+        if(p->recovering) parser_sync(p);
+        if(p->pos == before) parser_advance(p);
+    }
+    parser_expect(p, Tok_r_brace);
+    p->depth -= 1;
+    return parser_node(p, Ast_block, token, parser_list(p, top), 0);
+}
+
+// the statement after a label, C23 lets a label end a block
+static uint32_t parse_labeled(Parser* p){
+    if(parser_kind(p) == Tok_r_brace) return 0;
+    return parse_statement(p);
+}
+
+static uint32_t parse_paren_expr(Parser* p){
+    parser_expect(p, Tok_l_paren);
+    uint32_t expr = parse_expr_bp(p, PARSER_BP_EXPRESSION);
+    parser_expect(p, Tok_r_paren);
+    return expr;
+}
+
+static uint32_t parse_statement(Parser* p){
+    if(!parser_enter(p)) return parser_error_node(p);
+    TokenKind kind = parser_kind(p);
+    uint32_t token = parser_token(p);
+    uint32_t node;
+    switch(kind){
+        case Tok_l_brace:
+            node = parse_block(p);
+            break;
+        case Tok_semicolon:
+            parser_advance(p);
+            node = parser_node(p, Ast_empty, token, 0, 0);
+            break;
+        case Tok_keyword_if: {
+            parser_advance(p);
+            uint32_t condition = parse_paren_expr(p);
+            uint32_t then = parse_statement(p);
+            uint32_t other = parser_accept(p, Tok_keyword_else) ? parse_statement(p) : 0;
+            node = parser_node(p, Ast_if, token, condition, parser_pair(p, then, other));
+            break;
+        }
+        case Tok_keyword_while: case Tok_keyword_switch: {
+            parser_advance(p);
+            uint32_t condition = parse_paren_expr(p);
+            node = parser_node(p, kind == Tok_keyword_while ? Ast_while : Ast_switch, token, condition, parse_statement(p));
+            break;
+        }
+        case Tok_keyword_do: {
+            parser_advance(p);
+            uint32_t body = parse_statement(p);
+            parser_expect(p, Tok_keyword_while);
+            uint32_t condition = parse_paren_expr(p);
+            parser_expect(p, Tok_semicolon);
+            node = parser_node(p, Ast_do_while, token, body, condition);
+            break;
+        }
+        case Tok_keyword_for: {
+            parser_advance(p);
+            parser_expect(p, Tok_l_paren);
+            uint32_t parts[3] = {0};
+            if(parser_at_declaration(p)){
+                parts[0] = parse_decl_list(p);
+            }else{
+                if(parser_kind(p) != Tok_semicolon) parts[0] = parse_expr_bp(p, PARSER_BP_EXPRESSION);
+                parser_expect(p, Tok_semicolon);
+            }
+            if(parser_kind(p) != Tok_semicolon) parts[1] = parse_expr_bp(p, PARSER_BP_EXPRESSION);
+            parser_expect(p, Tok_semicolon);
+            if(parser_kind(p) != Tok_r_paren) parts[2] = parse_expr_bp(p, PARSER_BP_EXPRESSION);
+            parser_expect(p, Tok_r_paren);
+            uint32_t head = parser_extra(p, parts, 3);
+            node = parser_node(p, Ast_for, token, head, parse_statement(p));
+            break;
+        }
+        case Tok_keyword_case: {
+            parser_advance(p);
+            uint32_t value = parse_expr_bp(p, PARSER_BP_CONDITIONAL);
+            if(parser_kind(p) == Tok_ellipsis3){
+                uint32_t range = parser_token(p);
+                parser_advance(p);
+                value = parser_op_node(p, Ast_binary, Tok_ellipsis3, range, value, parse_expr_bp(p, PARSER_BP_CONDITIONAL));
+            }
+            parser_expect(p, Tok_colon);
+            node = parser_node(p, Ast_case, token, value, parse_labeled(p));
+            break;
+        }
+        case Tok_keyword_default:
+            parser_advance(p);
+            parser_expect(p, Tok_colon);
+            node = parser_node(p, Ast_default, token, parse_labeled(p), 0);
+            break;
+        case Tok_keyword_goto:
+            parser_advance(p);
+            node = parser_node(p, Ast_goto, token, parser_name(p), 0);
+            parser_expect(p, Tok_semicolon);
+            break;
+        case Tok_keyword_return: {
+            parser_advance(p);
+            uint32_t value = parser_kind(p) == Tok_semicolon ? 0 : parse_expr_bp(p, PARSER_BP_EXPRESSION);
+            parser_expect(p, Tok_semicolon);
+            node = parser_node(p, Ast_return, token, value, 0);
+            break;
+        }
+        case Tok_keyword_break: case Tok_keyword_continue:
+            parser_advance(p);
+            parser_expect(p, Tok_semicolon);
+            node = parser_node(p, kind == Tok_keyword_break ? Ast_break : Ast_continue, token, 0, 0);
+            break;
+        default:
+            if(kind == Tok_identifier && parser_peek(p, 1) == Tok_colon){
+                parser_advance(p);
+                parser_advance(p);
+                node = parser_node(p, Ast_label, token, parse_labeled(p), 0);
+            }else if(parser_at_declaration(p)){
+                node = parse_decl_list(p);
+            }else{
+                uint32_t expr = parse_expr_bp(p, PARSER_BP_EXPRESSION);
+                parser_expect(p, Tok_semicolon);
+                node = parser_node(p, Ast_expr_stmt, token, expr, 0);
+            }
+            break;
+    }
+    p->depth -= 1;
+    return node;
+}
+
+// Where a directive that starts at `offset` ends: the first newline not
+// escaped by a backslash.
+static uint32_t parser_line_end(const char* source, uint32_t src_len, uint32_t offset){
+    for(;;){
+        const char* newline = memchr(source + offset, '\n', src_len - offset);
+        if(!newline) return src_len;
+        offset = (uint32_t)(newline - source);
+        bool escaped = (offset >= 1 && source[offset - 1] == '\\')
+            || (offset >= 2 && source[offset - 1] == '\r' && source[offset - 2] == '\\');
+        if(!escaped) return offset;
+        offset += 1;
+    }
+}
+
+static TokenKind parser_gnu_word(const char* name, uint32_t len){
+    for(uint32_t i = 0; i < sizeof(ParserGnuWords) / sizeof(ParserGnuWords[0]); i++){
+        const ParserGnuWord* w = &ParserGnuWords[i];
+        if(w->len == len && !memcmp(w->name, name, len)) return w->kind;
+    }
+    return Tok_identifier;
+}
+
+// the token closing the group opened at `i`, the last one before the end
+// when it is never closed
+static uint32_t parser_group_end(const TokenBuffer* buf, uint32_t i, TokenKind open, TokenKind close){
+    uint32_t depth = 0;
+    for(; i < buf->len && buf->kinds[i] != Tok_eof; i++){
+        if(buf->kinds[i] == open) depth += 1;
+        else if(buf->kinds[i] == close && --depth == 0) return i;
+    }
+    return i - 1;
+}
+
+// every GNU word starts with `_` or `a`, most identifiers are settled by
+// their first byte without measuring them
+static TokenKind parser_view_word(const Parser* p, uint32_t i){
+    const char* name = p->source + p->tokens->offsets[i];
+    if(name[0] != '_' && name[0] != 'a') return Tok_identifier;
+    Token tok = token_buffer_get(p->tokens, p->source, i);
+    return parser_gnu_word(name, tok.loc.len);
+}
+
+// Picks the tokens the grammar sees: directive lines go, GNU keyword
+// spellings become the keywords and attributes, asm labels and `[[...]]`
+// are dropped with their operands.
+static void parser_view(Parser* p, uint32_t src_len){
+    const TokenBuffer* buf = p->tokens;
+    p->kinds = malloc(buf->len + 1);
+    p->index = malloc((buf->len + 1) * sizeof(uint32_t));
+    if(!p->kinds || !p->index){
+        fprintf(stderr, "[Parsing Error]: failed to allocate the view of %u tokens\n", buf->len);
+        exit(1);
+    }
+    uint32_t n = 0;
+    uint32_t i = 0;
+    for(; i < buf->len; i++){
+        TokenKind kind = (TokenKind)buf->kinds[i];
+        if(kind == Tok_eof) break;
+        if(kind == Tok_hash || kind >= Tok_builtin_include){
+            uint32_t end = parser_line_end(p->source, src_len, buf->offsets[i]);
+            while(i + 1 < buf->len && buf->kinds[i + 1] != Tok_eof && buf->offsets[i + 1] < end) i += 1;
+            continue;
+        }
+        if(kind == Tok_identifier){
+            TokenKind word = parser_view_word(p, i);
+            if(word == Tok_eof) continue;
+            if(word == Tok_l_paren){
+                // asm statements may have qualifiers before the operands
+                uint32_t j = i + 1;
+                for(; j < buf->len; j++){
+                    TokenKind k = (TokenKind)buf->kinds[j];
+                    if(k == Tok_identifier) k = parser_view_word(p, j);
+                    if(k != Tok_keyword_volatile && k != Tok_keyword_inline && k != Tok_keyword_goto) break;
+                }
+                if(j < buf->len && buf->kinds[j] == Tok_l_paren) i = parser_group_end(buf, j, Tok_l_paren, Tok_r_paren);
+                continue;
+            }
+            kind = word;
+        }
+        if(kind == Tok_l_bracket && i + 1 < buf->len && buf->kinds[i + 1] == Tok_l_bracket){
+            i = parser_group_end(buf, i, Tok_l_bracket, Tok_r_bracket);
+            continue;
+        }
+        p->kinds[n] = (uint8_t)kind;
+        p->index[n] = i;
+        n += 1;
+    }
+    p->kinds[n] = Tok_eof;
+    p->index[n] = i;
+    p->len = n + 1;
+}
+
+static void parse_translation_unit(Parser* p){
+    uint32_t top = p->scratch_len;
+    uint32_t linkage = 0;
+    while(parser_kind(p) != Tok_eof){
+        uint32_t before = p->pos;
+        if(parser_kind(p) == Tok_r_brace){
+            if(linkage){
+                linkage -= 1;
+            }else{
+                parser_report(p, ParseError_stray_brace, Tok_eof);
+                p->recovering = false;
+            }
+            parser_advance(p);
+            continue;
+        }
+        if(parser_accept(p, Tok_semicolon)) continue;
+        // `extern "C"` from both sides of an `#ifdef __cplusplus`
+        if(parser_kind(p) == Tok_keyword_extern && parser_peek(p, 1) == Tok_string_literal){
+            parser_advance(p);
+            parser_advance(p);
+            if(parser_accept(p, Tok_l_brace)) linkage += 1;
+            continue;
+        }
+        parse_declaration(p);
+        if(p->recovering) parser_sync(p);
+        if(p->pos == before) parser_advance(p);
+    }
+    p->ast->nodes[0].lhs = parser_list(p, top);
+}
+
+// Parses `tokens`, lexed from `source`, into the tree and returns the number
+// of diagnostics. The buffer must outlive the tree, nodes index it. Reuses
+// the storage of a previous parse; with an arena that storage is gone after
+// an arena_reset, ast_init it again.
+uint32_t ast_parse(Ast* ast, const char* source, uint32_t src_len, const TokenBuffer* tokens){
+    ast->source = source;
+    ast->src_len = src_len;
+    ast->tokens = tokens;
+    ast->node_len = 0;
+    ast->extra_len = 0;
+    ast->diag_len = 0;
+    Parser p = { .ast = ast, .source = source, .tokens = tokens };
+    parser_view(&p, src_len);
+    ast_reserve(ast, p.len / AST_TOKENS_PER_NODE + 64, p.len / AST_TOKENS_PER_EXTRA + 64);
+    interner_init(&p.types, 0);
+    parser_node(&p, Ast_root, p.index[0], 0, 0);
+    parser_extra(&p, (uint32_t[]){ 0 }, 1);
+    parse_translation_unit(&p);
+    interner_deinit(&p.types);
+    free(p.kinds);
+    free(p.index);
+    free(p.scratch);
+    return ast->diag_len;
+}
+
+// Lexes what is left of `lexer`, a source in memory, into ast->lexed and
+// parses it. The lexer keeps its own diagnostics.
+uint32_t ast_parse_lexer(Ast* ast, Lexer* lexer){
+    if(ast->lexed.arena != ast->arena || !ast->lexed.cap){
+        token_buffer_deinit(&ast->lexed);
+        token_buffer_init_arena(&ast->lexed, 0, lexer->src_len - lexer->index, ast->arena);
+    }
+    token_buffer_reset(&ast->lexed);
+    lexer_tokenize_all(lexer, &ast->lexed);
+    return ast_parse(ast, lexer->source, lexer->src_len, &ast->lexed);
+}
+
+StrView ast_token_text(const Ast* ast, uint32_t token){
+    if(token >= ast->tokens->len) return (StrView){ "", 0 };
+    Token tok = token_buffer_get(ast->tokens, ast->source, token);
+    return (StrView){ ast->source + tok.loc.offset, tok.loc.len };
+}
+
+const char* ast_kind_to_str(AstKind kind){
+    if((uint32_t)kind < AST_KIND_COUNT) return AstKindNames[kind];
+    return "Error: Unknown node kind";
+}
+
+const char* ast_base_to_str(AstBase base){
+    if((uint32_t)base < sizeof(AstBaseNames) / sizeof(AstBaseNames[0])) return AstBaseNames[base];
+    return "Error: Unknown base type";
+}
+
+const char* parse_error_to_str(ParseError code){
+    if((uint32_t)code < sizeof(ParseErrorTexts) / sizeof(ParseErrorTexts[0])) return ParseErrorTexts[code];
+    return "Error: Unknown parse error";
+}
+
+static void ast_print_node(const Ast* ast, uint32_t node, uint32_t depth, FILE* out);
+
+static void ast_print_field(const Ast* ast, AstField field, uint32_t value, uint32_t depth, FILE* out){
+    uint32_t count = 0;
+    const uint32_t* nodes = ast->extra + value;
+    switch(field){
+        case AstField_node: count = value != 0; nodes = &value; break;
+        case AstField_list: count = ast->extra[value]; nodes += 1; break;
+        case AstField_pair: count = 2; break;
+        case AstField_triple: count = 3; break;
+        default: break;
+    }
+    for(uint32_t i = 0; i < count; i++){
+        if(nodes[i]){
+            ast_print_node(ast, nodes[i], depth, out);
+        }else{
+            fprintf(out, "\n%*s-", (int)depth * 2, "");
+        }
+    }
+}
+
+static void ast_print_node(const Ast* ast, uint32_t node, uint32_t depth, FILE* out){
+    const AstNode* n = &ast->nodes[node];
+    StrView text = ast_token_text(ast, n->token);
+    fprintf(out, "%s%*s(%s", depth ? "\n" : "", (int)depth * 2, "", ast_kind_to_str((AstKind)n->kind));
+    if(n->op) fprintf(out, " %s", parser_spelling((TokenKind)n->op));
+    switch(n->kind){
+        case Ast_ident: case Ast_number: case Ast_float_number: case Ast_char_literal: case Ast_string:
+        case Ast_bool_literal: case Ast_type_record: case Ast_label:
+            fprintf(out, " %.*s", (int)text.len, text.ptr);
+            break;
+        case Ast_var_decl: case Ast_let_decl: case Ast_fn_decl: case Ast_typedef_decl:
+        case Ast_param: case Ast_field: case Ast_enumerator:
+            if(!(n->flags & AstFlag_unnamed)) fprintf(out, " %.*s", (int)text.len, text.ptr);
+            break;
+        case Ast_type_base:
+            fprintf(out, " %s", ast_base_to_str((AstBase)n->lhs));
+            break;
+        default:
+            break;
+    }
+    for(uint32_t bit = 0; bit < AST_FLAG_COUNT; bit++){
+        if(n->flags & (1u << bit)) fprintf(out, " %s", AstFlagNames[bit]);
+    }
+    ast_print_field(ast, (AstField)AstKindLhs[n->kind], n->lhs, depth + 1, out);
+    ast_print_field(ast, (AstField)AstKindRhs[n->kind], n->rhs, depth + 1, out);
+    fprintf(out, ")");
+}
+
+// Prints the tree under `node` as nested lists, one node per line.
+void ast_print(const Ast* ast, uint32_t node, FILE* out){
+    ast_print_node(ast, node, 0, out);
+    fprintf(out, "\n");
+}
+
+void ast_print_diagnostics(const Ast* ast, FILE* out, const char* file_name){
+    const TokenBuffer* buf = ast->tokens;
+    LineIndex index = {0};
+    if(!buf->lines && ast->diag_len) line_index_build(&index, ast->source, ast->src_len);
+    for(uint32_t i = 0; i < ast->diag_len; i++){
+        const ParserDiagnostic* d = &ast->diags[i];
+        bool end = d->token >= buf->len || buf->kinds[d->token] == Tok_eof;
+        uint32_t line = 0;
+        if(buf->lines && d->token < buf->len) line = buf->lines[d->token];
+        else if(index.source) line = line_index_lookup(&index, end ? index.src_len : buf->offsets[d->token]).line;
+        fprintf(out, "[Parsing Error]: %s:%u: %s", file_name, line, parse_error_to_str(d->code));
+        if(d->code == ParseError_expected_token) fprintf(out, " `%s`", parser_spelling(d->expected));
+        if(end){
+            fprintf(out, " at the end of the file\n");
+        }else{
+            StrView text = ast_token_text(ast, d->token);
+            fprintf(out, " before `%.*s`\n", (int)text.len, text.ptr);
+        }
+    }
+    line_index_deinit(&index);
+}
+
+#endif // IMPEL_C_PARSER
+
+#ifdef __cplusplus
+}
+#endif
+#endif // C_PARSER_H
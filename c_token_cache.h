@@ -0,0 +1,442 @@
+// you need to define IMPEL_C_TOKEN_CACHE before including this header
+// (c_lexer.h still needs IMPEL_C_LEXER in one translation unit)
+//
+// Keeps the tokens of lexed files in a cache directory, so a run over an
+// unchanged tree maps them back instead of lexing again. An entry is named
+// after a hash of the file content and its size, not after its path: a
+// renamed or copied file still hits, an edited one simply misses.
+// An entry is one flat file that is mapped read-only and used in place:
+//   TokenCacheHeader, padded to TOKEN_CACHE_ALIGN
+//   kinds[count] offsets[count] [lengths] [lines] [symbols] diagnostics[diag_count]
+//   name_offsets[name_count + 1] names
+// every column starting on a TOKEN_CACHE_ALIGN boundary. Symbols are stored
+// as ids local to the file (1..name_count, into the names column) because
+// interner ids only mean something within one run; loading interns the
+// names again and rewrites the ids. The lexer's diagnostics and final line
+// are stored too, so a hit leaves the Lexer as lexing would have.
+// Entries carry a version, the configuration of the lexer that wrote them
+// and a hash of the header and of the payload; anything that doesn't match
+// is a miss, and a corrupt entry is removed. Entries are written to a
+// temporary file and renamed into place, so concurrent writers of the same
+// entry are safe and readers never see half of one.
+
+#ifndef C_TOKEN_CACHE_H
+#define C_TOKEN_CACHE_H
+#include "c_lexer.h"
+#include <errno.h>
+#include <stdatomic.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TOKEN_CACHE_VERSION 4
+#define TOKEN_CACHE_MAGIC "clextok"
+#define TOKEN_CACHE_ALIGN 64
+
+// What makes tokens of the same source differ between builds: the token
+// kind numbering (and with it the dialect), line counting and the layout of
+// a diagnostic. Entries written under another configuration are misses.
+#define TOKEN_CACHE_CONFIG \
+    ((uint32_t)TOKEN_KIND_COUNT | (uint32_t)C_LEXER_DIALECT << 10 | (uint32_t)LEXER_FIRST_LINE << 14 \
+     | (uint32_t)sizeof(LexerDiagnostic) << 16)
+
+typedef enum TokenCacheStatus {
+    TokenCache_hit,
+    TokenCache_miss,    // no entry, or one of another version or configuration
+    TokenCache_corrupt, // the entry failed a check and was removed
+    TokenCache_io,      // the entry could not be read or written
+} TokenCacheStatus;
+
+typedef struct TokenCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t config;       // TOKEN_CACHE_CONFIG of the writer
+    uint64_t source_hash;  // token_cache_hash of the source
+    uint64_t source_size;
+    uint32_t count;        // tokens, Tok_eof included
+    uint32_t flags;        // TokenBufferFlags of the stored columns
+    uint32_t diag_count;
+    uint32_t name_count;
+    uint32_t names_bytes;
+    uint32_t end_line;     // Lexer.line after Tok_eof
+    uint64_t payload_size; // bytes after the padded header
+    uint64_t payload_hash;
+    uint64_t header_hash;  // of every field above
+} TokenCacheHeader;
+
+// A mapped entry, the columns point into the mapping.
+typedef struct TokenCacheFile {
+    void* map;
+    size_t map_size;
+    const TokenCacheHeader* header;
+    const uint8_t* kinds;
+    const uint32_t* offsets;
+    const uint32_t* lengths; // NULL when not stored
+    const uint32_t* lines;
+    const uint32_t* symbols; // file local ids
+    const LexerDiagnostic* diags;
+    const uint32_t* name_offsets;
+    const char* names;
+} TokenCacheFile;
+
+uint64_t token_cache_hash(const void* data, size_t len);
+void token_cache_path(const char* dir, uint64_t hash, uint64_t size, char* out, size_t cap);
+TokenCacheStatus token_cache_open(TokenCacheFile* entry, const char* dir, uint64_t hash, uint64_t size, uint32_t flags);
+void token_cache_close(TokenCacheFile* entry);
+void token_cache_fill(const TokenCacheFile* entry, const char* source, TokenBuffer* out, Lexer* lexer);
+TokenCacheStatus token_cache_load(const char* dir, uint64_t hash, const char* source, uint32_t src_len, TokenBuffer* out, Lexer* lexer);
+bool token_cache_store(const char* dir, uint64_t hash, uint32_t src_len, const TokenBuffer* tokens, const Lexer* lexer);
+
+#ifdef IMPEL_C_TOKEN_CACHE
+
+static inline uint64_t token_cache_mix(uint64_t h, uint64_t w){
+    h = (h ^ w) * 0xbf58476d1ce4e5b9ull;
+    return h ^ (h >> 29);
+}
+
+// Four independent multiply-xorshift lanes over 32 byte blocks, so the
+// multiplies overlap and hashing a file costs a small fraction of lexing
+// it. Not a cryptographic hash: it tells content apart and catches torn or
+// bit-flipped entries, it does not resist someone forging them.
+uint64_t token_cache_hash(const void* data, size_t len){
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h0 = 0x9e3779b97f4a7c15ull ^ len, h1 = 0x94d049bb133111ebull, h2 = 0x2545f4914f6cdd1dull, h3 = 0xd6e8feb86659fd93ull;
+    while(len >= 32){
+        uint64_t w[4];
+        memcpy(w, p, 32);
+        h0 = token_cache_mix(h0, w[0]);
+        h1 = token_cache_mix(h1, w[1]);
+        h2 = token_cache_mix(h2, w[2]);
+        h3 = token_cache_mix(h3, w[3]);
+        p += 32;
+        len -= 32;
+    }
+    uint64_t w[4] = {0};
+    memcpy(w, p, len);
+    h0 = token_cache_mix(h0, w[0]);
+    h1 = token_cache_mix(h1, w[1]);
+    h2 = token_cache_mix(h2, w[2]);
+    h3 = token_cache_mix(h3, w[3]);
+    uint64_t h = token_cache_mix(token_cache_mix(token_cache_mix(h0, h1), h2), h3);
+    h ^= h >> 31;
+    h *= 0x94d049bb133111ebull;
+    return h ^ (h >> 32);
+}
+
+// `dir/ab/cdef…-size-config`: the first byte of the hash fans the entries
+// out over 256 directories, so none of them grows huge on a big tree.
+void token_cache_path(const char* dir, uint64_t hash, uint64_t size, char* out, size_t cap){
+    snprintf(out, cap, "%s/%02x/%014llx-%llx-%08x", dir, (unsigned)(hash >> 56),
+             (unsigned long long)(hash & 0x00ffffffffffffffull), (unsigned long long)size, TOKEN_CACHE_CONFIG);
+}
+
+static size_t token_cache_align(size_t n){
+    return (n + TOKEN_CACHE_ALIGN - 1) & ~(size_t)(TOKEN_CACHE_ALIGN - 1);
+}
+
+// Byte offsets of the columns of an entry, the last one is its total size.
+typedef struct TokenCacheLayout {
+    uint64_t kinds, offsets, lengths, lines, symbols, diags, name_offsets, names, end;
+} TokenCacheLayout;
+
+// Sizes come from the header, in 64 bit so no count can overflow them.
+static TokenCacheLayout token_cache_layout(const TokenCacheHeader* h){
+    TokenCacheLayout l;
+    uint64_t column = (uint64_t)h->count * sizeof(uint32_t);
+    l.kinds = token_cache_align(sizeof(TokenCacheHeader));
+    l.offsets = token_cache_align(l.kinds + h->count);
+    l.lengths = token_cache_align(l.offsets + column);
+    l.lines = token_cache_align(l.lengths + ((h->flags & TokenBuffer_lengths) ? column : 0));
+    l.symbols = token_cache_align(l.lines + ((h->flags & TokenBuffer_lines) ? column : 0));
+    l.diags = token_cache_align(l.symbols + ((h->flags & TokenBuffer_symbols) ? column : 0));
+    l.name_offsets = token_cache_align(l.diags + (uint64_t)h->diag_count * sizeof(LexerDiagnostic));
+    l.names = token_cache_align(l.name_offsets + ((uint64_t)h->name_count + 1) * sizeof(uint32_t));
+    l.end = l.names + h->names_bytes;
+    return l;
+}
+
+static uint64_t token_cache_header_hash(const TokenCacheHeader* h){
+    return token_cache_hash(h, offsetof(TokenCacheHeader, header_hash));
+}
+
+// Checks everything a reader relies on besides the payload hash: the
+// columns fit the mapping, offsets stay inside the source and local symbol
+// ids inside the names.
+static bool token_cache_valid(const TokenCacheFile* e){
+    const TokenCacheHeader* h = e->header;
+    if(h->count == 0 || e->kinds[h->count - 1] != Tok_eof) return false;
+    if(e->name_offsets[0] != 0 || e->name_offsets[h->name_count] != h->names_bytes) return false;
+    for(uint32_t i = 0; i < h->name_count; i++){
+        if(e->name_offsets[i] > e->name_offsets[i + 1]) return false;
+    }
+    for(uint32_t i = 0; i < h->count; i++){
+        if(e->kinds[i] >= TOKEN_KIND_COUNT || e->offsets[i] > h->source_size) return false;
+        if(e->symbols && e->symbols[i] > h->name_count) return false;
+    }
+    return true;
+}
+
+// Maps the entry of a source and checks it. `flags` are the TokenBufferFlags
+// the caller needs: an entry without one of those columns is a miss.
+TokenCacheStatus token_cache_open(TokenCacheFile* e, const char* dir, uint64_t hash, uint64_t size, uint32_t flags){
+    *e = (TokenCacheFile){0};
+    char path[4096];
+    token_cache_path(dir, hash, size, path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    if(fd < 0) return errno == ENOENT ? TokenCache_miss : TokenCache_io;
+    struct stat st;
+    if(fstat(fd, &st) < 0){
+        close(fd);
+        return TokenCache_io;
+    }
+    size_t map_size = (size_t)st.st_size;
+    if(map_size < token_cache_align(sizeof(TokenCacheHeader))){
+        close(fd);
+        unlink(path);
+        return TokenCache_corrupt;
+    }
+    int map_flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    map_flags |= MAP_POPULATE;
+#endif
+    void* map = mmap(NULL, map_size, PROT_READ, map_flags, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return TokenCache_io;
+    e->map = map;
+    e->map_size = map_size;
+
+    const TokenCacheHeader* h = (const TokenCacheHeader*)map;
+    e->header = h;
+    TokenCacheStatus status = TokenCache_corrupt;
+    if(memcmp(h->magic, TOKEN_CACHE_MAGIC, sizeof(h->magic)) || token_cache_header_hash(h) != h->header_hash) goto fail;
+    // a well formed entry of another build, it gets replaced on store
+    status = TokenCache_miss;
+    if(h->version != TOKEN_CACHE_VERSION || h->config != TOKEN_CACHE_CONFIG || (flags & ~h->flags)) goto fail;
+    status = TokenCache_corrupt;
+    if(h->source_hash != hash || h->source_size != size) goto fail;
+
+    TokenCacheLayout l = token_cache_layout(h);
+    uint64_t payload = token_cache_align(sizeof(TokenCacheHeader));
+    if(l.end != map_size || h->payload_size != map_size - payload) goto fail;
+    if(token_cache_hash((const char*)map + payload, h->payload_size) != h->payload_hash) goto fail;
+
+    const char* base = (const char*)map;
+    e->kinds = (const uint8_t*)(base + l.kinds);
+    e->offsets = (const uint32_t*)(base + l.offsets);
+    e->lengths = (h->flags & TokenBuffer_lengths) ? (const uint32_t*)(base + l.lengths) : NULL;
+    e->lines = (h->flags & TokenBuffer_lines) ? (const uint32_t*)(base + l.lines) : NULL;
+    e->symbols = (h->flags & TokenBuffer_symbols) ? (const uint32_t*)(base + l.symbols) : NULL;
+    e->diags = (const LexerDiagnostic*)(base + l.diags);
+    e->name_offsets = (const uint32_t*)(base + l.name_offsets);
+    e->names = base + l.names;
+    if(!token_cache_valid(e)) goto fail;
+    return TokenCache_hit;
+
+fail:
+    token_cache_close(e);
+    if(status == TokenCache_corrupt) unlink(path);
+    return status;
+}
+
+void token_cache_close(TokenCacheFile* e){
+    if(e->map) munmap(e->map, e->map_size);
+    *e = (TokenCacheFile){0};
+}
+
+// Copies an open entry into `out`, as if `lexer` had just run
+// lexer_tokenize_all over `source`: the lexer is reset onto it and gets the
+// stored diagnostics and final line. With an interner on the lexer, the
+// file's names are interned into it in the order lexing would have and the
+// symbols column of `out`, if any, gets their ids; without one the symbols
+// read 0 as when lexing.
+void token_cache_fill(const TokenCacheFile* e, const char* source, TokenBuffer* out, Lexer* lexer){
+    const TokenCacheHeader* h = e->header;
+    uint32_t n = h->count;
+    lexer_reset(lexer, source, (uint32_t)h->source_size);
+    lexer->index = (uint32_t)h->source_size;
+    lexer->line = h->end_line;
+    for(uint32_t i = 0; i < h->diag_count; i++) lexer_report(lexer, e->diags[i].code, e->diags[i].loc);
+
+    uint32_t first = out->len;
+    token_buffer_reserve(out, first + n);
+    memcpy(out->kinds + first, e->kinds, n);
+    memcpy(out->offsets + first, e->offsets, n * sizeof(uint32_t));
+    if(out->lengths) memcpy(out->lengths + first, e->lengths, n * sizeof(uint32_t));
+    if(out->lines) memcpy(out->lines + first, e->lines, n * sizeof(uint32_t));
+    if(lexer->interner && e->symbols){
+        uint32_t* remap = (uint32_t*)malloc(((size_t)h->name_count + 1) * sizeof(uint32_t));
+        if(!remap){
+            fprintf(stderr, "[Lexing Error]: failed to allocate %u symbol remaps\n", h->name_count + 1);
+            exit(1);
+        }
+        remap[0] = 0;
+        for(uint32_t i = 0; i < h->name_count; i++){
+            uint32_t start = e->name_offsets[i];
+            remap[i + 1] = interner_intern(lexer->interner, e->names + start, e->name_offsets[i + 1] - start);
+        }
+        if(out->symbols) for(uint32_t i = 0; i < n; i++) out->symbols[first + i] = remap[e->symbols[i]];
+        free(remap);
+    }else if(out->symbols){
+        memset(out->symbols + first, 0, n * sizeof(uint32_t));
+    }
+    out->len = first + n;
+}
+
+// open + fill + close for the tokens of `source`, whose token_cache_hash is
+// `hash`, with the columns `out` has. A lexer with an interner needs the
+// stored symbols, whether `out` keeps them or not. Number values are not
+// stored, so a lexer with a NumberTable always misses.
+TokenCacheStatus token_cache_load(const char* dir, uint64_t hash, const char* source, uint32_t src_len, TokenBuffer* out, Lexer* lexer){
+    if(lexer->numbers) return TokenCache_miss;
+    uint32_t flags = out->flags & ~(uint32_t)TokenBuffer_symbols;
+    if(lexer->interner) flags |= TokenBuffer_symbols;
+    TokenCacheFile e;
+    TokenCacheStatus status = token_cache_open(&e, dir, hash, src_len, flags);
+    if(status != TokenCache_hit) return status;
+    token_cache_fill(&e, source, out, lexer);
+    token_cache_close(&e);
+    return TokenCache_hit;
+}
+
+static bool token_cache_write_all(int fd, const char* data, size_t len){
+    while(len){
+        ssize_t n = write(fd, data, len);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        data += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// Gives every distinct interner id among `symbols` a local id in order of
+// first use, and returns how many there are. `table` has `mask + 1` slots
+// of global << 32 | local, more than twice the distinct ids.
+static uint32_t token_cache_local_symbols(const uint32_t* symbols, uint32_t n, uint32_t* local, uint64_t* table, uint32_t mask){
+    uint32_t count = 0;
+    for(uint32_t i = 0; i < n; i++){
+        uint32_t s = symbols[i];
+        if(s == 0){
+            local[i] = 0;
+            continue;
+        }
+        uint32_t slot = (s * 0x9e3779b1u) & mask;
+        while(table[slot] && (uint32_t)(table[slot] >> 32) != s) slot = (slot + 1) & mask;
+        if(!table[slot]) table[slot] = (uint64_t)s << 32 | ++count;
+        local[i] = (uint32_t)table[slot];
+    }
+    return count;
+}
+
+// Writes the entry for `tokens`, the complete lexer_tokenize_all result of
+// a source of `src_len` bytes, with the columns the buffer has. Symbols are
+// only stored when `lexer` interned them, its interner gives their names;
+// an entry without them never hits a lexer that interns, so such a lexer
+// should fill a buffer with TokenBuffer_symbols. Nothing is stored for a
+// lexer with a NumberTable, its symbols mix in number indices.
+// Returns false when the entry could not be written.
+bool token_cache_store(const char* dir, uint64_t hash, uint32_t src_len, const TokenBuffer* tokens, const Lexer* lexer){
+    if(lexer->numbers) return false;
+    uint32_t n = tokens->len;
+    uint32_t flags = tokens->flags & (TokenBuffer_lengths | TokenBuffer_lines);
+    if(tokens->symbols && lexer->interner) flags |= TokenBuffer_symbols;
+
+    // local symbol ids and the names they stand for
+    uint32_t* local = NULL;
+    uint32_t* names_of = NULL;
+    uint32_t name_count = 0, names_bytes = 0;
+    if(flags & TokenBuffer_symbols){
+        uint32_t mask = 15;
+        while(mask < n * 2) mask = mask * 2 + 1;
+        uint64_t* table = (uint64_t*)calloc((size_t)mask + 1, sizeof(uint64_t));
+        local = (uint32_t*)malloc((size_t)n * sizeof(uint32_t));
+        if(!table || !local){
+            fprintf(stderr, "[Lexing Error]: failed to allocate the symbols of a %u token cache entry\n", n);
+            exit(1);
+        }
+        name_count = token_cache_local_symbols(tokens->symbols, n, local, table, mask);
+        names_of = (uint32_t*)malloc(((size_t)name_count + 1) * sizeof(uint32_t));
+        if(!names_of){
+            fprintf(stderr, "[Lexing Error]: failed to allocate %u cache entry names\n", name_count);
+            exit(1);
+        }
+        for(uint32_t slot = 0; slot <= mask; slot++){
+            if(!table[slot]) continue;
+            uint32_t global = (uint32_t)(table[slot] >> 32);
+            names_of[(uint32_t)table[slot] - 1] = global;
+            names_bytes += interner_get(lexer->interner, global).len;
+        }
+        free(table);
+    }
+
+    TokenCacheHeader h = {
+        .version = TOKEN_CACHE_VERSION,
+        .config = TOKEN_CACHE_CONFIG,
+        .source_hash = hash,
+        .source_size = src_len,
+        .count = n,
+        .flags = flags,
+        .diag_count = lexer->diag_len,
+        .name_count = name_count,
+        .names_bytes = names_bytes,
+        .end_line = lexer->line,
+    };
+    memcpy(h.magic, TOKEN_CACHE_MAGIC, sizeof(h.magic));
+    TokenCacheLayout l = token_cache_layout(&h);
+    char* data = (char*)calloc(1, l.end);
+    if(!data){
+        fprintf(stderr, "[Lexing Error]: failed to allocate a %llu bytes cache entry\n", (unsigned long long)l.end);
+        exit(1);
+    }
+    memcpy(data + l.kinds, tokens->kinds, n);
+    memcpy(data + l.offsets, tokens->offsets, (size_t)n * sizeof(uint32_t));
+    if(flags & TokenBuffer_lengths) memcpy(data + l.lengths, tokens->lengths, (size_t)n * sizeof(uint32_t));
+    if(flags & TokenBuffer_lines) memcpy(data + l.lines, tokens->lines, (size_t)n * sizeof(uint32_t));
+    if(flags & TokenBuffer_symbols) memcpy(data + l.symbols, local, (size_t)n * sizeof(uint32_t));
+    if(lexer->diag_len) memcpy(data + l.diags, lexer->diags, (size_t)lexer->diag_len * sizeof(LexerDiagnostic));
+    uint32_t* name_offsets = (uint32_t*)(data + l.name_offsets);
+    uint32_t at = 0;
+    for(uint32_t i = 0; i < name_count; i++){
+        StrView name = interner_get(lexer->interner, names_of[i]);
+        name_offsets[i] = at;
+        memcpy(data + l.names + at, name.ptr, name.len);
+        at += name.len;
+    }
+    name_offsets[name_count] = at;
+    free(local);
+    free(names_of);
+
+    uint64_t payload = token_cache_align(sizeof(TokenCacheHeader));
+    h.payload_size = l.end - payload;
+    h.payload_hash = token_cache_hash(data + payload, h.payload_size);
+    h.header_hash = token_cache_header_hash(&h);
+    memcpy(data, &h, sizeof(h));
+
+    char path[4096], tmp[4096 + 64];
+    token_cache_path(dir, hash, src_len, path, sizeof(path));
+    char* slash = strrchr(path, '/');
+    *slash = '\0';
+    mkdir(dir, 0777);
+    mkdir(path, 0777);
+    *slash = '/';
+    static _Atomic uint32_t token_cache_tmp_seq;
+    snprintf(tmp, sizeof(tmp), "%s.%ld.%u.tmp", path, (long)getpid(), atomic_fetch_add(&token_cache_tmp_seq, 1));
+
+    bool stored = false;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if(fd >= 0){
+        bool written = token_cache_write_all(fd, data, l.end);
+        stored = close(fd) == 0 && written && rename(tmp, path) == 0;
+        if(!stored) unlink(tmp);
+    }
+    free(data);
+    return stored;
+}
+
+#endif // IMPEL_C_TOKEN_CACHE
+
+#ifdef __cplusplus
+}
+#endif
+#endif // C_TOKEN_CACHE_H
@@ -0,0 +1,15 @@
+// casts and compound literals, with and without known type names
+typedef struct Pair { int a, b; } Pair;
+typedef unsigned long Size;
+void casts(void){
+    x = (int)y;
+    x = (Pair*)p;
+    x = (Size)-1;
+    x = (float)(int)y;
+    x = (unknown_t)y;
+    x = (f)(y);
+    p = &(Pair){ 1, 2 };
+    q = (int[]){ [0] = 1, [2] = 3 };
+    s = (struct Pair){ .a = 1, .b = 2 }.b;
+    n = sizeof(Pair) + sizeof p;
+}
@@ -0,0 +1,15 @@
+// the extended language: `let` declarations and the sized number types
+let count = 0;
+let ratio: f64 = 0.5;
+let table: u8* = 0;
+u16 port;
+i32 delta = -1;
+u64 sizes[4];
+f32 scale(f32 v, u8 shift){
+    let r: f32 = v;
+    let w = (i64)shift << 2;
+    let m = (u8)w + 1;
+    i8 small = (i8)w;
+    u32* out;
+    return r * small;
+}
@@ -0,0 +1,17 @@
+// binding powers and associativity of the expression parser
+void precedence(void){
+    a = b = c;
+    a += b -= c;
+    x = a - b - c;
+    x = a + b * c - d / e % f;
+    x = a || b && c | d ^ e & f;
+    x = a == b != c < d;
+    x = a << b + c;
+    x = a & b == c;
+    x = a ? b : c ? d : e;
+    x = a ?: b;
+    x = -a++ + !b-- * ~*p++;
+    x = sizeof a + b;
+    x = a->b.c[d](e, f)[g];
+    x = a, y = b;
+}
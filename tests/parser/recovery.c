@@ -0,0 +1,14 @@
+// every broken statement reports once and the next one parses again
+int before;
+void recovery(void){
+    x = ;
+    int y = 1
+    z = 2;
+    f(a b);
+    if(a) { g(); }
+}
+}
+int = 5;
+int after;
+void later(void){ return; }
+void not_a_shift(void){ x = a >< b; y = a > > b; }
@@ -0,0 +1,8 @@
+// `>>` and `>>=` are single tokens, `>` `>` is no shift
+void shifts(void){
+    x = a >> b >> c;
+    y >>= a >> 1;
+    z = a > b;
+    w = a >= b >> c;
+    if(a >> 1 > b) v = a << 2 >> 3;
+}
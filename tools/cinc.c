@@ -0,0 +1,119 @@
+// cinc: follows the #include graph of translation units and prints statistics
+//   cc -std=gnu2x -O2 -I.. cinc.c -o cinc
+//   ./cinc [-I dir]... [-iquote dir]... [-M] [-g] [-m] [-n] file...
+
+#define IMPEL_C_LEXER
+#define IMPEL_C_INCLUDE_GRAPH
+#include "../c_include_graph.h"
+#include <time.h>
+
+static void usage(FILE* out){
+    fprintf(out,
+        "usage: cinc [-I dir]... [-iquote dir]... [-M] [-g] [-m] [-n] file...\n"
+        "  file       a translation unit, walked with its own macro state\n"
+        "  -I DIR     search DIR for <name> and \"name\"\n"
+        "  -iquote DIR  search DIR for \"name\" only\n"
+        "  -M         print a make rule with the dependencies of every unit\n"
+        "  -g         print the include graph as Graphviz dot\n"
+        "  -m         list the includes no search path has\n"
+        "  -n         walk guarded headers again instead of skipping them\n");
+}
+
+static void print_make_rules(const IncludeGraph* g, FILE* out){
+    for(uint32_t u = 0; u < g->unit_len; u++){
+        const IncludeUnit* unit = &g->units[u];
+        fprintf(out, "%s:", g->files[unit->file].path);
+        for(uint32_t i = 0; i < unit->dep_count; i++){
+            fprintf(out, " \\\n  %s", g->files[g->deps[unit->first_dep + i]].path);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+static void print_dot(const IncludeGraph* g, FILE* out){
+    fprintf(out, "digraph includes {\n");
+    for(uint32_t f = 0; f < g->file_len; f++){
+        const IncludeFile* file = &g->files[f];
+        fprintf(out, "  n%u [label=\"%s\"%s];\n", f, file->path, file->guard || file->pragma_once ? "" : ", shape=box");
+    }
+    for(uint32_t e = 0; e < g->edge_len; e++){
+        fprintf(out, "  n%u -> n%u;\n", (uint32_t)(g->edges[e] >> 32), (uint32_t)g->edges[e]);
+    }
+    fprintf(out, "}\n");
+}
+
+static void print_missing(const IncludeGraph* g, FILE* out){
+    for(uint32_t i = 0; i < g->missing_len; i++){
+        const IncludeMissing* m = &g->missing[i];
+        const char* path = g->files[m->file].path;
+        if(!m->name){
+            fprintf(out, "%s:%u: computed include\n", path, m->line);
+        }else if(m->angled){
+            fprintf(out, "%s:%u: <%s> not found\n", path, m->line, include_graph_name(g, m->name));
+        }else{
+            fprintf(out, "%s:%u: \"%s\" not found\n", path, m->line, include_graph_name(g, m->name));
+        }
+    }
+}
+
+int main(int argc, char** argv){
+    IncludeGraph graph;
+    include_graph_init(&graph);
+    bool make_rules = false, dot = false, missing = false;
+    const char** units = (const char**)malloc((size_t)argc * sizeof(char*));
+    uint32_t unit_len = 0;
+    int status = 0;
+
+    for(int i = 1; i < argc; i++){
+        const char* arg = argv[i];
+        if(!strcmp(arg, "-h") || !strcmp(arg, "--help")){
+            usage(stdout);
+            return 0;
+        }else if(!strcmp(arg, "-I") && i + 1 < argc){
+            include_graph_add_path(&graph, argv[++i], false);
+        }else if(!strncmp(arg, "-I", 2) && arg[2]){
+            include_graph_add_path(&graph, arg + 2, false);
+        }else if(!strcmp(arg, "-iquote") && i + 1 < argc){
+            include_graph_add_path(&graph, argv[++i], true);
+        }else if(!strcmp(arg, "-M")){
+            make_rules = true;
+        }else if(!strcmp(arg, "-g")){
+            dot = true;
+        }else if(!strcmp(arg, "-m")){
+            missing = true;
+        }else if(!strcmp(arg, "-n")){
+            graph.reenter_guarded = true;
+        }else if(arg[0] == '-'){
+            usage(stderr);
+            return 1;
+        }else{
+            units[unit_len++] = arg;
+        }
+    }
+    if(unit_len == 0){
+        usage(stderr);
+        return 1;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(uint32_t i = 0; i < unit_len; i++){
+        if(include_graph_add_unit(&graph, units[i]) < 0){
+            fprintf(stderr, "cinc: cannot read `%s`\n", units[i]);
+            status = 1;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    double seconds = (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+
+    if(make_rules) print_make_rules(&graph, stdout);
+    if(dot) print_dot(&graph, stdout);
+    if(missing) print_missing(&graph, stdout);
+    if(!make_rules && !dot){
+        include_graph_stats_print(&graph.stats, stdout);
+        printf("time           %.3f s\n", seconds);
+    }
+    include_graph_deinit(&graph);
+    free(units);
+    return status;
+}
@@ -0,0 +1,213 @@
+// clex: lexes directories and file lists on all cores and prints statistics
+//   cc -std=gnu2x -O2 -pthread -I.. clex.c -o clex
+//   ./clex [-j threads] [-l list]... [-k] [-d] [-s] [-t trace.json] [-p] [-c cache] [-i] [-M] [-u] path...
+//   gunzip -c big.c.gz | ./clex -
+// -p needs a build with -DC_LEXER_PROFILE (make clex_profile)
+
+#define IMPEL_C_LEXER
+#define IMPEL_C_LEXER_PARALLEL
+#define IMPEL_C_LEXER_DRIVER
+#include "../c_lexer_driver.h"
+
+static void usage(FILE* out){
+    fprintf(out,
+        "usage: clex [-j threads] [-l list]... [-k] [-d] [-s] [-t trace.json] [-p] [-c cache] [-i] [-M] [-u] path...\n"
+        "  path     a file, or a directory searched for .c and .h files,\n"
+        "           `-` lexes stdin as a stream in constant memory\n"
+        "  -j N     worker threads, defaults to the online cpus\n"
+        "  -l FILE  newline separated paths, `-` reads them from stdin\n"
+        "  -k       print the per token kind histogram\n"
+        "  -d       print every diagnostic\n"
+        "  -s       intern identifiers and count the distinct ones\n"
+        "  -t FILE  write per-file timing spans as Chrome trace JSON\n"
+        "  -p       print the lexer state machine profile (C_LEXER_PROFILE builds)\n"
+        "  -c DIR   reuse the tokens of unchanged files from a token cache\n"
+        "           directory and add the others to it\n"
+        "  -i       lex the preprocessor directives only\n"
+        "  -M       print the #include and #embed names of every file, implies -i\n"
+        "  -u       read the small files in batches, through io_uring where the\n"
+        "           kernel has it, to hide the latency of a cold page cache\n");
+}
+
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+typedef struct PrintOptions {
+    bool diagnostics;
+    bool dependencies;
+} PrintOptions;
+
+// `file: <a.h> "b.h"`, the names as written; computed includes are left out
+static void print_dependencies(const CFile* file, const TokenBuffer* tokens, FILE* out){
+    fprintf(out, "%s:", file->name);
+    for(uint32_t i = 0; i < tokens->len; i++){
+        TokenKind kind = (TokenKind)tokens->kinds[i];
+        const char* p = file->buffer + tokens->offsets[i];
+        if(kind == Tok_hash){
+            // `#  include`, the hash token stops before the blanks
+            while(*p == ' ' || *p == '\t') p++;
+            const char* name = p;
+            while((*p >= 'a' && *p <= 'z') || *p == '_') p++;
+            kind = builtin_lookup(name, (uint32_t)(p - name));
+        }else{
+            p += token_len_at(file->buffer, kind, tokens->offsets[i]);
+        }
+        if(kind != Tok_builtin_include && kind != Tok_builtin_embed) continue;
+        while(*p == ' ' || *p == '\t') p++;
+        char close = *p == '<' ? '>' : *p == '"' ? '"' : 0;
+        if(!close) continue;
+        const char* end = p + 1;
+        while(*end && *end != close && *end != '\n') end++;
+        if(*end == close) fprintf(out, " %.*s", (int)(end + 1 - p), p);
+    }
+    fprintf(out, "\n");
+}
+
+static void print_file(void* ctx, const CFile* file, const TokenBuffer* tokens, const Lexer* lexer){
+    const PrintOptions* options = (const PrintOptions*)ctx;
+    bool diagnostics = options->diagnostics && lexer->diag_len;
+    if(!diagnostics && !options->dependencies) return;
+    pthread_mutex_lock(&print_lock);
+    if(options->dependencies) print_dependencies(file, tokens, stdout);
+    if(diagnostics) lexer_print_diagnostics(lexer, stderr, file->name);
+    pthread_mutex_unlock(&print_lock);
+}
+
+typedef struct StdinReader {
+    int fd;
+    char last; // last byte read, to count an unterminated final line
+} StdinReader;
+
+static ssize_t read_stdin(void* ctx, char* buf, size_t cap){
+    StdinReader* r = (StdinReader*)ctx;
+    ssize_t n = lexer_read_fd(&r->fd, buf, cap);
+    if(n > 0) r->last = buf[n - 1];
+    return n;
+}
+
+// stdin goes through a stream lexer instead of the driver: it may be a pipe
+// of any size, so it is never read into memory as a whole
+static void lex_stdin(LexerStats* stats, bool diagnostics, Interner* interner, LexerProfile* profile){
+    StdinReader reader = { .fd = STDIN_FILENO, .last = '\n' };
+    LexerStream stream;
+    lexer_stream_init(&stream, read_stdin, &reader, 0);
+    Lexer lexer = lexer_init_stream(&stream);
+    lexer.interner = interner;
+    lexer.profile = profile;
+    Token tok;
+    do{
+        tok = lexer_next_token(&lexer);
+        stats->kinds[tok.kind] += 1;
+        stats->tokens += tok.kind != Tok_eof;
+    }while(tok.kind != Tok_eof);
+
+    stats->files += 1;
+    stats->bytes += lexer_stream_offset(&lexer, tok.loc);
+    if(LEXER_FIRST_LINE) stats->lines += lexer.line - 1 + (reader.last != '\n');
+    stats->diagnostics += lexer.diag_len;
+    if(interner) stats->symbols = interner->len - 1;
+    if(diagnostics) lexer_print_diagnostics(&lexer, stderr, "<stdin>");
+    lexer_deinit(&lexer);
+    lexer_stream_deinit(&stream);
+}
+
+int main(int argc, char** argv){
+    LexerDriver driver;
+    lexer_driver_init(&driver, 0);
+    bool kinds = false, diagnostics = false, from_stdin = false;
+    PrintOptions print = {0};
+    Interner interner;
+    LexerProfile profile = {0};
+    const char* trace_name = NULL;
+    int status = 0;
+
+    for(int i = 1; i < argc; i++){
+        const char* arg = argv[i];
+        if(!strcmp(arg, "-h") || !strcmp(arg, "--help")){
+            usage(stdout);
+            return 0;
+        }else if(!strcmp(arg, "-j") && i + 1 < argc){
+            int n = atoi(argv[++i]);
+            driver.threads = n > 0 ? (uint32_t)n : 1;
+        }else if(!strcmp(arg, "-l") && i + 1 < argc){
+            const char* name = argv[++i];
+            FILE* list = strcmp(name, "-") ? fopen(name, "r") : stdin;
+            if(!list){
+                fprintf(stderr, "clex: cannot open list `%s`\n", name);
+                return 1;
+            }
+            if(!lexer_driver_add_list(&driver, list)) status = 1;
+            if(list != stdin) fclose(list);
+        }else if(!strcmp(arg, "-k")){
+            kinds = true;
+        }else if(!strcmp(arg, "-d")){
+            print.diagnostics = diagnostics = true;
+        }else if(!strcmp(arg, "-s")){
+            if(!driver.interner) interner_init(&interner, 0);
+            driver.interner = &interner;
+        }else if(!strcmp(arg, "-t") && i + 1 < argc){
+            trace_name = argv[++i];
+        }else if(!strcmp(arg, "-c") && i + 1 < argc){
+            driver.cache_dir = argv[++i];
+        }else if(!strcmp(arg, "-i")){
+            driver.directives_only = true;
+        }else if(!strcmp(arg, "-M")){
+            driver.directives_only = print.dependencies = true;
+        }else if(!strcmp(arg, "-u")){
+            driver.batched_io = true;
+        }else if(!strcmp(arg, "-p")){
+#ifndef C_LEXER_PROFILE
+            fprintf(stderr, "clex: -p needs a build with -DC_LEXER_PROFILE\n");
+            return 1;
+#endif
+            driver.profile = &profile;
+        }else if(!strcmp(arg, "-")){
+            from_stdin = true;
+        }else if(arg[0] == '-' && arg[1]){
+            usage(stderr);
+            return 1;
+        }else if(!lexer_driver_add_path(&driver, arg)){
+            fprintf(stderr, "clex: cannot read `%s`\n", arg);
+            status = 1;
+        }
+    }
+    if(driver.directives_only && from_stdin){
+        fprintf(stderr, "clex: -i and -M need files, stdin is lexed as a stream\n");
+        return 1;
+    }
+    if(print.diagnostics || print.dependencies){
+        driver.on_file = print_file;
+        driver.ctx = &print;
+    }
+    if(driver.len == 0 && !from_stdin){
+        usage(stderr);
+        return 1;
+    }
+
+    if(trace_name && !(driver.trace = fopen(trace_name, "w"))){
+        fprintf(stderr, "clex: cannot write `%s`\n", trace_name);
+        return 1;
+    }
+
+    LexerStats stats = {0};
+    uint32_t threads = driver.threads;
+    if(driver.len) lexer_driver_run(&driver, &stats);
+    if(from_stdin){
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        lex_stdin(&stats, diagnostics, driver.interner, driver.profile);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        stats.seconds += (double)(t1.tv_sec - t0.tv_sec) + (double)(t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    }
+    if(print.dependencies){
+        fprintf(stderr, "threads      %u\n", threads);
+        lexer_stats_print(&stats, stderr, kinds);
+    }else{
+        printf("threads      %u\n", threads);
+        lexer_stats_print(&stats, stdout, kinds);
+    }
+    if(driver.profile) lexer_profile_print(driver.profile, stdout);
+    if(driver.trace) fclose(driver.trace);
+    if(driver.interner) interner_deinit(driver.interner);
+    lexer_driver_deinit(&driver);
+    return stats.failed_files ? 1 : status;
+}
@@ -0,0 +1,142 @@
+// cparse: parses C and extended language files into flat syntax trees and prints statistics
+//   cc -std=gnu2x -O2 -I.. cparse.c -o cparse
+//   ./cparse [-p] [-d] file...
+
+#define IMPEL_C_LEXER
+#define IMPEL_C_PARSER
+#include "../c_parser.h"
+#include <time.h>
+
+static void usage(FILE* out){
+    fprintf(out,
+        "usage: cparse [-p] [-d] file...\n"
+        "  file     a source file, parsed without preprocessing\n"
+        "  -p       print the syntax tree of every file\n"
+        "  -d       print every diagnostic\n");
+}
+
+typedef struct ParseStats {
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t tokens;
+    uint64_t nodes;
+    uint64_t extra;
+    uint64_t errors;
+    uint64_t files_with_errors;
+    uint64_t kinds[AST_KIND_COUNT];
+    double lex_seconds;
+    double parse_seconds;
+} ParseStats;
+
+static double seconds_since(const struct timespec* t0){
+    struct timespec t1;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return (double)(t1.tv_sec - t0->tv_sec) + (double)(t1.tv_nsec - t0->tv_nsec) * 1e-9;
+}
+
+static void print_stats(const ParseStats* s, FILE* out){
+    double per_token = s->tokens ? (double)s->nodes / (double)s->tokens : 0.0;
+    uint64_t tree_bytes = s->nodes * sizeof(AstNode) + s->extra * sizeof(uint32_t);
+    fprintf(out, "files          %llu\n", (unsigned long long)s->files);
+    fprintf(out, "bytes          %llu\n", (unsigned long long)s->bytes);
+    fprintf(out, "tokens         %llu\n", (unsigned long long)s->tokens);
+    fprintf(out, "nodes          %llu (%.2f per token)\n", (unsigned long long)s->nodes, per_token);
+    fprintf(out, "extra          %llu words\n", (unsigned long long)s->extra);
+    fprintf(out, "tree           %.1f MiB\n", (double)tree_bytes / (1024.0 * 1024.0));
+    fprintf(out, "errors         %llu in %llu files\n", (unsigned long long)s->errors, (unsigned long long)s->files_with_errors);
+    fprintf(out, "lex time       %.3f s\n", s->lex_seconds);
+    fprintf(out, "parse time     %.3f s (%.1f MB/s, %.1f Mtokens/s)\n", s->parse_seconds,
+            s->parse_seconds > 0 ? (double)s->bytes / s->parse_seconds * 1e-6 : 0.0,
+            s->parse_seconds > 0 ? (double)s->tokens / s->parse_seconds * 1e-6 : 0.0);
+    fprintf(out, "top node kinds\n");
+    uint64_t kinds[AST_KIND_COUNT];
+    memcpy(kinds, s->kinds, sizeof(kinds));
+    for(uint32_t shown = 0; shown < 10; shown++){
+        uint32_t best = 0;
+        for(uint32_t k = 1; k < AST_KIND_COUNT; k++){
+            if(kinds[k] > kinds[best]) best = k;
+        }
+        if(!kinds[best]) break;
+        fprintf(out, "  %-18s %12llu\n", ast_kind_to_str((AstKind)best), (unsigned long long)kinds[best]);
+        kinds[best] = 0;
+    }
+}
+
+int main(int argc, char** argv){
+    bool print_tree = false, print_diags = false;
+    const char** files = (const char**)malloc((size_t)argc * sizeof(char*));
+    uint32_t file_len = 0;
+    int status = 0;
+
+    for(int i = 1; i < argc; i++){
+        const char* arg = argv[i];
+        if(!strcmp(arg, "-h") || !strcmp(arg, "--help")){
+            usage(stdout);
+            return 0;
+        }else if(!strcmp(arg, "-p")){
+            print_tree = true;
+        }else if(!strcmp(arg, "-d")){
+            print_diags = true;
+        }else if(arg[0] == '-'){
+            usage(stderr);
+            return 1;
+        }else{
+            files[file_len++] = arg;
+        }
+    }
+    if(file_len == 0){
+        usage(stderr);
+        return 1;
+    }
+
+    // the tokens and the tree of a file go with one arena_clear
+    Arena arena;
+    arena_init(&arena, 0, 0);
+    Lexer lexer = lexer_init_s("", 0);
+    ParseStats stats = {0};
+    for(uint32_t i = 0; i < file_len; i++){
+        CFile file;
+        if(cfile_init_mmap(&file, files[i])){
+            fprintf(stderr, "cparse: cannot read `%s`\n", files[i]);
+            status = 1;
+            continue;
+        }
+        struct timespec t0;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        lexer_reset(&lexer, file.buffer, (uint32_t)file.size);
+        TokenBuffer tokens;
+        token_buffer_init_arena(&tokens, 0, file.size, &arena);
+        lexer_tokenize_all(&lexer, &tokens);
+        stats.lex_seconds += seconds_since(&t0);
+
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        Ast ast;
+        ast_init(&ast, &arena);
+        uint32_t errors = ast_parse(&ast, file.buffer, (uint32_t)file.size, &tokens);
+        stats.parse_seconds += seconds_since(&t0);
+
+        if(print_tree) ast_print(&ast, 0, stdout);
+        if(print_diags){
+            lexer_print_diagnostics(&lexer, stderr, files[i]);
+            ast_print_diagnostics(&ast, stderr, files[i]);
+        }
+        stats.files += 1;
+        stats.bytes += file.size;
+        stats.tokens += tokens.len;
+        stats.nodes += ast.node_len;
+        stats.extra += ast.extra_len;
+        stats.errors += errors;
+        stats.files_with_errors += errors != 0;
+        for(uint32_t n = 0; n < ast.node_len; n++) stats.kinds[ast.nodes[n].kind] += 1;
+
+        ast_deinit(&ast);
+        token_buffer_deinit(&tokens);
+        arena_clear(&arena);
+        cfile_deinit(&file);
+    }
+    if(!print_tree) print_stats(&stats, stdout);
+    lexer_deinit(&lexer);
+    arena_deinit(&arena);
+    free(files);
+    return status;
+}